@@ -77,6 +77,14 @@ enum GfxFormat
     GFX_FORMAT_D32_SFLOAT,
     GFX_FORMAT_D16_UNORM_S8_UINT,
     GFX_FORMAT_D32_SFLOAT_S8_UINT,
+    GFX_FORMAT_BC1_RGB_UNORM,
+    GFX_FORMAT_BC1_RGB_SRGB,
+    GFX_FORMAT_BC3_UNORM,
+    GFX_FORMAT_BC3_SRGB,
+    GFX_FORMAT_BC4_UNORM,
+    GFX_FORMAT_BC5_UNORM,
+    GFX_FORMAT_BC7_UNORM,
+    GFX_FORMAT_BC7_SRGB,
 };
 enum GfxBufferAccess
 {
@@ -141,11 +149,14 @@ enum GfxBorderColor
 	GFX_BORDER_COLOR_INT_OPAQUE_BLACK,
 	GFX_BORDER_COLOR_INT_OPAQUE_WHITE,
 };
+#define GFX_MODEL_MAX_LOD_COUNT 5
+
 enum GfxModelVertexAttribute
 {
     GFX_MODEL_VERTEX_ATTRIBUTE_POSITION = 0,         // RGBM16_UNORM
     GFX_MODEL_VERTEX_ATTRIBUTE_TEXCOORD,             // RG16_SFLOAT
-    GFX_MODEL_VERTEX_ATTRIBUTE_NORMAL,               // RGBA8_UNORM
+    GFX_MODEL_VERTEX_ATTRIBUTE_NORMAL,               // RG16_SNORM, octahedral encoded
+    GFX_MODEL_VERTEX_ATTRIBUTE_TANGENT_FRAME,        // RGBA16_SNORM, quaternion rotating x to the tangent and z to the normal, w < 0 flips the bitangent
     GFX_MODEL_VERTEX_ATTRIBUTE_COUNT
 };
 enum GfxBufferUsageBits : uint32_t
@@ -163,6 +174,17 @@ enum GfxTextureUsageBits : uint32_t
 	GFX_TEXTURE_USAGE_COLOR_ATTACHMENT_BIT			= 1 << 2,
 	GFX_TEXTURE_USAGE_DEPTH_ATTACHMENT_BIT	        = 1 << 3,
 };
+enum GfxSubgroupFeatureBits : uint32_t
+{
+    GFX_SUBGROUP_FEATURE_BASIC_BIT                  = 1 << 0,
+    GFX_SUBGROUP_FEATURE_VOTE_BIT                   = 1 << 1,
+    GFX_SUBGROUP_FEATURE_ARITHMETIC_BIT             = 1 << 2,
+    GFX_SUBGROUP_FEATURE_BALLOT_BIT                 = 1 << 3,
+    GFX_SUBGROUP_FEATURE_SHUFFLE_BIT                = 1 << 4,
+    GFX_SUBGROUP_FEATURE_SHUFFLE_RELATIVE_BIT       = 1 << 5,
+    GFX_SUBGROUP_FEATURE_CLUSTERED_BIT              = 1 << 6,
+    GFX_SUBGROUP_FEATURE_QUAD_BIT                   = 1 << 7,
+};
 
 #ifdef _WIN32
 #define LIB_EXPORT __declspec(dllexport)
@@ -177,12 +199,52 @@ struct GfxCreateDeviceParams
 	uint32_t					m_BackBufferHeight;
 	uint32_t					m_DesiredBackBufferCount;
     bool                        m_EnableValidationLayer;
+    bool                        m_CompressBlobs             = false;    // LZ compress large sections of newly cooked blobs
+    bool                        m_StreamModelTextures       = false;    // See GfxUpdateModelTextureStreaming
+    uint64_t                    m_MemoryBudget              = 0;        // Device local bytes, 0 for the size of the device local heaps
 };
 LIB_EXPORT GfxDevice			GfxCreateDevice(const GfxCreateDeviceParams& params);
 LIB_EXPORT void					GfxDestroyDevice(GfxDevice device);
 LIB_EXPORT void					GfxResizeSwapchain(GfxDevice device, uint32_t width, uint32_t height);
 LIB_EXPORT void                 GfxWaitForGpu(GfxDevice device);
 
+// An asset pack holds the cooked blobs of many source files in one mapped file. Loaders look in the mounted packs
+// first and use a packed blob as it is, without opening the source file. GfxCreateAssetPack packs the blobs already
+// cooked to Data/ for the given source filepaths, which must be spelled the same way as when they are loaded.
+// A pack only mounts when its blobs were cooked by this version of the library.
+// A pack holding BCn textures fails to mount on devices without BC support.
+LIB_EXPORT bool                 GfxMountAssetPack(GfxDevice device, const char* filepath);
+LIB_EXPORT bool                 GfxCreateAssetPack(const char* filepath, const char* const* source_filepaths, uint32_t source_filepath_count);
+
+struct GfxDeviceCaps
+{
+    uint32_t                    m_SubgroupSize;                 // 1 when subgroups are not supported
+    uint32_t                    m_SubgroupFeatures;             // GfxSubgroupFeatureBits
+    bool                        m_SubgroupVertexShader;
+    bool                        m_SubgroupFragmentShader;
+    bool                        m_SubgroupComputeShader;
+    bool                        m_SubgroupQuadOperationsInAllStages;
+    bool                        m_MultiDrawIndirect;            // Emulated with one draw per command when not supported
+    bool                        m_DrawIndirectFirstInstance;
+    bool                        m_DrawIndirectCount;            // GfxCmdDraw*IndirectCount
+    uint32_t                    m_MaxDrawIndirectCount;
+    bool                        m_SampledImageArrayDynamicIndexing;
+    bool                        m_TextureCompressionBC;         // GfxLoadTexture cooks BCn textures when supported
+    bool                        m_FragmentStoresAndAtomics;     // Needed for model texture streaming feedback
+    bool                        m_MemoryBudget;                 // VK_EXT_memory_budget
+};
+LIB_EXPORT const GfxDeviceCaps& GfxGetDeviceCaps(GfxDevice device);
+
+// Refreshed by GfxBeginFrame. With VK_EXT_memory_budget the usage is that of the whole process and the budget is what
+// the driver reports, capped by GfxCreateDeviceParams::m_MemoryBudget. Otherwise the usage only counts Gfx buffers and
+// textures and the budget is the configured one. Streamed model textures are evicted to stay within it.
+struct GfxMemoryBudget
+{
+    uint64_t                    m_Usage;
+    uint64_t                    m_Budget;
+};
+LIB_EXPORT GfxMemoryBudget      GfxGetMemoryBudget(GfxDevice device);
+
 LIB_EXPORT uint32_t             GfxGetBackBufferCount(GfxDevice device);
 LIB_EXPORT uint32_t             GfxGetBackBufferIndex(GfxDevice device);
 LIB_EXPORT GfxTexture           GfxGetBackBuffer(GfxDevice device, uint32_t index);
@@ -209,6 +271,9 @@ LIB_EXPORT GfxBuffer			GfxCreateBuffer(GfxDevice device, const GfxCreateBufferPa
 LIB_EXPORT void					GfxDestroyBuffer(GfxDevice device, GfxBuffer buffer);
 
 
+// m_Data holds m_MipCount mips of each of the m_LayerCount layers, a mip of a 3D texture holds all of its slices.
+// m_SubresourceOffsets tells where each of them starts in m_Data, indexed by layer * m_MipCount + mip. Without it the
+// layers follow one another, each with its mips packed one after another. Everything is uploaded in a single copy.
 struct GfxCreateTextureParams
 {
     GfxTextureType              m_Type                      = GFX_TEXTURE_TYPE_2D;
@@ -220,9 +285,14 @@ struct GfxCreateTextureParams
 	GfxTextureState				m_InitialState				= GFX_TEXTURE_STATE_SHADER_READ;
 	const void*					m_Data						= NULL;
 	size_t						m_DataSize					= 0;
-    bool                        m_GenerateMipmaps           = false;
+    uint32_t                    m_MipCount                  = 1;        // Mips of each layer in m_Data
+    uint32_t                    m_LayerCount                = 1;        // Of 2D arrays, a multiple of 6 for cubes and cube arrays
+    const uint64_t*             m_SubresourceOffsets        = NULL;     // m_MipCount * m_LayerCount offsets into m_Data
+    bool                        m_GenerateMipmaps           = false;    // From the first mip of each layer in m_Data, not for BCn formats
 };
 LIB_EXPORT GfxTexture			GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& params);
+// Loads of the same file, including the textures of models that do not stream, share one texture. It is destroyed
+// once GfxDestroyTexture has been called for every load.
 LIB_EXPORT GfxTexture           GfxLoadTexture(GfxDevice device, const char* filepath);
 LIB_EXPORT void					GfxDestroyTexture(GfxDevice device, GfxTexture texture);
 
@@ -250,6 +320,25 @@ LIB_EXPORT void					GfxDestroySampler(GfxDevice device, GfxSampler sampler);
 
 LIB_EXPORT GfxTechnique			GfxCreateTechnique(GfxDevice device, const void* data, size_t size, GfxTechnique old_tech = NULL);
 LIB_EXPORT GfxTechnique         GfxLoadTechnique(GfxDevice device, const char* filepath);
+
+struct GfxSpecializationConstant
+{
+    uint64_t                    m_Hash                      = 0;    // GFX_HASH of the name, work group size is "local_size_x/y/z"
+    union
+    {
+        uint32_t                m_Uint                      = 0;
+        int32_t                 m_Int;
+        float                   m_Float;
+    };
+};
+// A variant of a variant starts from the constants of its parent, the constants given override them
+LIB_EXPORT GfxTechnique         GfxCreateTechniqueVariant(GfxDevice device, GfxTechnique tech, const GfxSpecializationConstant* constants, uint32_t constant_count);
+
+LIB_EXPORT const uint32_t*      GfxGetTechniqueWorkGroupSize(GfxTechnique tech);
+
+// Times a set of work group sizes and keeps the fastest, the result is cached per device in Data/Autotune
+typedef void(*GfxAutotuneDispatchFunction)(GfxCommandBuffer cmd, GfxTechnique tech, void* user_data);
+LIB_EXPORT void                 GfxAutotuneTechnique(GfxDevice device, GfxTechnique tech, GfxAutotuneDispatchFunction dispatch, void* user_data);
 LIB_EXPORT void					GfxDestroyTechnique(GfxDevice device, GfxTechnique tech);
 #ifdef _DEBUG
 LIB_EXPORT void                 GfxReloadAllTechniques(GfxDevice device);
@@ -271,14 +360,76 @@ LIB_EXPORT void                 GfxDestroyModel(GfxDevice device, GfxModel model
 LIB_EXPORT uint32_t             GfxGetModelMeshCount(GfxModel model);
 LIB_EXPORT uint32_t             GfxGetModelMaterialIndex(GfxModel model, uint32_t mesh_index);
 LIB_EXPORT GfxTexture           GfxGetModelDiffuseTexture(GfxModel model, uint32_t material_index);
+LIB_EXPORT uint32_t             GfxGetModelTextureCount(GfxModel model);
+LIB_EXPORT const GfxTexture*    GfxGetModelTextures(GfxModel model);
+
+// With m_StreamModelTextures, GfxLoadModel only creates the mips of at most 64 texels of each texture. Shaders report
+// what they sample in the buffer set by GfxCmdSetModelTextureFeedback, one uint per texture index that is combined
+// with atomicMax and holds the width of the finest mip sampled, as textureSize(tex, 0).x * exp2(-floor(lod)) with
+// the lod from textureQueryLod(tex, uv).y. GfxUpdateModelTextureStreaming reads back the feedback of the frame that
+// last used the same back buffer, loads the mips asked for on the file workers and creates the larger textures.
+// It must be called once per frame after GfxBeginFrame. GfxGetModelTextures may change on every call: a larger
+// texture replaces the old one in the frame after it is created, until then shaders keep sampling the mips resident.
+// Mips are only loaded while they fit in the memory budget. Over budget, the textures of every streaming model that
+// were sampled longest ago are evicted back to their tail. Textures only stream with m_FragmentStoresAndAtomics,
+// without it models load their full mip chains, GfxCmdSetModelTextureFeedback binds a buffer nothing reads back and
+// shaders must leave the feedback write out, for instance behind a specialization constant.
+LIB_EXPORT void                 GfxUpdateModelTextureStreaming(GfxDevice device, GfxModel model);
+LIB_EXPORT void                 GfxCmdSetModelTextureFeedback(GfxCommandBuffer cmd, uint64_t hash, GfxModel model);
+
+LIB_EXPORT void                 GfxGetModelMeshBoundingBox(GfxModel model, uint32_t mesh_index, float out_min[3], float out_max[3]);
+LIB_EXPORT void                 GfxGetModelMeshBoundingSphere(GfxModel model, uint32_t mesh_index, float out_center[3], float* out_radius);
 LIB_EXPORT const float*         GfxGetModelBoundingBoxMin(GfxModel model);
 LIB_EXPORT const float*         GfxGetModelBoundingBoxMax(GfxModel model);
 LIB_EXPORT float                GfxGetModelQuantizationScale(GfxModel model);
 
 LIB_EXPORT void                 GfxCmdBindModelVertexBuffer(GfxCommandBuffer cmd, GfxModel model, GfxModelVertexAttribute attribute, uint32_t binding);
+// Meshes use 16-bit indices when they fit, the model draw commands bind the index buffer for the size they need
 LIB_EXPORT void                 GfxCmdBindModelIndexBuffer(GfxCommandBuffer cmd, GfxModel model);
 LIB_EXPORT void                 GfxCmdDrawModel(GfxCommandBuffer cmd, GfxModel model, uint32_t mesh_index, uint32_t instance_count);
 
+// Meshes get up to GFX_MODEL_MAX_LOD_COUNT simplified index lists when the model is cooked, LOD 0 is the full detail mesh.
+// GfxSelectModelMeshLod returns the coarsest LOD whose simplification error projects to at most max_pixel_error pixels,
+// projection_scale is the projection matrix [1][1] element times half the viewport height.
+LIB_EXPORT uint32_t             GfxGetModelMeshLodCount(GfxModel model, uint32_t mesh_index);
+LIB_EXPORT uint32_t             GfxSelectModelMeshLod(GfxModel model, uint32_t mesh_index, const float world[16], const float camera_position[3], float projection_scale, float max_pixel_error);
+LIB_EXPORT void                 GfxCmdDrawModelLod(GfxCommandBuffer cmd, GfxModel model, uint32_t mesh_index, uint32_t lod, uint32_t instance_count);
+
+// GfxCmdDrawModelAll draws every mesh with one multi draw, the first instance of mesh i is i * instance_count
+// so shaders find the draw data at gl_InstanceIndex / instance_count
+struct GfxModelDrawData
+{
+    uint32_t                    m_MeshIndex;
+    uint32_t                    m_MaterialIndex;
+    int32_t                     m_DiffuseTextureIndex;          // Index into GfxGetModelTextures, -1 when missing
+    uint32_t                    m_Padding;
+};
+LIB_EXPORT void                 GfxCmdSetModelDrawData(GfxCommandBuffer cmd, uint64_t hash, GfxModel model);
+LIB_EXPORT void                 GfxCmdDrawModelAll(GfxCommandBuffer cmd, GfxModel model, uint32_t instance_count);
+// lods holds one LOD per entry of mesh_indices, NULL draws LOD 0
+LIB_EXPORT void                 GfxCmdDrawModelMeshes(GfxCommandBuffer cmd, GfxModel model, const uint32_t* mesh_indices, uint32_t mesh_index_count, uint32_t instance_count, const uint32_t* lods = NULL);
+
+// Frustum culls the mesh bounding boxes on the CPU, view_proj transforms from model space to clip space.
+// out_visible needs room for every mesh index, returns the number of visible meshes written.
+LIB_EXPORT uint32_t             GfxCullModelMeshes(GfxModel model, const float view_proj[16], uint32_t* out_visible);
+
+// Frustum culls every mesh of every instance on the GPU, must be recorded outside a technique.
+// instance_buffer holds one column major 4x4 world matrix per instance, indirect_buffer needs room for
+// mesh count * instance count GfxDrawIndexedIndirectCommand and count_buffer for two uint32_t, one per index size.
+// Both output buffers are left ready for GfxCmdDrawModelCulled, which uses the same instance layout as GfxCmdDrawModelAll.
+// GfxCmdDrawModelCulled needs GfxDeviceCaps::m_DrawIndirectFirstInstance.
+LIB_EXPORT void                 GfxCmdCullModel(GfxCommandBuffer cmd, GfxModel model, GfxBuffer instance_buffer, uint32_t instance_count, const float view_proj[16], GfxBuffer indirect_buffer, GfxBuffer count_buffer);
+LIB_EXPORT void                 GfxCmdDrawModelCulled(GfxCommandBuffer cmd, GfxModel model, uint32_t instance_count, GfxBuffer indirect_buffer, GfxBuffer count_buffer);
+
+// Meshes are split into meshlets of at most 64 vertices and 124 triangles when the model is cooked.
+// GfxCmdCullModelMeshlets frustum and back face culls them on the GPU for one instance, must be recorded outside a technique.
+// indirect_buffer needs room for GfxGetModelMeshletCount GfxDrawIndexedIndirectCommand and count_buffer for two uint32_t.
+// The first instance of each draw is its mesh index, so GfxCmdDrawModelMeshletsCulled needs
+// GfxDeviceCaps::m_DrawIndirectFirstInstance.
+LIB_EXPORT uint32_t             GfxGetModelMeshletCount(GfxModel model);
+LIB_EXPORT void                 GfxCmdCullModelMeshlets(GfxCommandBuffer cmd, GfxModel model, const float world[16], const float view_proj[16], const float camera_position[3], GfxBuffer indirect_buffer, GfxBuffer count_buffer);
+LIB_EXPORT void                 GfxCmdDrawModelMeshletsCulled(GfxCommandBuffer cmd, GfxModel model, GfxBuffer indirect_buffer, GfxBuffer count_buffer);
+
 
 LIB_EXPORT void                 GfxCmdBeginTechnique(GfxCommandBuffer cmd, GfxTechnique tech);
 LIB_EXPORT void                 GfxCmdEndTechnique(GfxCommandBuffer cmd);
@@ -304,13 +455,44 @@ constexpr uint64_t GfxHash(const char* str, size_t len)
 
 LIB_EXPORT void                 GfxCmdSetBuffer(GfxCommandBuffer cmd, uint64_t hash, GfxBuffer buffer, uint64_t offset, uint64_t size);
 LIB_EXPORT void                 GfxCmdSetTexture(GfxCommandBuffer cmd, uint64_t hash, GfxTexture texture, GfxTextureState state);
+// NULL textures are bound as a white texture. Textures past the size of the array are left out, reported once per
+// technique. Arrays declared with a count naming a specialization constant are sized when the technique is created.
+LIB_EXPORT void                 GfxCmdSetTextures(GfxCommandBuffer cmd, uint64_t hash, const GfxTexture* textures, uint32_t texture_count, GfxTextureState state);
 LIB_EXPORT void                 GfxCmdSetSampler(GfxCommandBuffer cmd, uint64_t hash, GfxSampler sampler);
 LIB_EXPORT void*                GfxCmdAllocUploadBuffer(GfxCommandBuffer cmd, uint64_t hash, uint32_t size);
 
-LIB_EXPORT void                 GfxCmdDraw(GfxCommandBuffer cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex);
-LIB_EXPORT void                 GfxCmdDrawIndexed(GfxCommandBuffer cmd, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset);
+LIB_EXPORT void                 GfxCmdDraw(GfxCommandBuffer cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance = 0);
+LIB_EXPORT void                 GfxCmdDrawIndexed(GfxCommandBuffer cmd, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance = 0);
 LIB_EXPORT void                 GfxCmdDispatch(GfxCommandBuffer cmd, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z);
 
+// Layouts of the commands read from indirect buffers
+struct GfxDrawIndirectCommand
+{
+    uint32_t                    m_VertexCount;
+    uint32_t                    m_InstanceCount;
+    uint32_t                    m_FirstVertex;
+    uint32_t                    m_FirstInstance;
+};
+struct GfxDrawIndexedIndirectCommand
+{
+    uint32_t                    m_IndexCount;
+    uint32_t                    m_InstanceCount;
+    uint32_t                    m_FirstIndex;
+    int32_t                     m_VertexOffset;
+    uint32_t                    m_FirstInstance;
+};
+struct GfxDispatchIndirectCommand
+{
+    uint32_t                    m_GroupCountX;
+    uint32_t                    m_GroupCountY;
+    uint32_t                    m_GroupCountZ;
+};
+LIB_EXPORT void                 GfxCmdDrawIndirect(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, uint32_t draw_count, uint32_t stride = sizeof(GfxDrawIndirectCommand));
+LIB_EXPORT void                 GfxCmdDrawIndexedIndirect(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, uint32_t draw_count, uint32_t stride = sizeof(GfxDrawIndexedIndirectCommand));
+LIB_EXPORT void                 GfxCmdDrawIndirectCount(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, GfxBuffer count_buffer, uint64_t count_offset, uint32_t max_draw_count, uint32_t stride = sizeof(GfxDrawIndirectCommand));
+LIB_EXPORT void                 GfxCmdDrawIndexedIndirectCount(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, GfxBuffer count_buffer, uint64_t count_offset, uint32_t max_draw_count, uint32_t stride = sizeof(GfxDrawIndexedIndirectCommand));
+LIB_EXPORT void                 GfxCmdDispatchIndirect(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset);
+
 LIB_EXPORT void                 GfxCmdCopyBuffer(GfxCommandBuffer cmd, GfxBuffer dst_buffer, uint64_t dst_offset, GfxBuffer src_buffer, uint64_t src_offset, uint64_t size);
 LIB_EXPORT void                 GfxCmdBlitTexture(GfxCommandBuffer cmd, GfxTexture dst_texture, GfxTexture src_texture);
 
@@ -0,0 +1,214 @@
+#include <GfxInternal.h>
+
+#include <stb_image.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double ElapsedMilliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Culls with one mesh at a time from array of structures bounds, the way the culling looked before the SIMD path
+static uint32_t CullMeshesReference(const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max, const glm::mat4& view_proj, uint32_t* out_visible)
+{
+    const glm::mat4 m = glm::transpose(view_proj);
+    glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+    for (glm::vec4& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    uint32_t visible_count = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(bounds_min.size()); ++i)
+    {
+        bool visible = true;
+        for (uint32_t j = 0; j < 6 && visible; ++j)
+        {
+            const glm::vec3 corner = glm::mix(bounds_min[i], bounds_max[i], glm::greaterThanEqual(glm::vec3(planes[j]), glm::vec3(0.0f)));
+            visible = glm::dot(glm::vec3(planes[j]), corner) + planes[j].w >= 0.0f;
+        }
+        if (visible)
+            out_visible[visible_count++] = i;
+    }
+    return visible_count;
+}
+
+static void BenchmarkCulling(uint32_t mesh_count, uint32_t iteration_count)
+{
+    // Random boxes scattered around the camera so that roughly a tenth of them end up in the frustum
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> extent(0.5f, 5.0f);
+    std::vector<glm::vec3> bounds_min(mesh_count);
+    std::vector<glm::vec3> bounds_max(mesh_count);
+    for (uint32_t i = 0; i < mesh_count; ++i)
+    {
+        const glm::vec3 center(position(rng), position(rng), position(rng));
+        const glm::vec3 half_extent(extent(rng), extent(rng), extent(rng));
+        bounds_min[i] = center - half_extent;
+        bounds_max[i] = center + half_extent;
+    }
+
+    GfxModel model = New<GfxModel_T>();
+    model->m_Meshes.Resize(mesh_count);
+    model->m_MeshBoundsStride = (mesh_count + 7) & ~7u;
+    model->m_MeshBounds.Resize(model->m_MeshBoundsStride * GfxModel_T::MESH_BOUNDS_STREAM_COUNT);
+    memset(model->m_MeshBounds.Data(), 0, sizeof(float) * model->m_MeshBounds.Count());
+    float* bounds = model->m_MeshBounds.Data();
+    const uint32_t stride = model->m_MeshBoundsStride;
+    for (uint32_t i = 0; i < mesh_count; ++i)
+    {
+        bounds[GfxModel_T::MESH_BOUNDS_MIN_X * stride + i] = bounds_min[i].x;
+        bounds[GfxModel_T::MESH_BOUNDS_MIN_Y * stride + i] = bounds_min[i].y;
+        bounds[GfxModel_T::MESH_BOUNDS_MIN_Z * stride + i] = bounds_min[i].z;
+        bounds[GfxModel_T::MESH_BOUNDS_MAX_X * stride + i] = bounds_max[i].x;
+        bounds[GfxModel_T::MESH_BOUNDS_MAX_Y * stride + i] = bounds_max[i].y;
+        bounds[GfxModel_T::MESH_BOUNDS_MAX_Z * stride + i] = bounds_max[i].z;
+    }
+
+    const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::vector<uint32_t> visible(mesh_count);
+    std::vector<uint32_t> reference_visible(mesh_count);
+    double time = 0.0;
+    double reference_time = 0.0;
+    uint32_t visible_count = 0;
+    for (uint32_t i = 0; i < iteration_count; ++i)
+    {
+        const float angle = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(iteration_count);
+        const glm::mat4 view_proj = proj * glm::lookAt(glm::vec3(0.0f), glm::vec3(cosf(angle), 0.0f, sinf(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        Clock::time_point start = Clock::now();
+        visible_count = GfxCullModelMeshes(model, glm::value_ptr(view_proj), visible.data());
+        time += ElapsedMilliseconds(start);
+
+        start = Clock::now();
+        const uint32_t reference_visible_count = CullMeshesReference(bounds_min, bounds_max, view_proj, reference_visible.data());
+        reference_time += ElapsedMilliseconds(start);
+
+        if (visible_count != reference_visible_count || memcmp(visible.data(), reference_visible.data(), sizeof(uint32_t) * visible_count) != 0)
+        {
+            Print("Error: Culling results differ from the reference at iteration %u", i);
+        }
+    }
+
+    Print("Culling %u meshes, %u visible in the last iteration", mesh_count, visible_count);
+    Print("    GfxCullModelMeshes: %.3f ms", time / iteration_count);
+    Print("    Reference:          %.3f ms", reference_time / iteration_count);
+
+    Delete(model);
+}
+
+// Cooks the images the way GfxLoadTexture does, one LZ compressed section per mip, and times decoding the sections
+// against copying the same mips uncompressed. Both run from memory, so this is the CPU side of a cold load.
+static void BenchmarkDecode(const char* const* filepaths, uint32_t filepath_count, bool block_compression, uint32_t iteration_count)
+{
+    size_t total_size = 0;
+    size_t total_stored_size = 0;
+    double decode_time = 0.0;
+    double copy_time = 0.0;
+    for (uint32_t i = 0; i < filepath_count; ++i)
+    {
+        int width, height, channel_count;
+        stbi_uc* pixels = stbi_load(filepaths[i], &width, &height, &channel_count, STBI_rgb_alpha);
+        if (pixels == NULL)
+        {
+            Print("Error: Failed to load %s", filepaths[i]);
+            continue;
+        }
+
+        bool normal_map, alpha_tested;
+        const GfxFormat format = ChooseTextureFormat(filepaths[i], pixels, width, height, block_compression, &normal_map, &alpha_tested);
+        const uint32_t mip_count = MipCount(width, height, 1);
+        const size_t size = GetTextureDataSize(format, width, height, mip_count);
+        uint8_t* cooked = static_cast<uint8_t*>(Alloc(size));
+        CookTexture(format, normal_map, alpha_tested, pixels, width, height, mip_count, cooked, 0);
+        stbi_image_free(pixels);
+
+        Array<StreamSection> sections(mip_count);
+        void* stored = Alloc(size + sizeof(uint64_t) * 2 * mip_count);
+        WriteStream write_stream(stored, size + sizeof(uint64_t) * 2 * mip_count);
+        const uint8_t* mip_data = cooked;
+        for (uint32_t mip = 0; mip < mip_count; ++mip)
+        {
+            const size_t mip_size = GetTextureDataSize(format, Max(width >> mip, 1), Max(height >> mip, 1), 1);
+            void* section = write_stream.BeginSection();
+            write_stream.WriteBytes(mip_data, mip_size);
+            write_stream.EndSection(section, true);
+            mip_data += mip_size;
+        }
+        ReadStream read_stream(stored, static_cast<const uint8_t*>(write_stream.GetPtr()) - static_cast<const uint8_t*>(stored));
+        for (uint32_t mip = 0; mip < mip_count; ++mip)
+        {
+            sections[mip] = read_stream.ReadSection();
+            total_stored_size += sections[mip].m_StoredSize;
+        }
+        total_size += size;
+
+        uint8_t* decoded = static_cast<uint8_t*>(Alloc(size));
+        for (uint32_t j = 0; j < iteration_count; ++j)
+        {
+            Clock::time_point start = Clock::now();
+            uint8_t* dst = decoded;
+            for (uint32_t mip = 0; mip < mip_count; ++mip)
+            {
+                if (!DecodeSection(sections[mip], dst))
+                    Print("Error: Failed to decode mip %u of %s", mip, filepaths[i]);
+                dst += sections[mip].m_Size;
+            }
+            decode_time += ElapsedMilliseconds(start);
+
+            start = Clock::now();
+            dst = decoded;
+            mip_data = cooked;
+            for (uint32_t mip = 0; mip < mip_count; ++mip)
+            {
+                memcpy(dst, mip_data, sections[mip].m_Size);
+                dst += sections[mip].m_Size;
+                mip_data += sections[mip].m_Size;
+            }
+            copy_time += ElapsedMilliseconds(start);
+        }
+        if (memcmp(decoded, cooked, size) != 0)
+        {
+            Print("Error: Decoded %s differs from the cooked data", filepaths[i]);
+        }
+
+        Free(decoded);
+        Free(stored);
+        Free(cooked);
+    }
+
+    const double megabytes = static_cast<double>(total_size) / (1024.0 * 1024.0);
+    Print("Decoding %u %s textures, %.1f MB stored in %.1f MB (%.0f%%)", filepath_count, block_compression ? "BCn" : "RGBA8",
+        megabytes, static_cast<double>(total_stored_size) / (1024.0 * 1024.0), 100.0 * total_stored_size / total_size);
+    Print("    DecodeSection: %.2f ms, %.0f MB/s", decode_time / iteration_count, megabytes * iteration_count / (decode_time / 1000.0));
+    Print("    Copy:          %.2f ms, %.0f MB/s", copy_time / iteration_count, megabytes * iteration_count / (copy_time / 1000.0));
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkCulling(100000, 256);
+
+    // Images given on the command line replace the default set from the Testbed
+    const char* default_filepaths[] =
+    {
+        "../../Testbed/Assets/textures/spnza_bricks_a_diff.png",
+        "../../Testbed/Assets/textures/spnza_bricks_a_ddn.png",
+        "../../Testbed/Assets/textures/sponza_floor_a_diff.png",
+        "../../Testbed/Assets/textures/sponza_thorn_diff.png",
+        "../../Testbed/Assets/textures/sponza_column_a_ddn.png",
+        "../../Testbed/Assets/textures/sponza_fabric_diff.png",
+    };
+    const char* const* filepaths = argc > 1 ? argv + 1 : default_filepaths;
+    const uint32_t filepath_count = argc > 1 ? static_cast<uint32_t>(argc - 1) : ARRAY_COUNT(default_filepaths);
+    BenchmarkDecode(filepaths, filepath_count, true, 16);
+    BenchmarkDecode(filepaths, filepath_count, false, 16);
+    return 0;
+}
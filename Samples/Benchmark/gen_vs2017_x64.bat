@@ -0,0 +1,4 @@
+if exist Build rd /q /s Build
+mkdir Build
+cd Build
+cmake -G "Visual Studio 15 2017 Win64" ..
\ No newline at end of file
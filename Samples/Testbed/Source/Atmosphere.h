@@ -95,6 +95,12 @@ public:
         linear_clamp_params.m_AddressModeW = GFX_ADDRESS_MODE_CLAMP;
         m_LinearClamp = GfxCreateSampler(ctx.m_Device, linear_clamp_params);
 
+        // Pick work group sizes for this device, cached in Data/Autotune after the first run
+        GfxAutotuneTechnique(ctx.m_Device, m_TechPrecomputeDensityLUT, [](GfxCommandBuffer cmd, GfxTechnique tech, void* user_data) { static_cast<Atmosphere*>(user_data)->PrecomputeDensityLUT(cmd, tech); }, this);
+        GfxAutotuneTechnique(ctx.m_Device, m_TechPrecomputeAmbientLightLUT, [](GfxCommandBuffer cmd, GfxTechnique tech, void* user_data) { static_cast<Atmosphere*>(user_data)->PrecomputeAmbientLightLUT(cmd, tech); }, this);
+        GfxAutotuneTechnique(ctx.m_Device, m_TechPrecomputeDirectionalLightLUT, [](GfxCommandBuffer cmd, GfxTechnique tech, void* user_data) { static_cast<Atmosphere*>(user_data)->PrecomputeDirectionalLightLUT(cmd, tech); }, this);
+        GfxAutotuneTechnique(ctx.m_Device, m_TechPrecomputeSkyLUT, [](GfxCommandBuffer cmd, GfxTechnique tech, void* user_data) { static_cast<Atmosphere*>(user_data)->PrecomputeSkyLUT(cmd, tech); }, this);
+
         Resize(ctx);
 
         ctx.m_AtmosphereAmbientLightLUT = m_AmbientLightLUT;
@@ -149,140 +155,153 @@ public:
             // Precompute density LUT
             {
                 GfxCmdBeginTechnique(cmd, m_TechPrecomputeDensityLUT);
-
-                GfxCmdTransitionTexture(cmd, m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
-                GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_WRITE);
-
-                struct Constants
-                {
-                    glm::vec2   m_DensityScaleHeightRM;
-                    float       m_PlanetRadius;
-                    float       m_AtmosphereRadius;
-                };
-                Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
-                constants->m_DensityScaleHeightRM = m_DensityScaleHeightRM;
-                constants->m_PlanetRadius = m_PlanetRadius;
-                constants->m_AtmosphereRadius = m_AtmosphereRadius;
-
-                const uint32_t group_count_x = (m_DensityLUTSizeX + 8 - 1) / 8;
-                const uint32_t group_count_y = (m_DensityLUTSizeY + 8 - 1) / 8;
-                GfxCmdDispatch(cmd, group_count_x, group_count_y, 1);
-
-                GfxCmdTransitionTexture(cmd, m_DensityLUT, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
-
+                PrecomputeDensityLUT(cmd, m_TechPrecomputeDensityLUT);
                 GfxCmdEndTechnique(cmd);
             }
 
             // Precompute ambient light LUT
             {
                 GfxCmdBeginTechnique(cmd, m_TechPrecomputeAmbientLightLUT);
-
-                GfxCmdTransitionTexture(cmd, m_AmbientLightLUT, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
-                GfxCmdSetTexture(cmd, GFX_HASH("AmbientLightLUT"), m_AmbientLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE);
-
-                GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ);
-                GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
-
-                struct Constants
-                {
-                    glm::vec3   m_BetaR;
-                    float       m_PlanetRadius;
-                    glm::vec3   m_BetaM;
-                    float       m_AtmosphereRadius;
-                    glm::vec2   m_DensityScaleHeightRM;
-                    float       m_MieG;
-                    float       m_SunIntensity;
-                };
-                Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
-                constants->m_BetaR = m_BetaR;
-                constants->m_PlanetRadius = m_PlanetRadius;
-                constants->m_BetaM = m_BetaM;
-                constants->m_AtmosphereRadius = m_AtmosphereRadius;
-                constants->m_DensityScaleHeightRM = m_DensityScaleHeightRM;
-                constants->m_MieG = m_MieG;
-                constants->m_SunIntensity = m_SunIntensity;
-
-                const uint32_t group_count_x = (m_AmbientLightLUTSize + 32 - 1) / 32;
-                GfxCmdDispatch(cmd, group_count_x, 1, 1);
-
-                GfxCmdTransitionTexture(cmd, m_AmbientLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
-
+                PrecomputeAmbientLightLUT(cmd, m_TechPrecomputeAmbientLightLUT);
                 GfxCmdEndTechnique(cmd);
             }
 
             // Precompute directional light LUT
             {
                 GfxCmdBeginTechnique(cmd, m_TechPrecomputeDirectionalLightLUT);
-
-                GfxCmdTransitionTexture(cmd, m_DirectionalLightLUT, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
-                GfxCmdSetTexture(cmd, GFX_HASH("DirectionalLightLUT"), m_DirectionalLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE);
-
-                GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ);
-                GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
-
-                struct Constants
-                {
-                    glm::vec3   m_BetaR;
-                    float       m_PlanetRadius;
-                    glm::vec3   m_BetaM;
-                    float       m_AtmosphereRadius;
-                    float       m_SunIntensity;
-                };
-                Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
-                constants->m_BetaR = m_BetaR;
-                constants->m_PlanetRadius = m_PlanetRadius;
-                constants->m_BetaM = m_BetaM;
-                constants->m_AtmosphereRadius = m_AtmosphereRadius;
-                constants->m_SunIntensity = m_SunIntensity;
-
-                const uint32_t group_count_x = (m_DirectionalLightLUTSize + 32 - 1) / 32;
-                GfxCmdDispatch(cmd, group_count_x, 1, 1);
-
-                GfxCmdTransitionTexture(cmd, m_DirectionalLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
-
+                PrecomputeDirectionalLightLUT(cmd, m_TechPrecomputeDirectionalLightLUT);
                 GfxCmdEndTechnique(cmd);
             }
 
             // Precompute sky LUT
             {
                 GfxCmdBeginTechnique(cmd, m_TechPrecomputeSkyLUT);
-
-                GfxCmdTransitionTexture(cmd, m_SkyLUTR, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
-                GfxCmdTransitionTexture(cmd, m_SkyLUTM, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
-                GfxCmdSetTexture(cmd, GFX_HASH("SkyLUTR"), m_SkyLUTR, GFX_TEXTURE_STATE_SHADER_WRITE);
-                GfxCmdSetTexture(cmd, GFX_HASH("SkyLUTM"), m_SkyLUTM, GFX_TEXTURE_STATE_SHADER_WRITE);
-
-                GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ);
-                GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
-
-                struct Constants
-                {
-                    glm::vec3   m_BetaR;
-                    float       m_PlanetRadius;
-                    glm::vec3   m_BetaM;
-                    float       m_AtmosphereRadius;
-                    glm::vec2   m_DensityScaleHeightRM;
-                };
-                Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
-                constants->m_BetaR = m_BetaR;
-                constants->m_PlanetRadius = m_PlanetRadius;
-                constants->m_BetaM = m_BetaM;
-                constants->m_AtmosphereRadius = m_AtmosphereRadius;
-                constants->m_DensityScaleHeightRM = m_DensityScaleHeightRM;
-
-                const uint32_t group_count_x = (m_SkyLUTSizeX + 8 - 1) / 8;
-                const uint32_t group_count_y = (m_SkyLUTSizeY + 8 - 1) / 8;
-                const uint32_t group_count_z = (m_SkyLUTSizeZ + 4 - 1) / 4;
-                GfxCmdDispatch(cmd, group_count_x, group_count_y, group_count_z);
-
-                GfxCmdTransitionTexture(cmd, m_SkyLUTR, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
-                GfxCmdTransitionTexture(cmd, m_SkyLUTM, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
-
+                PrecomputeSkyLUT(cmd, m_TechPrecomputeSkyLUT);
                 GfxCmdEndTechnique(cmd);
             }
         }
     }
 
+    void PrecomputeDensityLUT(GfxCommandBuffer cmd, GfxTechnique tech)
+    {
+        GfxCmdTransitionTexture(cmd, m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_WRITE);
+
+        struct Constants
+        {
+            glm::vec2   m_DensityScaleHeightRM;
+            float       m_PlanetRadius;
+            float       m_AtmosphereRadius;
+        };
+        Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+        constants->m_DensityScaleHeightRM = m_DensityScaleHeightRM;
+        constants->m_PlanetRadius = m_PlanetRadius;
+        constants->m_AtmosphereRadius = m_AtmosphereRadius;
+
+        const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(tech);
+        const uint32_t group_count_x = (m_DensityLUTSizeX + work_group_size[0] - 1) / work_group_size[0];
+        const uint32_t group_count_y = (m_DensityLUTSizeY + work_group_size[1] - 1) / work_group_size[1];
+        GfxCmdDispatch(cmd, group_count_x, group_count_y, 1);
+
+        GfxCmdTransitionTexture(cmd, m_DensityLUT, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+    }
+    void PrecomputeAmbientLightLUT(GfxCommandBuffer cmd, GfxTechnique tech)
+    {
+        GfxCmdTransitionTexture(cmd, m_AmbientLightLUT, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdSetTexture(cmd, GFX_HASH("AmbientLightLUT"), m_AmbientLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE);
+
+        GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
+
+        struct Constants
+        {
+            glm::vec3   m_BetaR;
+            float       m_PlanetRadius;
+            glm::vec3   m_BetaM;
+            float       m_AtmosphereRadius;
+            glm::vec2   m_DensityScaleHeightRM;
+            float       m_MieG;
+            float       m_SunIntensity;
+        };
+        Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+        constants->m_BetaR = m_BetaR;
+        constants->m_PlanetRadius = m_PlanetRadius;
+        constants->m_BetaM = m_BetaM;
+        constants->m_AtmosphereRadius = m_AtmosphereRadius;
+        constants->m_DensityScaleHeightRM = m_DensityScaleHeightRM;
+        constants->m_MieG = m_MieG;
+        constants->m_SunIntensity = m_SunIntensity;
+
+        const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(tech);
+        const uint32_t group_count_x = (m_AmbientLightLUTSize + work_group_size[0] - 1) / work_group_size[0];
+        GfxCmdDispatch(cmd, group_count_x, 1, 1);
+
+        GfxCmdTransitionTexture(cmd, m_AmbientLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+    }
+    void PrecomputeDirectionalLightLUT(GfxCommandBuffer cmd, GfxTechnique tech)
+    {
+        GfxCmdTransitionTexture(cmd, m_DirectionalLightLUT, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdSetTexture(cmd, GFX_HASH("DirectionalLightLUT"), m_DirectionalLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE);
+
+        GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
+
+        struct Constants
+        {
+            glm::vec3   m_BetaR;
+            float       m_PlanetRadius;
+            glm::vec3   m_BetaM;
+            float       m_AtmosphereRadius;
+            float       m_SunIntensity;
+        };
+        Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+        constants->m_BetaR = m_BetaR;
+        constants->m_PlanetRadius = m_PlanetRadius;
+        constants->m_BetaM = m_BetaM;
+        constants->m_AtmosphereRadius = m_AtmosphereRadius;
+        constants->m_SunIntensity = m_SunIntensity;
+
+        const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(tech);
+        const uint32_t group_count_x = (m_DirectionalLightLUTSize + work_group_size[0] - 1) / work_group_size[0];
+        GfxCmdDispatch(cmd, group_count_x, 1, 1);
+
+        GfxCmdTransitionTexture(cmd, m_DirectionalLightLUT, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+    }
+    void PrecomputeSkyLUT(GfxCommandBuffer cmd, GfxTechnique tech)
+    {
+        GfxCmdTransitionTexture(cmd, m_SkyLUTR, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdTransitionTexture(cmd, m_SkyLUTM, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdSetTexture(cmd, GFX_HASH("SkyLUTR"), m_SkyLUTR, GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdSetTexture(cmd, GFX_HASH("SkyLUTM"), m_SkyLUTM, GFX_TEXTURE_STATE_SHADER_WRITE);
+
+        GfxCmdSetTexture(cmd, GFX_HASH("DensityLUT"), m_DensityLUT, GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
+
+        struct Constants
+        {
+            glm::vec3   m_BetaR;
+            float       m_PlanetRadius;
+            glm::vec3   m_BetaM;
+            float       m_AtmosphereRadius;
+            glm::vec2   m_DensityScaleHeightRM;
+        };
+        Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+        constants->m_BetaR = m_BetaR;
+        constants->m_PlanetRadius = m_PlanetRadius;
+        constants->m_BetaM = m_BetaM;
+        constants->m_AtmosphereRadius = m_AtmosphereRadius;
+        constants->m_DensityScaleHeightRM = m_DensityScaleHeightRM;
+
+        const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(tech);
+        const uint32_t group_count_x = (m_SkyLUTSizeX + work_group_size[0] - 1) / work_group_size[0];
+        const uint32_t group_count_y = (m_SkyLUTSizeY + work_group_size[1] - 1) / work_group_size[1];
+        const uint32_t group_count_z = (m_SkyLUTSizeZ + work_group_size[2] - 1) / work_group_size[2];
+        GfxCmdDispatch(cmd, group_count_x, group_count_y, group_count_z);
+
+        GfxCmdTransitionTexture(cmd, m_SkyLUTR, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdTransitionTexture(cmd, m_SkyLUTM, GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+    }
+
     void DrawSky(const Context& ctx, GfxCommandBuffer cmd)
     {
         // Draw sky
@@ -3,20 +3,41 @@
 
 #include "Context.h"
 
+#include <vector>
+
 class Lighting
 {
 public:
     GfxTechnique                m_Tech                      = NULL;
+    GfxTechnique                m_ModelTech                 = NULL;     // Variant sized to the model textures
     GfxSampler                  m_LinearClamp               = NULL;
     GfxRenderSetup              m_RenderSetup               = NULL;
 
     float                       m_AmbientLightIntensity     = 0.20f;
     float                       m_DirectionalLightIntensity = 0.02f;
+    float                       m_LodPixelError             = 1.0f;
+
+    std::vector<uint32_t>       m_VisibleMeshes;
+    std::vector<uint32_t>       m_VisibleMeshLods;
 
-    void Init(const Context& ctx)
+    void Init(const Context& ctx, uint32_t diffuse_count)
     {
         m_Tech = GfxLoadTechnique(ctx.m_Device, "../Techniques/Lighting.json");
 
+        // The diffuse array holds every texture of the model. Model textures only stream when fragment shaders can
+        // store feedback, the technique writes none otherwise.
+        GfxSpecializationConstant constants[2];
+        constants[0].m_Hash = GFX_HASH("DiffuseCount");
+        constants[0].m_Uint = diffuse_count;
+        uint32_t constant_count = 1;
+        if (GfxGetDeviceCaps(ctx.m_Device).m_FragmentStoresAndAtomics)
+        {
+            constants[constant_count].m_Hash = GFX_HASH("WriteTextureFeedback");
+            constants[constant_count].m_Uint = 1;
+            ++constant_count;
+        }
+        m_ModelTech = GfxCreateTechniqueVariant(ctx.m_Device, m_Tech, constants, constant_count);
+
         GfxCreateSamplerParams sampler_params;
         sampler_params.m_MagFilter = GFX_FILTER_LINEAR;
         sampler_params.m_MinFilter = GFX_FILTER_LINEAR;
@@ -36,18 +57,19 @@ public:
         render_setup_params.m_ColorAttachmentCount = 1;
         render_setup_params.m_ColorAttachments = &ctx.m_ColorBuffer;
         render_setup_params.m_DepthAttachment = ctx.m_DepthBuffer;
-        m_RenderSetup = GfxCreateRenderSetup(ctx.m_Device, m_Tech, render_setup_params);
+        m_RenderSetup = GfxCreateRenderSetup(ctx.m_Device, m_ModelTech, render_setup_params);
     }
     void Destroy(const Context& ctx)
     {
         GfxDestroyRenderSetup(ctx.m_Device, m_RenderSetup);
         GfxDestroySampler(ctx.m_Device, m_LinearClamp);
+        GfxDestroyTechnique(ctx.m_Device, m_ModelTech);
         GfxDestroyTechnique(ctx.m_Device, m_Tech);
     }
 
     void BeginDraw(GfxCommandBuffer cmd)
     {
-        GfxCmdBeginTechnique(cmd, m_Tech);
+        GfxCmdBeginTechnique(cmd, m_ModelTech);
         GfxCmdSetRenderSetup(cmd, m_RenderSetup);
     }
     void EndDraw(GfxCommandBuffer cmd)
@@ -66,40 +88,41 @@ public:
         GfxCmdBindModelVertexBuffer(cmd, model, GFX_MODEL_VERTEX_ATTRIBUTE_NORMAL, 2);
         GfxCmdBindModelIndexBuffer(cmd, model);
 
+        GfxCmdSetModelDrawData(cmd, GFX_HASH("Draws"), model);
+        GfxCmdSetModelTextureFeedback(cmd, GFX_HASH("Feedback"), model);
+        GfxCmdSetTextures(cmd, GFX_HASH("Diffuse"), GfxGetModelTextures(model), GfxGetModelTextureCount(model), GFX_TEXTURE_STATE_SHADER_READ);
+
         const glm::mat4 view_proj = ctx.m_Camera.m_Projection * ctx.m_Camera.m_View;
-        
-        const uint32_t mesh_count = GfxGetModelMeshCount(model);
-        for (uint32_t i = 0; i < mesh_count; ++i)
+
+        struct Constants
         {
-            uint32_t material_index = GfxGetModelMaterialIndex(model, i);
-            GfxTexture diffuse_texture = GfxGetModelDiffuseTexture(model, material_index);
-            if (!diffuse_texture)
-                continue;
-            GfxCmdSetTexture(cmd, GFX_HASH("Diffuse"), diffuse_texture, GFX_TEXTURE_STATE_SHADER_READ);
-        
-            struct Constants
-            {
-                glm::mat4   m_World;
-                glm::mat4   m_WorldViewProj;
-                glm::vec3   m_ViewPosition;
-                float       m_PositionScale;
-                glm::vec3   m_LightDirection;
-                float       m_LightCoord;
-                float       m_AmbientLightIntensity;
-                float       m_DirectionalLightIntensity;
-            };
-            Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
-            constants->m_World = world;
-            constants->m_WorldViewProj = view_proj * world;
-            constants->m_ViewPosition = ctx.m_Camera.m_Position;
-            constants->m_PositionScale = GfxGetModelQuantizationScale(model);
-            constants->m_LightDirection = ctx.m_AtmosphereLightDirection;
-            constants->m_LightCoord = ctx.m_AtmosphereLightCoord;
-            constants->m_AmbientLightIntensity = m_AmbientLightIntensity;
-            constants->m_DirectionalLightIntensity = m_DirectionalLightIntensity;
-        
-            GfxCmdDrawModel(cmd, model, i, 1);
-        }
+            glm::mat4   m_World;
+            glm::mat4   m_WorldViewProj;
+            glm::vec3   m_ViewPosition;
+            float       m_PositionScale;
+            glm::vec3   m_LightDirection;
+            float       m_LightCoord;
+            float       m_AmbientLightIntensity;
+            float       m_DirectionalLightIntensity;
+        };
+        Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+        constants->m_World = world;
+        constants->m_WorldViewProj = view_proj * world;
+        constants->m_ViewPosition = ctx.m_Camera.m_Position;
+        constants->m_PositionScale = GfxGetModelQuantizationScale(model);
+        constants->m_LightDirection = ctx.m_AtmosphereLightDirection;
+        constants->m_LightCoord = ctx.m_AtmosphereLightCoord;
+        constants->m_AmbientLightIntensity = m_AmbientLightIntensity;
+        constants->m_DirectionalLightIntensity = m_DirectionalLightIntensity;
+
+        m_VisibleMeshes.resize(GfxGetModelMeshCount(model));
+        const uint32_t visible_mesh_count = GfxCullModelMeshes(model, glm::value_ptr(constants->m_WorldViewProj), m_VisibleMeshes.data());
+
+        m_VisibleMeshLods.resize(visible_mesh_count);
+        const float projection_scale = ctx.m_Camera.m_Projection[1][1] * ctx.m_Camera.m_Height * 0.5f;
+        for (uint32_t i = 0; i < visible_mesh_count; ++i)
+            m_VisibleMeshLods[i] = GfxSelectModelMeshLod(model, m_VisibleMeshes[i], glm::value_ptr(world), glm::value_ptr(ctx.m_Camera.m_Position), projection_scale, m_LodPixelError);
+        GfxCmdDrawModelMeshes(cmd, model, m_VisibleMeshes.data(), visible_mesh_count, 1, m_VisibleMeshLods.data());
     }
 };
 
@@ -43,6 +43,7 @@ int main(int argc, char* argv[])
     device_params.m_BackBufferHeight = ctx.m_Height;
     device_params.m_DesiredBackBufferCount = 2;
     device_params.m_EnableValidationLayer = false;
+    device_params.m_StreamModelTextures = true;
     ctx.m_Device = GfxCreateDevice(device_params);
 
     GfxCreateTextureParams color_buffer_params;
@@ -67,8 +68,10 @@ int main(int argc, char* argv[])
     Atmosphere atmosphere;
     atmosphere.Init(ctx);
 
+    GfxModel sponza = GfxLoadModel(ctx.m_Device, "../Assets/sponza.obj", "../Assets/");
+
     Lighting lighting;
-    lighting.Init(ctx);
+    lighting.Init(ctx, GfxGetModelTextureCount(sponza));
 
     PostProcessEffects post_process_effects;
     post_process_effects.Init(ctx);
@@ -76,8 +79,6 @@ int main(int argc, char* argv[])
     ImGuiImpl imgui_impl;
     imgui_impl.Init(ctx);
 
-    GfxModel sponza = GfxLoadModel(ctx.m_Device, "../Assets/sponza.obj", "../Assets/");
-
     CameraController camera_controller;
 
     glfwShowWindow(ctx.m_Window);
@@ -176,6 +177,8 @@ int main(int argc, char* argv[])
         {
             GfxCommandBuffer cmd = GfxBeginFrame(ctx.m_Device);
 
+            GfxUpdateModelTextureStreaming(ctx.m_Device, sponza);
+
             atmosphere.Precompute(ctx, cmd);
 
             GfxCmdTransitionTexture(cmd, ctx.m_ColorBuffer, GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_COLOR_ATTACHMENT);
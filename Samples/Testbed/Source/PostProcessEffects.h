@@ -41,6 +41,19 @@ public:
         m_LinearClamp = GfxCreateSampler(ctx.m_Device, sampler_params);
 
         Resize(ctx);
+
+        // Pick the work group size for this device, cached in Data/Autotune after the first run
+        struct AutotuneData
+        {
+            PostProcessEffects* m_This;
+            const Context*      m_Context;
+        };
+        AutotuneData autotune_data = { this, &ctx };
+        GfxAutotuneTechnique(ctx.m_Device, m_TechTemporalAA, [](GfxCommandBuffer cmd, GfxTechnique tech, void* user_data)
+        {
+            const AutotuneData* data = static_cast<const AutotuneData*>(user_data);
+            data->m_This->TemporalAA(*data->m_Context, cmd, tech, glm::identity<glm::mat4>());
+        }, &autotune_data);
     }
     void Resize(const Context& ctx)
     {
@@ -114,39 +127,13 @@ public:
     {
         if (m_TemporalAAEnable)
         {
-            GfxCmdTransitionTexture(cmd, m_TemporalBuffers[m_TemporalAAFrameCounter & 1], GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
-
-            GfxCmdBeginTechnique(cmd, m_TechTemporalAA);
-
-            GfxCmdSetTexture(cmd, GFX_HASH("OutTemporal"), m_TemporalBuffers[m_TemporalAAFrameCounter & 1], GFX_TEXTURE_STATE_SHADER_WRITE);
-            GfxCmdSetTexture(cmd, GFX_HASH("Temporal"), m_TemporalBuffers[(m_TemporalAAFrameCounter + 1) & 1], GFX_TEXTURE_STATE_SHADER_READ);
-            GfxCmdSetTexture(cmd, GFX_HASH("Color"), ctx.m_ColorBuffer, GFX_TEXTURE_STATE_SHADER_READ);
-            GfxCmdSetTexture(cmd, GFX_HASH("Depth"), ctx.m_DepthBuffer, GFX_TEXTURE_STATE_SHADER_READ);
-            GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
-            GfxCmdSetSampler(cmd, GFX_HASH("NearestClamp"), m_NearestClamp);
-
             const glm::mat4 curr_view_proj = ctx.m_Camera.m_UnjitteredProjection * ctx.m_Camera.m_View;
 
-            struct Constants
-            {
-                glm::mat4   m_InvViewProj;
-                glm::mat4   m_PrevViewProj;
-                float       m_Exposure;
-            };
-            Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
-            constants->m_InvViewProj = glm::inverse(curr_view_proj);
-            constants->m_PrevViewProj = m_TemporalAAPrevViewProj;
-            constants->m_Exposure = m_Exposure;
-
-            m_TemporalAAPrevViewProj = curr_view_proj;
-
-            const uint32_t group_count_x = (ctx.m_Width + 8 - 1) / 8;
-            const uint32_t group_count_y = (ctx.m_Height + 8 - 1) / 8;
-            GfxCmdDispatch(cmd, group_count_x, group_count_y, 1);
-
+            GfxCmdBeginTechnique(cmd, m_TechTemporalAA);
+            TemporalAA(ctx, cmd, m_TechTemporalAA, curr_view_proj);
             GfxCmdEndTechnique(cmd);
 
-            GfxCmdTransitionTexture(cmd, m_TemporalBuffers[m_TemporalAAFrameCounter & 1], GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+            m_TemporalAAPrevViewProj = curr_view_proj;
         }
 
         {
@@ -172,6 +159,36 @@ public:
             GfxCmdEndTechnique(cmd);
         }
     }
+
+    void TemporalAA(const Context& ctx, GfxCommandBuffer cmd, GfxTechnique tech, const glm::mat4& curr_view_proj)
+    {
+        GfxCmdTransitionTexture(cmd, m_TemporalBuffers[m_TemporalAAFrameCounter & 1], GFX_TEXTURE_STATE_SHADER_READ, GFX_TEXTURE_STATE_SHADER_WRITE);
+
+        GfxCmdSetTexture(cmd, GFX_HASH("OutTemporal"), m_TemporalBuffers[m_TemporalAAFrameCounter & 1], GFX_TEXTURE_STATE_SHADER_WRITE);
+        GfxCmdSetTexture(cmd, GFX_HASH("Temporal"), m_TemporalBuffers[(m_TemporalAAFrameCounter + 1) & 1], GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdSetTexture(cmd, GFX_HASH("Color"), ctx.m_ColorBuffer, GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdSetTexture(cmd, GFX_HASH("Depth"), ctx.m_DepthBuffer, GFX_TEXTURE_STATE_SHADER_READ);
+        GfxCmdSetSampler(cmd, GFX_HASH("LinearClamp"), m_LinearClamp);
+        GfxCmdSetSampler(cmd, GFX_HASH("NearestClamp"), m_NearestClamp);
+
+        struct Constants
+        {
+            glm::mat4   m_InvViewProj;
+            glm::mat4   m_PrevViewProj;
+            float       m_Exposure;
+        };
+        Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+        constants->m_InvViewProj = glm::inverse(curr_view_proj);
+        constants->m_PrevViewProj = m_TemporalAAPrevViewProj;
+        constants->m_Exposure = m_Exposure;
+
+        const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(tech);
+        const uint32_t group_count_x = (ctx.m_Width + work_group_size[0] - 1) / work_group_size[0];
+        const uint32_t group_count_y = (ctx.m_Height + work_group_size[1] - 1) / work_group_size[1];
+        GfxCmdDispatch(cmd, group_count_x, group_count_y, 1);
+
+        GfxCmdTransitionTexture(cmd, m_TemporalBuffers[m_TemporalAAFrameCounter & 1], GFX_TEXTURE_STATE_SHADER_WRITE, GFX_TEXTURE_STATE_SHADER_READ);
+    }
 };
 
 #endif
\ No newline at end of file
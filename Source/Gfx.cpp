@@ -48,13 +48,56 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugReportFlagsEXT flags,
     return VK_FALSE;
 }
 
-static void QueueCmd(GfxDevice device, GfxCmdFunction func, const void* user_data, uint32_t user_data_size)
+// Trailing data is queued right after the user data, for commands with a variable number of regions
+static void QueueCmd(GfxDevice device, GfxCmdFunction func, const void* user_data, uint32_t user_data_size, const void* trailing_data = NULL, uint32_t trailing_data_size = 0)
 {
     const uint32_t offset = device->m_CmdFunctionUserData.Count();
     device->m_CmdFunctions.Push(func);
-    device->m_CmdFunctionUserData.Grow(user_data_size);
+    device->m_CmdFunctionUserData.Grow(user_data_size + trailing_data_size);
     device->m_CmdFunctionUserDataOffsets.Push(offset);
     memcpy(device->m_CmdFunctionUserData.Data() + offset, user_data, user_data_size);
+    if (trailing_data_size > 0)
+        memcpy(device->m_CmdFunctionUserData.Data() + offset + user_data_size, trailing_data, trailing_data_size);
+}
+
+static void ExecuteQueuedCmds(GfxDevice device, VkCommandBuffer cmd)
+{
+    const uint32_t function_count = device->m_CmdFunctions.Count();
+    for (uint32_t i = 0; i < function_count; ++i)
+    {
+        GfxCmdFunction func = device->m_CmdFunctions[i];
+        void* user_data = static_cast<void*>(&device->m_CmdFunctionUserData[device->m_CmdFunctionUserDataOffsets[i]]);
+        (*func)(cmd, user_data);
+    }
+
+    device->m_CmdFunctions.Clear();
+    device->m_CmdFunctionUserData.Clear();
+    device->m_CmdFunctionUserDataOffsets.Clear();
+}
+
+static VkDescriptorPool CreateDescriptorPool(GfxDevice device, uint32_t descriptor_count)
+{
+    const VkDescriptorPoolSize descriptor_pool_sizes[] =
+    {
+        { VK_DESCRIPTOR_TYPE_SAMPLER, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, descriptor_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, descriptor_count },
+    };
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = ARRAY_COUNT(descriptor_pool_sizes);
+    pool_info.pPoolSizes = descriptor_pool_sizes;
+    pool_info.maxSets = descriptor_count;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VK(vkCreateDescriptorPool(device->m_Device, &pool_info, NULL, &pool));
+    return pool;
 }
 
 struct CmdUploadBufferParams
@@ -102,17 +145,16 @@ static void CmdUploadBuffer(VkCommandBuffer cmd, void* user_data)
 struct CmdUploadImageParams
 {
     VkImage             m_DstImage;
-    uint32_t            m_DstWidth;
-    uint32_t            m_DstHeight;
     VkImageAspectFlags  m_DstAspectMask;
     VkAccessFlags       m_DstAccessMask;
     VkImageLayout       m_DstLayout;
     VkBuffer            m_SrcBuffer;
-    VkDeviceSize        m_SrcOffset;
+    uint32_t            m_RegionCount;      // One VkBufferImageCopy per mip and layer follows the params
 };
 static void CmdUploadImage(VkCommandBuffer cmd, void* user_data)
 {
     CmdUploadImageParams* params = static_cast<CmdUploadImageParams*>(user_data);
+    const VkBufferImageCopy* regions = reinterpret_cast<const VkBufferImageCopy*>(params + 1);
 
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -121,25 +163,16 @@ static void CmdUploadImage(VkCommandBuffer cmd, void* user_data)
     barrier.image = params->m_DstImage;
     barrier.subresourceRange.aspectMask = params->m_DstAspectMask;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
     barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     barrier.srcAccessMask = 0;
     barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 
-    VkBufferImageCopy copy_region = {};
-    copy_region.bufferOffset = params->m_SrcOffset;
-    copy_region.imageSubresource.aspectMask = params->m_DstAspectMask;
-    copy_region.imageSubresource.mipLevel = 0;
-    copy_region.imageSubresource.baseArrayLayer = 0;
-    copy_region.imageSubresource.layerCount = 1;
-    copy_region.imageExtent.width = params->m_DstWidth;
-    copy_region.imageExtent.height = params->m_DstHeight;
-    copy_region.imageExtent.depth = 1;
-    vkCmdCopyBufferToImage(cmd, params->m_SrcBuffer, params->m_DstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+    vkCmdCopyBufferToImage(cmd, params->m_SrcBuffer, params->m_DstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, params->m_RegionCount, regions);
 
     barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     barrier.newLayout = params->m_DstLayout;
@@ -166,9 +199,9 @@ static void CmdTransitionImage(VkCommandBuffer cmd, void* user_data)
     barrier.image = params->m_DstImage;
     barrier.subresourceRange.aspectMask = params->m_DstAspectMask;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
     barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     barrier.newLayout = params->m_DstLayout;
     barrier.srcAccessMask = 0;
@@ -181,16 +214,18 @@ struct CmdGenerateMipmapParams
     VkImage             m_DstImage;
     uint32_t            m_DstWidth;
     uint32_t            m_DstHeight;
+    uint32_t            m_DstDepth;
     uint32_t            m_DstMipCount;
+    uint32_t            m_DstLayerCount;
     VkImageAspectFlags  m_DstAspectMask;
     VkAccessFlags       m_DstAccessMask;
     VkImageLayout       m_DstLayout;
-    VkBuffer            m_SrcBuffer;
-    VkDeviceSize        m_SrcOffset;
+    VkBuffer            m_SrcBuffer;    // Mip 0 of every layer, one VkBufferImageCopy per layer follows the params
 };
 static void CmdGenerateMipmap(VkCommandBuffer cmd, void* user_data)
 {
     CmdGenerateMipmapParams* params = static_cast<CmdGenerateMipmapParams*>(user_data);
+    const VkBufferImageCopy* regions = reinterpret_cast<const VkBufferImageCopy*>(params + 1);
 
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -201,26 +236,19 @@ static void CmdGenerateMipmap(VkCommandBuffer cmd, void* user_data)
     barrier.subresourceRange.baseMipLevel = 0;
     barrier.subresourceRange.levelCount = params->m_DstMipCount;
     barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.layerCount = params->m_DstLayerCount;
     barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     barrier.srcAccessMask = 0;
     barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 
-    VkBufferImageCopy copy_region = {};
-    copy_region.bufferOffset = params->m_SrcOffset;
-    copy_region.imageSubresource.aspectMask = params->m_DstAspectMask;
-    copy_region.imageSubresource.mipLevel = 0;
-    copy_region.imageSubresource.baseArrayLayer = 0;
-    copy_region.imageSubresource.layerCount = 1;
-    copy_region.imageExtent.width = params->m_DstWidth;
-    copy_region.imageExtent.height = params->m_DstHeight;
-    copy_region.imageExtent.depth = 1;
-    vkCmdCopyBufferToImage(cmd, params->m_SrcBuffer, params->m_DstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+    vkCmdCopyBufferToImage(cmd, params->m_SrcBuffer, params->m_DstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, params->m_DstLayerCount, regions);
 
+    // Every layer is blitted at once
     uint32_t width = params->m_DstWidth;
     uint32_t height = params->m_DstHeight;
+    uint32_t depth = params->m_DstDepth;
     for (uint32_t mip = 1; mip < params->m_DstMipCount; ++mip)
     {
         barrier.subresourceRange.baseMipLevel = mip - 1;
@@ -236,12 +264,13 @@ static void CmdGenerateMipmap(VkCommandBuffer cmd, void* user_data)
         region.srcOffsets[1].y = height;
         region.dstOffsets[1].x = Max(width >> 1, 1);
         region.dstOffsets[1].y = Max(height >> 1, 1);
-        region.srcOffsets[1].z = region.dstOffsets[1].z = 1;
+        region.srcOffsets[1].z = depth;
+        region.dstOffsets[1].z = Max(depth >> 1, 1);
         region.srcSubresource.mipLevel = mip - 1;
         region.dstSubresource.mipLevel = mip;
         region.srcSubresource.aspectMask = region.dstSubresource.aspectMask = params->m_DstAspectMask;
         region.srcSubresource.baseArrayLayer = region.dstSubresource.baseArrayLayer = 0;
-        region.srcSubresource.layerCount = region.dstSubresource.layerCount = 1;
+        region.srcSubresource.layerCount = region.dstSubresource.layerCount = params->m_DstLayerCount;
         vkCmdBlitImage(cmd, params->m_DstImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, params->m_DstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
 
         barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
@@ -252,6 +281,7 @@ static void CmdGenerateMipmap(VkCommandBuffer cmd, void* user_data)
 
         width = Max(width >> 1, 1);
         height = Max(height >> 1, 1);
+        depth = Max(depth >> 1, 1);
     }
 
     barrier.subresourceRange.baseMipLevel = params->m_DstMipCount - 1;
@@ -313,6 +343,7 @@ static void CreateSwapchain(GfxDevice device, uint32_t width, uint32_t height, u
         device->m_SwapchainTextures[i].m_Width = width;
         device->m_SwapchainTextures[i].m_Height = height;
         device->m_SwapchainTextures[i].m_Format = device->m_SwapchainSurfaceFormat.format;
+        device->m_SwapchainTextures[i].m_AllocationSize = 0;
 
         VkImageViewCreateInfo image_view_info = {};
         image_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -361,25 +392,7 @@ static void CreateSwapchain(GfxDevice device, uint32_t width, uint32_t height, u
         VK(vkCreateSemaphore(device->m_Device, &semaphore_info, NULL, &device->m_CommandBuffers[i].m_CommandBufferSemaphore));
         VK(vkCreateSemaphore(device->m_Device, &semaphore_info, NULL, &device->m_CommandBuffers[i].m_PresentSemaphore));
 
-        const VkDescriptorPoolSize descriptor_pool_sizes[] =
-        {
-            { VK_DESCRIPTOR_TYPE_SAMPLER, 65535 },
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 65535 },
-            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 65535 },
-        };
-        VkDescriptorPoolCreateInfo pool_info = {};
-        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        pool_info.poolSizeCount = ARRAY_COUNT(descriptor_pool_sizes);
-        pool_info.pPoolSizes = descriptor_pool_sizes;
-        pool_info.maxSets = 65535;
-        VK(vkCreateDescriptorPool(device->m_Device, &pool_info, NULL, &device->m_CommandBuffers[i].m_DescriptorPool));
+        device->m_CommandBuffers[i].m_DescriptorPool = CreateDescriptorPool(device, 65535);
 
         device->m_CommandBuffers[i].m_Device = device;
     }
@@ -402,6 +415,37 @@ static void DestroySwapchain(GfxDevice device)
 	vkDestroySwapchainKHR(device->m_Device, device->m_Swapchain, NULL);
 }
 
+static void UpdateMemoryBudget(GfxDevice device)
+{
+    if (!device->m_Caps.m_MemoryBudget)
+    {
+        device->m_MemoryBudget.m_Usage = device->m_AllocatedMemory;
+        device->m_MemoryBudget.m_Budget = device->m_MemoryCap;
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memory_properties = {};
+    memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memory_properties.pNext = &budget_properties;
+    device->m_GetPhysicalDeviceMemoryProperties2(device->m_PhysicalDevice, &memory_properties);
+
+    uint64_t usage = 0;
+    uint64_t budget = 0;
+    for (uint32_t i = 0; i < memory_properties.memoryProperties.memoryHeapCount; ++i)
+    {
+        if ((memory_properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0)
+        {
+            usage += budget_properties.heapUsage[i];
+            budget += budget_properties.heapBudget[i];
+        }
+    }
+    device->m_MemoryBudget.m_Usage = usage;
+    device->m_MemoryBudget.m_Budget = budget < device->m_MemoryCap ? budget : device->m_MemoryCap;
+}
+
 GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
 {
 	const char* instance_extensions[] =
@@ -466,9 +510,20 @@ GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
         }
     }
 
+    // Vulkan 1.1 is needed for subgroup operations, fall back to 1.0 on older loaders
+    device->m_ApiVersion = VK_API_VERSION_1_0;
+    PFN_vkEnumerateInstanceVersion vkEnumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion"));
+    if (vkEnumerateInstanceVersion)
+    {
+        uint32_t instance_version = VK_API_VERSION_1_0;
+        VK(vkEnumerateInstanceVersion(&instance_version));
+        if (instance_version >= VK_API_VERSION_1_1)
+            device->m_ApiVersion = VK_API_VERSION_1_1;
+    }
+
 	VkApplicationInfo app_info = {};
 	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	app_info.apiVersion = VK_API_VERSION_1_0;
+	app_info.apiVersion = device->m_ApiVersion;
 
 	VkInstanceCreateInfo instance_info = {};
 	instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -586,6 +641,32 @@ GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
         Print("Error: No compatible physical device was found");
         Abort();
     }
+    vkGetPhysicalDeviceProperties(device->m_PhysicalDevice, &device->m_PhysicalDeviceProperties);
+    if (device->m_PhysicalDeviceProperties.apiVersion < device->m_ApiVersion)
+        device->m_ApiVersion = VK_API_VERSION_1_0;
+
+    device->m_Caps = GfxDeviceCaps();
+    device->m_Caps.m_SubgroupSize = 1;
+    if (device->m_ApiVersion >= VK_API_VERSION_1_1)
+    {
+        VkPhysicalDeviceSubgroupProperties subgroup_properties = {};
+        subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+        // Fetched at runtime rather than linked, so the executable still loads with a 1.0 loader
+        PFN_vkGetPhysicalDeviceProperties2 vkGetPhysicalDeviceProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2>(vkGetInstanceProcAddr(device->m_Instance, "vkGetPhysicalDeviceProperties2"));
+
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &subgroup_properties;
+        vkGetPhysicalDeviceProperties2(device->m_PhysicalDevice, &properties);
+
+        device->m_Caps.m_SubgroupSize = subgroup_properties.subgroupSize;
+        device->m_Caps.m_SubgroupFeatures = subgroup_properties.supportedOperations;
+        device->m_Caps.m_SubgroupVertexShader = (subgroup_properties.supportedStages & VK_SHADER_STAGE_VERTEX_BIT) != 0;
+        device->m_Caps.m_SubgroupFragmentShader = (subgroup_properties.supportedStages & VK_SHADER_STAGE_FRAGMENT_BIT) != 0;
+        device->m_Caps.m_SubgroupComputeShader = (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0;
+        device->m_Caps.m_SubgroupQuadOperationsInAllStages = subgroup_properties.quadOperationsInAllStages == VK_TRUE;
+    }
 
 	const float queue_priority = 1.0f;
 	VkDeviceQueueCreateInfo queue_info = {};
@@ -594,15 +675,55 @@ GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
 	queue_info.queueCount = 1;
 	queue_info.pQueuePriorities = &queue_priority;
 
+    VkPhysicalDeviceFeatures supported_features = {};
+    vkGetPhysicalDeviceFeatures(device->m_PhysicalDevice, &supported_features);
+
     VkPhysicalDeviceFeatures device_features = {};
     device_features.shaderStorageImageExtendedFormats = VK_TRUE;
+    device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+    device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+    device_features.shaderSampledImageArrayDynamicIndexing = supported_features.shaderSampledImageArrayDynamicIndexing;
+    device_features.textureCompressionBC = supported_features.textureCompressionBC;
+    device_features.fragmentStoresAndAtomics = supported_features.fragmentStoresAndAtomics;
+
+    device->m_Caps.m_MultiDrawIndirect = supported_features.multiDrawIndirect == VK_TRUE;
+    device->m_Caps.m_DrawIndirectFirstInstance = supported_features.drawIndirectFirstInstance == VK_TRUE;
+    device->m_Caps.m_MaxDrawIndirectCount = device->m_PhysicalDeviceProperties.limits.maxDrawIndirectCount;
+    device->m_Caps.m_SampledImageArrayDynamicIndexing = supported_features.shaderSampledImageArrayDynamicIndexing == VK_TRUE;
+    device->m_Caps.m_TextureCompressionBC = supported_features.textureCompressionBC == VK_TRUE;
+    device->m_Caps.m_FragmentStoresAndAtomics = supported_features.fragmentStoresAndAtomics == VK_TRUE;
+
+    // Optional extensions are enabled when the physical device has them
+    Array<const char*> enabled_device_extensions(ARRAY_COUNT(device_extensions));
+    memcpy(enabled_device_extensions.Data(), device_extensions, sizeof(device_extensions));
+    {
+        uint32_t device_extension_properties_count = 0;
+        VK(vkEnumerateDeviceExtensionProperties(device->m_PhysicalDevice, NULL, &device_extension_properties_count, NULL));
+        Array<VkExtensionProperties> device_extension_properties(device_extension_properties_count);
+        VK(vkEnumerateDeviceExtensionProperties(device->m_PhysicalDevice, NULL, &device_extension_properties_count, device_extension_properties.Data()));
+
+        for (uint32_t i = 0; i < device_extension_properties_count; ++i)
+        {
+            if (strcmp(device_extension_properties[i].extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+            {
+                enabled_device_extensions.Push(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+                device->m_Caps.m_DrawIndirectCount = true;
+            }
+            // Queried through vkGetPhysicalDeviceMemoryProperties2, which is core in 1.1
+            if (strcmp(device_extension_properties[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0 && device->m_ApiVersion >= VK_API_VERSION_1_1)
+            {
+                enabled_device_extensions.Push(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+                device->m_Caps.m_MemoryBudget = true;
+            }
+        }
+    }
 
 	VkDeviceCreateInfo device_info = {};
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	device_info.queueCreateInfoCount = 1;
 	device_info.pQueueCreateInfos = &queue_info;
-	device_info.enabledExtensionCount = ARRAY_COUNT(device_extensions);
-	device_info.ppEnabledExtensionNames = device_extensions;
+	device_info.enabledExtensionCount = enabled_device_extensions.Count();
+	device_info.ppEnabledExtensionNames = enabled_device_extensions.Data();
     device_info.pEnabledFeatures = &device_features;
     if (params.m_EnableValidationLayer)
     {
@@ -613,6 +734,43 @@ GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
 
 	vkGetDeviceQueue(device->m_Device, device->m_GraphicsQueueIndex, 0, &device->m_GraphicsQueue);
 
+    device->m_CullModelTechnique = NULL;
+    device->m_CullModelMeshletsTechnique = NULL;
+
+    device->m_FileQueue = CreateFileQueue();
+    device->m_CompressBlobs = params.m_CompressBlobs;
+    device->m_StreamModelTextures = params.m_StreamModelTextures && device->m_Caps.m_FragmentStoresAndAtomics;
+    if (params.m_StreamModelTextures && !device->m_StreamModelTextures)
+        Print("Warning: Model textures are not streamed, fragment shaders can not write sampling feedback on this device");
+
+    device->m_FrameIndex = 0;
+    device->m_MemoryCap = params.m_MemoryBudget;
+    if (device->m_MemoryCap == 0)
+    {
+        VkPhysicalDeviceMemoryProperties memory_properties = {};
+        vkGetPhysicalDeviceMemoryProperties(device->m_PhysicalDevice, &memory_properties);
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i)
+        {
+            if ((memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0)
+                device->m_MemoryCap += memory_properties.memoryHeaps[i].size;
+        }
+    }
+    device->m_AllocatedMemory = 0;
+    device->m_StreamingHeadroom = 0;
+    device->m_StreamingBudgetFrame = ~0ULL;
+    device->m_GetPhysicalDeviceMemoryProperties2 = NULL;
+    if (device->m_Caps.m_MemoryBudget)
+        device->m_GetPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(vkGetInstanceProcAddr(device->m_Instance, "vkGetPhysicalDeviceMemoryProperties2"));
+    UpdateMemoryBudget(device);
+
+    device->m_CmdDrawIndirectCount = NULL;
+    device->m_CmdDrawIndexedIndirectCount = NULL;
+    if (device->m_Caps.m_DrawIndirectCount)
+    {
+        device->m_CmdDrawIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndirectCountKHR>(vkGetDeviceProcAddr(device->m_Device, "vkCmdDrawIndirectCountKHR"));
+        device->m_CmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->m_Device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+
     VkCommandPoolCreateInfo command_pool_info = {};
     command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -629,7 +787,7 @@ GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
 	VkBufferCreateInfo staging_buffer_info = {};
 	staging_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	staging_buffer_info.size = GFX_STAGING_BUFFER_SIZE;
-	staging_buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	staging_buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
 	staging_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	VmaAllocationCreateInfo staging_buffer_allocation_info = {};
@@ -643,6 +801,24 @@ GfxDevice GfxCreateDevice(const GfxCreateDeviceParams& params)
 	device->m_StagingBufferMappedData = (uint8_t*)allocation_info.pMappedData;
 	device->m_StagingBufferHead = 0;
 
+    // Bound in place of textures that failed to load
+    const uint32_t default_texture_data = 0xFFFFFFFF;
+    GfxCreateTextureParams default_texture_params;
+    default_texture_params.m_Width = 1;
+    default_texture_params.m_Height = 1;
+    default_texture_params.m_Format = GFX_FORMAT_R8G8B8A8_UNORM;
+    default_texture_params.m_Usage = GFX_TEXTURE_USAGE_SAMPLE_BIT;
+    default_texture_params.m_InitialState = GFX_TEXTURE_STATE_SHADER_READ;
+    default_texture_params.m_Data = &default_texture_data;
+    default_texture_params.m_DataSize = sizeof(default_texture_data);
+    device->m_DefaultTexture = GfxCreateTexture(device, default_texture_params);
+
+    // Bound as the feedback buffer of models whose textures do not stream, nothing reads it back
+    GfxCreateBufferParams default_feedback_buffer_params;
+    default_feedback_buffer_params.m_Usage = GFX_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    default_feedback_buffer_params.m_Size = sizeof(uint32_t);
+    device->m_DefaultFeedback = GfxCreateBuffer(device, default_feedback_buffer_params);
+
     CreateSwapchain(device, params.m_BackBufferWidth, params.m_BackBufferHeight, params.m_DesiredBackBufferCount);
 
 	return device;
@@ -651,6 +827,15 @@ void GfxDestroyDevice(GfxDevice device)
 {
     DestroySwapchain(device);
 
+    GfxDestroyTechnique(device, device->m_CullModelTechnique);
+    GfxDestroyTechnique(device, device->m_CullModelMeshletsTechnique);
+
+    DestroyFileQueue(device->m_FileQueue);
+    UnmountAssetPacks(device);
+
+    GfxDestroyTexture(device, device->m_DefaultTexture);
+    GfxDestroyBuffer(device, device->m_DefaultFeedback);
+
 	vmaDestroyBuffer(device->m_Allocator, device->m_StagingBuffer.m_Buffer, device->m_StagingBuffer.m_Allocation);
 	vmaDestroyAllocator(device->m_Allocator);
     vkDestroyCommandPool(device->m_Device, device->m_CommandPool, NULL);
@@ -677,6 +862,16 @@ void GfxWaitForGpu(GfxDevice device)
     vkDeviceWaitIdle(device->m_Device);
 }
 
+const GfxDeviceCaps& GfxGetDeviceCaps(GfxDevice device)
+{
+    return device->m_Caps;
+}
+
+GfxMemoryBudget GfxGetMemoryBudget(GfxDevice device)
+{
+    return device->m_MemoryBudget;
+}
+
 GfxCommandBuffer GfxBeginFrame(GfxDevice device)
 {
     GfxCommandBuffer cmd = &device->m_CommandBuffers[device->m_CommandBufferIndexCurr];
@@ -686,24 +881,17 @@ GfxCommandBuffer GfxBeginFrame(GfxDevice device)
     VK(vkWaitForFences(device->m_Device, 1, &cmd->m_CommandBufferFence, VK_TRUE, UINT64_MAX));
     VK(vkResetFences(device->m_Device, 1, &cmd->m_CommandBufferFence));
 
+    ++device->m_FrameIndex;
+    UpdateMemoryBudget(device);
+
 	VkCommandBufferBeginInfo cmd_begin_info = {};
 	cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	VK(vkBeginCommandBuffer(cmd->m_CommandBuffer, &cmd_begin_info));
 
-	{
-        const uint32_t function_count = device->m_CmdFunctions.Count();
-        for (uint32_t i = 0; i < function_count; ++i)
-        {
-            GfxCmdFunction func = device->m_CmdFunctions[i];
-            void* user_data = static_cast<void*>(&device->m_CmdFunctionUserData[device->m_CmdFunctionUserDataOffsets[i]]);
-            (*func)(cmd->m_CommandBuffer, user_data);
-        }
+    cmd->m_IndexBuffer = NULL;
 
-        device->m_CmdFunctions.Clear();
-        device->m_CmdFunctionUserData.Clear();
-        device->m_CmdFunctionUserDataOffsets.Clear();
-	}
+    ExecuteQueuedCmds(device, cmd->m_CommandBuffer);
 
     VK(vkResetDescriptorPool(device->m_Device, cmd->m_DescriptorPool, 0));
 
@@ -713,6 +901,13 @@ void GfxEndFrame(GfxDevice device)
 {
     GfxCommandBuffer cmd = &device->m_CommandBuffers[device->m_CommandBufferIndexCurr];
 
+    // Makes shader writes to readback buffers visible to the host once the frame fence is signalled
+    VkMemoryBarrier readback_barrier = {};
+    readback_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readback_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    readback_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd->m_CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &readback_barrier, 0, NULL, 0, NULL);
+
 	VK(vkEndCommandBuffer(cmd->m_CommandBuffer));
 
     cmd->m_StagingBufferTail = device->m_StagingBufferHead;
@@ -742,6 +937,53 @@ void GfxEndFrame(GfxDevice device)
     device->m_CommandBufferIndexNext = (device->m_CommandBufferIndexCurr + 1) % device->m_SwapchainImageCount;
 }
 
+GfxCommandBuffer BeginImmediateCommandBuffer(GfxDevice device)
+{
+    GfxCommandBuffer cmd = New<GfxCommandBuffer_T>();
+    cmd->m_Device = device;
+
+    VkCommandBufferAllocateInfo command_buffer_info = {};
+    command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_info.commandPool = device->m_CommandPool;
+    command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_info.commandBufferCount = 1;
+    VK(vkAllocateCommandBuffers(device->m_Device, &command_buffer_info, &cmd->m_CommandBuffer));
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK(vkCreateFence(device->m_Device, &fence_info, NULL, &cmd->m_CommandBufferFence));
+
+    cmd->m_DescriptorPool = CreateDescriptorPool(device, 4096);
+
+    VkCommandBufferBeginInfo cmd_begin_info = {};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK(vkBeginCommandBuffer(cmd->m_CommandBuffer, &cmd_begin_info));
+
+    cmd->m_IndexBuffer = NULL;
+
+    // Resources created since the last frame must be uploaded first
+    ExecuteQueuedCmds(device, cmd->m_CommandBuffer);
+
+    return cmd;
+}
+void EndImmediateCommandBuffer(GfxDevice device, GfxCommandBuffer cmd)
+{
+    VK(vkEndCommandBuffer(cmd->m_CommandBuffer));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd->m_CommandBuffer;
+    VK(vkQueueSubmit(device->m_GraphicsQueue, 1, &submit_info, cmd->m_CommandBufferFence));
+    VK(vkWaitForFences(device->m_Device, 1, &cmd->m_CommandBufferFence, VK_TRUE, UINT64_MAX));
+
+    vkDestroyDescriptorPool(device->m_Device, cmd->m_DescriptorPool, NULL);
+    vkDestroyFence(device->m_Device, cmd->m_CommandBufferFence, NULL);
+    vkFreeCommandBuffers(device->m_Device, device->m_CommandPool, 1, &cmd->m_CommandBuffer);
+    Delete<GfxCommandBuffer_T>(cmd);
+}
+
 GfxAllocation GfxAllocateUploadBuffer(GfxDevice device, size_t size)
 {
     GfxAllocation allocation;
@@ -764,7 +1006,25 @@ GfxTexture GfxGetBackBuffer(GfxDevice device, uint32_t index)
     return &device->m_SwapchainTextures[index];
 }
 
-GfxBuffer GfxCreateBuffer(GfxDevice device, const GfxCreateBufferParams& params)
+// Blob sections are decoded back to back into staging memory without going through an intermediate heap block
+static VkDeviceSize StageSections(GfxDevice device, VkDeviceSize size, const StreamSection* sections, uint32_t section_count)
+{
+    VkDeviceSize staging_buffer_offset = AllocateStagingBuffer(device, size);
+    uint8_t* staging_data = device->m_StagingBufferMappedData + staging_buffer_offset;
+    for (uint32_t i = 0; i < section_count; ++i)
+    {
+        ASSERT(staging_data + sections[i].m_Size <= device->m_StagingBufferMappedData + staging_buffer_offset + size);
+        if (!DecodeSection(sections[i], staging_data))
+        {
+            Print("Error: Failed to decompress blob section");
+            memset(staging_data, 0, sections[i].m_Size);
+        }
+        staging_data += sections[i].m_Size;
+    }
+    return staging_buffer_offset;
+}
+
+static GfxBuffer CreateBuffer(GfxDevice device, const GfxCreateBufferParams& params, const StreamSection* sections, uint32_t section_count)
 {
 	GfxBuffer buffer = New<GfxBuffer_T>();
 	buffer->m_Size = params.m_Size;
@@ -778,12 +1038,23 @@ GfxBuffer GfxCreateBuffer(GfxDevice device, const GfxCreateBufferParams& params)
 	VmaAllocationCreateInfo buffer_allocation_info = {};
 	buffer_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-	VK(vmaCreateBuffer(device->m_Allocator, &buffer_info, &buffer_allocation_info, &buffer->m_Buffer, &buffer->m_Allocation, NULL));
+	VmaAllocationInfo allocation_info = {};
+	VK(vmaCreateBuffer(device->m_Allocator, &buffer_info, &buffer_allocation_info, &buffer->m_Buffer, &buffer->m_Allocation, &allocation_info));
+	buffer->m_AllocationSize = allocation_info.size;
+	device->m_AllocatedMemory += buffer->m_AllocationSize;
 
-	if (params.m_Data != NULL)
+	if (params.m_Data != NULL || section_count > 0)
 	{
-        VkDeviceSize staging_buffer_offset = AllocateStagingBuffer(device, params.m_Size);
-        memcpy(device->m_StagingBufferMappedData + staging_buffer_offset, params.m_Data, params.m_Size);
+        VkDeviceSize staging_buffer_offset;
+        if (params.m_Data != NULL)
+        {
+            staging_buffer_offset = AllocateStagingBuffer(device, params.m_Size);
+            memcpy(device->m_StagingBufferMappedData + staging_buffer_offset, params.m_Data, params.m_Size);
+        }
+        else
+        {
+            staging_buffer_offset = StageSections(device, params.m_Size, sections, section_count);
+        }
 
         CmdUploadBufferParams upload_params;
         upload_params.m_DstBuffer = buffer->m_Buffer;
@@ -797,15 +1068,57 @@ GfxBuffer GfxCreateBuffer(GfxDevice device, const GfxCreateBufferParams& params)
 
 	return buffer;
 }
+GfxBuffer GfxCreateBuffer(GfxDevice device, const GfxCreateBufferParams& params)
+{
+    return CreateBuffer(device, params, NULL, 0);
+}
+GfxBuffer CreateBufferFromSections(GfxDevice device, const GfxCreateBufferParams& params, const StreamSection* sections, uint32_t section_count)
+{
+    return CreateBuffer(device, params, sections, section_count);
+}
+GfxBuffer CreateReadbackBuffer(GfxDevice device, const GfxCreateBufferParams& params, void** out_data)
+{
+    ASSERT(params.m_Data == NULL);
+
+    GfxBuffer buffer = New<GfxBuffer_T>();
+    buffer->m_Size = params.m_Size;
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = params.m_Size;
+    buffer_info.usage = ToVkBufferUsageMask(params.m_Usage);
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Coherent memory since this allocator has no way to invalidate a mapped range
+    VmaAllocationCreateInfo buffer_allocation_info = {};
+    buffer_allocation_info.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+    buffer_allocation_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    buffer_allocation_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VmaAllocationInfo allocation_info = {};
+    VK(vmaCreateBuffer(device->m_Allocator, &buffer_info, &buffer_allocation_info, &buffer->m_Buffer, &buffer->m_Allocation, &allocation_info));
+    buffer->m_AllocationSize = 0;
+    *out_data = allocation_info.pMappedData;
+
+    return buffer;
+}
 void GfxDestroyBuffer(GfxDevice device, GfxBuffer buffer)
 {
 	vmaDestroyBuffer(device->m_Allocator, buffer->m_Buffer, buffer->m_Allocation);
+	device->m_AllocatedMemory -= buffer->m_AllocationSize;
 
 	Delete<GfxBuffer_T>(buffer);
 }
 
-GfxTexture GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& params)
+static GfxTexture CreateTexture(GfxDevice device, const GfxCreateTextureParams& params, const StreamSection* sections, uint32_t section_count)
 {
+    ASSERT(params.m_MipCount >= 1 && params.m_MipCount <= GFX_MAX_MIP_COUNT);
+    ASSERT(!params.m_GenerateMipmaps || ToBlockStride(ToVkFormat(params.m_Format)) == 0); // Block compressed images can not be blitted to
+    ASSERT(!params.m_GenerateMipmaps || params.m_MipCount == 1);
+    ASSERT(params.m_LayerCount >= 1);
+    ASSERT(params.m_Type != GFX_TEXTURE_TYPE_3D || params.m_LayerCount == 1);
+    ASSERT((params.m_Type != GFX_TEXTURE_TYPE_CUBE && params.m_Type != GFX_TEXTURE_TYPE_CUBE_ARRAY) || params.m_LayerCount % 6 == 0);
+
 	GfxTexture texture = New<GfxTexture_T>();
 	texture->m_Width = params.m_Width;
 	texture->m_Height = params.m_Height;
@@ -818,18 +1131,25 @@ GfxTexture GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& para
 	image_info.extent.width = texture->m_Width;
 	image_info.extent.height = texture->m_Height;
 	image_info.extent.depth = texture->m_Depth;
-	image_info.mipLevels = params.m_GenerateMipmaps ? MipCount(params.m_Width, params.m_Height, 1) : 1;
-	image_info.arrayLayers = 1;
+	image_info.mipLevels = params.m_GenerateMipmaps ? MipCount(params.m_Width, params.m_Height, params.m_Depth) : params.m_MipCount;
+	image_info.arrayLayers = params.m_LayerCount;
 	image_info.format = texture->m_Format;
 	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
 	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
 	image_info.usage = ToVkImageUsageMask(params.m_Usage);
 	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (params.m_Type == GFX_TEXTURE_TYPE_CUBE || params.m_Type == GFX_TEXTURE_TYPE_CUBE_ARRAY)
+		image_info.flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 
 	VmaAllocationCreateInfo image_allocation_info = {};
 	image_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-	VK(vmaCreateImage(device->m_Allocator, &image_info, &image_allocation_info, &texture->m_Image, &texture->m_Allocation, NULL));
+	VmaAllocationInfo allocation_info = {};
+	VK(vmaCreateImage(device->m_Allocator, &image_info, &image_allocation_info, &texture->m_Image, &texture->m_Allocation, &allocation_info));
+	texture->m_AllocationSize = allocation_info.size;
+	device->m_AllocatedMemory += texture->m_AllocationSize;
+	texture->m_RefCount = 1;
+	texture->m_PathHash = 0;
 
 	VkImageViewCreateInfo image_view_info = {};
 	image_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -847,10 +1167,50 @@ GfxTexture GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& para
 	image_view_info.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
 	VK(vkCreateImageView(device->m_Device, &image_view_info, NULL, &texture->m_ImageView));
 
-	if (params.m_Data != NULL)
+	if (params.m_Data != NULL || section_count > 0)
 	{
-        VkDeviceSize staging_buffer_offset = AllocateStagingBuffer(device, params.m_DataSize);
-        memcpy(device->m_StagingBufferMappedData + staging_buffer_offset, params.m_Data, params.m_DataSize);
+        VkDeviceSize staging_buffer_offset;
+        size_t data_size = 0;
+        if (params.m_Data != NULL)
+        {
+            data_size = params.m_DataSize;
+            staging_buffer_offset = AllocateStagingBuffer(device, data_size);
+            memcpy(device->m_StagingBufferMappedData + staging_buffer_offset, params.m_Data, data_size);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < section_count; ++i)
+                data_size += sections[i].m_Size;
+            staging_buffer_offset = StageSections(device, data_size, sections, section_count);
+        }
+
+        // Every mip of every layer in the data is copied by a region of its own, all in a single copy
+        const uint32_t data_mip_count = params.m_GenerateMipmaps ? 1 : params.m_MipCount;
+        Array<VkBufferImageCopy> regions(data_mip_count * params.m_LayerCount);
+        VkDeviceSize packed_offset = 0;
+        for (uint32_t layer = 0; layer < params.m_LayerCount; ++layer)
+        {
+            for (uint32_t mip = 0; mip < data_mip_count; ++mip)
+            {
+                const uint32_t index = layer * data_mip_count + mip;
+                VkBufferImageCopy& region = regions[index];
+                region = VkBufferImageCopy();
+                region.imageSubresource.aspectMask = ToVkImageAspectMask(texture->m_Format);
+                region.imageSubresource.mipLevel = mip;
+                region.imageSubresource.baseArrayLayer = layer;
+                region.imageSubresource.layerCount = 1;
+                region.imageExtent.width = Max(texture->m_Width >> mip, 1);
+                region.imageExtent.height = Max(texture->m_Height >> mip, 1);
+                region.imageExtent.depth = Max(texture->m_Depth >> mip, 1);
+
+                const VkDeviceSize size = ToImageSize(texture->m_Format, region.imageExtent.width, region.imageExtent.height) * region.imageExtent.depth;
+                const VkDeviceSize offset = params.m_SubresourceOffsets ? params.m_SubresourceOffsets[index] : packed_offset;
+                ASSERT(offset + size <= data_size);
+                region.bufferOffset = staging_buffer_offset + offset;
+                packed_offset += size;
+            }
+        }
+        const uint32_t regions_size = regions.Count() * sizeof(VkBufferImageCopy);
 
         if (params.m_GenerateMipmaps)
         {
@@ -858,26 +1218,25 @@ GfxTexture GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& para
             mipmap_params.m_DstImage = texture->m_Image;
             mipmap_params.m_DstWidth = texture->m_Width;
             mipmap_params.m_DstHeight = texture->m_Height;
+            mipmap_params.m_DstDepth = texture->m_Depth;
             mipmap_params.m_DstMipCount = image_info.mipLevels;
+            mipmap_params.m_DstLayerCount = params.m_LayerCount;
             mipmap_params.m_DstAspectMask = ToVkImageAspectMask(texture->m_Format);
             mipmap_params.m_DstAccessMask = ToVkAccessMask(params.m_InitialState);
             mipmap_params.m_DstLayout = ToVkImageLayout(params.m_InitialState);
             mipmap_params.m_SrcBuffer = device->m_StagingBuffer.m_Buffer;
-            mipmap_params.m_SrcOffset = staging_buffer_offset;
-            QueueCmd(device, &CmdGenerateMipmap, &mipmap_params, sizeof(CmdGenerateMipmapParams));
+            QueueCmd(device, &CmdGenerateMipmap, &mipmap_params, sizeof(CmdGenerateMipmapParams), regions.Data(), regions_size);
         }
         else
         {
             CmdUploadImageParams upload_params;
             upload_params.m_DstImage = texture->m_Image;
-            upload_params.m_DstWidth = texture->m_Width;
-            upload_params.m_DstHeight = texture->m_Height;
             upload_params.m_DstAspectMask = ToVkImageAspectMask(texture->m_Format);
             upload_params.m_DstAccessMask = ToVkAccessMask(params.m_InitialState);
             upload_params.m_DstLayout = ToVkImageLayout(params.m_InitialState);
             upload_params.m_SrcBuffer = device->m_StagingBuffer.m_Buffer;
-            upload_params.m_SrcOffset = staging_buffer_offset;
-            QueueCmd(device, &CmdUploadImage, &upload_params, sizeof(CmdUploadImageParams));
+            upload_params.m_RegionCount = regions.Count();
+            QueueCmd(device, &CmdUploadImage, &upload_params, sizeof(CmdUploadImageParams), regions.Data(), regions_size);
         }
 	}
 	else
@@ -892,114 +1251,253 @@ GfxTexture GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& para
 
 	return texture;
 }
+GfxTexture GfxCreateTexture(GfxDevice device, const GfxCreateTextureParams& params)
+{
+    return CreateTexture(device, params, NULL, 0);
+}
+GfxTexture CreateTextureFromSections(GfxDevice device, const GfxCreateTextureParams& params, const StreamSection* sections, uint32_t section_count)
+{
+    return CreateTexture(device, params, sections, section_count);
+}
 void GfxDestroyTexture(GfxDevice device, GfxTexture texture)
 {
+    if (--texture->m_RefCount > 0)
+        return;
+    for (uint32_t i = 0; texture->m_PathHash != 0 && i < device->m_CachedTextures.Count(); ++i)
+    {
+        if (device->m_CachedTextures[i] == texture)
+        {
+            device->m_CachedTextures.EraseSwap(i);
+            break;
+        }
+    }
+
 	vkDestroyImageView(device->m_Device, texture->m_ImageView, NULL);
 	vmaDestroyImage(device->m_Allocator, texture->m_Image, texture->m_Allocation);
+	device->m_AllocatedMemory -= texture->m_AllocationSize;
 
 	Delete<GfxTexture_T>(texture);
 }
-GfxTexture GfxLoadTexture(GfxDevice device, const char* filepath)
+bool ReadTextureBlobInfo(const void* blob_data, size_t blob_size, TextureBlobInfo* out_info)
 {
-    const size_t filepath_len = strlen(filepath);
+    if (blob_size < sizeof(BlobHeader) + sizeof(uint32_t) * 4)
+        return false;
+
+    ReadStream stream(blob_data, blob_size);
+    stream.IncrPtr(sizeof(BlobHeader)); // Header
+
+    out_info->m_Width = stream.ReadUint32();
+    out_info->m_Height = stream.ReadUint32();
+    out_info->m_Format = static_cast<GfxFormat>(stream.ReadUint32());
+    out_info->m_MipCount = stream.ReadUint32();
+    out_info->m_Checksum = static_cast<const BlobHeader*>(blob_data)->m_Checksum;
+    out_info->m_BlobSize = blob_size;
+    if (out_info->m_MipCount < 1 || out_info->m_MipCount > GFX_MAX_MIP_COUNT || blob_size < sizeof(BlobHeader) + sizeof(uint32_t) * 4 + sizeof(uint64_t) * out_info->m_MipCount)
+        return false;
+    for (uint32_t mip = 0; mip < out_info->m_MipCount; ++mip)
+    {
+        out_info->m_MipOffsets[mip] = stream.ReadUint64();
+        if (out_info->m_MipOffsets[mip] + sizeof(uint64_t) * 2 > blob_size)
+            return false;
+    }
+    return true;
+}
+uint32_t GetTextureBlobTailMip(const TextureBlobInfo& info, uint32_t max_size)
+{
+    uint32_t mip = 0;
+    while (mip + 1 < info.m_MipCount && Max(info.m_Width >> mip, info.m_Height >> mip) > max_size)
+        ++mip;
+    return mip;
+}
+GfxTexture CreateTextureFromBlob(GfxDevice device, const void* blob_data, const TextureBlobInfo& info, uint32_t first_mip)
+{
+    ASSERT(first_mip < info.m_MipCount);
 
-    size_t blob_filepath_offset = 0;
-    while (blob_filepath_offset < filepath_len &&
-        (filepath[blob_filepath_offset] == '.' ||
-         filepath[blob_filepath_offset] == '/' ||
-         filepath[blob_filepath_offset] == '\\'))
+    // Mips are copied or decompressed from the mapped blob straight into staging memory
+    StreamSection mip_sections[GFX_MAX_MIP_COUNT];
+    for (uint32_t mip = first_mip; mip < info.m_MipCount; ++mip)
     {
-        ++blob_filepath_offset;
+        ReadStream stream(static_cast<const uint8_t*>(blob_data) + info.m_MipOffsets[mip], static_cast<size_t>(info.m_BlobSize - info.m_MipOffsets[mip]));
+        mip_sections[mip - first_mip] = stream.ReadSection();
+        ASSERT(mip_sections[mip - first_mip].m_Size == GetTextureDataSize(info.m_Format, Max(info.m_Width >> mip, 1), Max(info.m_Height >> mip, 1), 1));
     }
-    String blob_filepath("Data/%s.blob", filepath + blob_filepath_offset);
-
-    void* image_data = NULL;
-    void* blob_data = NULL;
-    size_t image_size = 0;
-    size_t blob_size = 0;
-    bool image_loaded = ReadFile(filepath, "rb", &image_data, &image_size);
-    bool blob_loaded = ReadFile(blob_filepath.Data(), "rb", &blob_data, &blob_size);
-    if (!image_loaded && !blob_loaded)
+
+    GfxCreateTextureParams texture_params;
+    texture_params.m_Width = Max(info.m_Width >> first_mip, 1);
+    texture_params.m_Height = Max(info.m_Height >> first_mip, 1);
+    texture_params.m_Format = info.m_Format;
+    texture_params.m_Usage = GFX_TEXTURE_USAGE_SAMPLE_BIT;
+    texture_params.m_InitialState = GFX_TEXTURE_STATE_SHADER_READ;
+    texture_params.m_MipCount = info.m_MipCount - first_mip;
+    return CreateTextureFromSections(device, texture_params, mip_sections, info.m_MipCount - first_mip);
+}
+void CookTextureLoad(TextureLoad* load, uint32_t thread_count)
+{
+    const FileRead* image_read = &load->m_ImageRead;
+    FileRead* blob_read = &load->m_BlobRead;
+    if (!image_read->m_Loaded)
+        return;
+
+    GfxDevice device = load->m_Device;
+    const void* image_data = image_read->m_Data;
+    const size_t image_size = image_read->m_Size;
+    if (blob_read->m_Loaded && IsBlobChecksumCurrent(blob_read->m_MappedFile.m_Data, blob_read->m_MappedFile.m_Size, image_data, image_size, GetTextureBlobFlags(device)))
     {
-        Print("Error: Failed to read from file %s", filepath);
-        return NULL;
+        UpdateBlobSourceStamp(load->m_BlobFilepath, load->m_ImageStamp);
+        return;
     }
 
-    bool create_new_blob = false;
-    if (image_loaded && blob_loaded)
+    // The stale blob is unmapped before its file is overwritten
+    ReleaseFileRead(blob_read);
+
+    int width, height, component_count;
+    stbi_uc* pixel_data = stbi_load_from_memory(static_cast<const stbi_uc*>(image_data), static_cast<int>(image_size), &width, &height, &component_count, STBI_rgb_alpha);
+    if (pixel_data == NULL)
     {
-        uint64_t image_checksum = GfxHash(static_cast<const char*>(image_data), image_size);
-        uint64_t blob_checksum = *static_cast<const uint64_t*>(blob_data);
-        create_new_blob = image_checksum != blob_checksum;
+        Print("Error: Failed to decode %s", load->m_Filepath);
+        return;
     }
-    else if (image_loaded)
+
+    // Every mip is cooked up front since block compressed images can not have their mips generated on the GPU
+    bool normal_map, alpha_tested;
+    const GfxFormat format = ChooseTextureFormat(load->m_Filepath, pixel_data, width, height, device->m_Caps.m_TextureCompressionBC, &normal_map, &alpha_tested);
+    const uint32_t mip_count = MipCount(width, height, 1);
+    const size_t texture_data_size = GetTextureDataSize(format, width, height, mip_count);
+
+    Blob& blob = load->m_CookedBlob;
+    blob.m_Size =
+        sizeof(BlobHeader) +                                    // Header
+        sizeof(uint32_t) +                                      // Width
+        sizeof(uint32_t) +                                      // Height
+        sizeof(uint32_t) +                                      // Format
+        sizeof(uint32_t) +                                      // Mip count
+        sizeof(uint64_t) * mip_count +                          // Mip offsets
+        sizeof(uint64_t) * 2 * mip_count + texture_data_size;   // Mips
+    blob.m_Data = Alloc(blob.m_Size);
+
+    void* texture_data = Alloc(texture_data_size);
+    CookTexture(format, normal_map, alpha_tested, pixel_data, width, height, mip_count, texture_data, thread_count);
+
+    // Each mip is a section of its own so streaming can load a few mips without decoding the rest
+    WriteStream stream(blob.m_Data, blob.m_Size);
+    WriteBlobHeader(stream, image_data, image_size, load->m_ImageStamp, GetTextureBlobFlags(device));
+    stream.WriteUint32(static_cast<uint32_t>(width));
+    stream.WriteUint32(static_cast<uint32_t>(height));
+    stream.WriteUint32(static_cast<uint32_t>(format));
+    stream.WriteUint32(mip_count);
+    uint64_t* mip_offsets = static_cast<uint64_t*>(stream.GetPtr());
+    stream.IncrPtr(sizeof(uint64_t) * mip_count);
+    const uint8_t* mip_data = static_cast<const uint8_t*>(texture_data);
+    for (uint32_t mip = 0; mip < mip_count; ++mip)
     {
-        create_new_blob = true;
+        const size_t mip_size = GetTextureDataSize(format, Max(width >> mip, 1), Max(height >> mip, 1), 1);
+        mip_offsets[mip] = static_cast<uint8_t*>(stream.GetPtr()) - static_cast<uint8_t*>(blob.m_Data);
+        void* mip_section = stream.BeginSection();
+        stream.WriteBytes(mip_data, mip_size);
+        stream.EndSection(mip_section, device->m_CompressBlobs);
+        mip_data += mip_size;
     }
+    blob.m_Size = static_cast<const uint8_t*>(stream.GetPtr()) - static_cast<const uint8_t*>(blob.m_Data);
+    load->m_Cooked = true;
 
-    Blob blob;
-    if (create_new_blob)
+    Free(texture_data);
+    stbi_image_free(pixel_data);
+
+    if (!WriteFile(load->m_BlobFilepath, "wb", blob.m_Data, blob.m_Size))
     {
-        int width, height, component_count;
-        stbi_uc* pixel_data = stbi_load_from_memory(static_cast<const stbi_uc*>(image_data), static_cast<int>(image_size), &width, &height, &component_count, STBI_rgb_alpha);
-        ASSERT(pixel_data);
-        size_t pixel_data_size = width * height * 4;
-
-        blob.m_Size =
-            sizeof(uint64_t) +                      // Checksum
-            sizeof(uint32_t) +                      // Width
-            sizeof(uint32_t) +                      // Height
-            sizeof(uint64_t) + pixel_data_size;     // Pixel data
-        blob.m_Data = Alloc(blob.m_Size);
-
-        WriteStream stream(blob.m_Data, blob.m_Size);
-        stream.WriteUint64(GfxHash(static_cast<const char*>(image_data), image_size));
-        stream.WriteUint32(static_cast<uint32_t>(width));
-        stream.WriteUint32(static_cast<uint32_t>(height));
-        stream.Write(pixel_data, pixel_data_size);
-        ASSERT(stream.IsEndOfStream());
-
-        stbi_image_free(pixel_data);
-
-        if (!WriteFile(blob_filepath.Data(), "wb", blob.m_Data, blob.m_Size))
-        {
-            Print("Error: Failed to write to file %s", blob_filepath.Data());
-        }
+        Print("Error: Failed to write to file %s", load->m_BlobFilepath);
     }
-    else
+}
+GfxTexture CreateTextureFromLoad(TextureLoad* load, uint32_t tail_size, TextureBlobInfo* out_info)
+{
+    const MappedFile& blob_file = load->m_BlobRead.m_MappedFile;
+    if (!load->m_Cooked && !load->m_BlobRead.m_Loaded)
     {
-        blob.m_Data = blob_data;
-        blob.m_Size = blob_size;
+        if (!load->m_ImageRead.m_Loaded)
+            Print("Error: Failed to read from file %s", load->m_Filepath);
+        return NULL;
     }
 
-    ReadStream stream(blob.m_Data, blob.m_Size);
-    stream.ReadUint64(); // Checksum
-
-    uint32_t width = stream.ReadUint32();
-    uint32_t height = stream.ReadUint32();
+    const void* blob_data = load->m_Cooked ? load->m_CookedBlob.m_Data : blob_file.m_Data;
+    const size_t blob_size = load->m_Cooked ? load->m_CookedBlob.m_Size : blob_file.m_Size;
+    TextureBlobInfo info = {};
+    GfxTexture texture = NULL;
+    if (ReadTextureBlobInfo(blob_data, blob_size, &info))
+        texture = CreateTextureFromBlob(load->m_Device, blob_data, info, tail_size > 0 ? GetTextureBlobTailMip(info, tail_size) : 0);
+    else
+        Print("Error: %s is not a valid texture blob", load->m_BlobFilepath);
+    if (out_info)
+        *out_info = info;
 
-    size_t pixel_data_size;
-    const void* pixel_data = stream.Read(&pixel_data_size);
+    Print("Loaded %s", load->m_Cooked ? load->m_Filepath : load->m_BlobFilepath);
 
-    GfxCreateTextureParams texture_params;
-    texture_params.m_Width = width;
-    texture_params.m_Height = height;
-    texture_params.m_Format = GFX_FORMAT_R8G8B8A8_UNORM;
-    texture_params.m_Usage = GFX_TEXTURE_USAGE_SAMPLE_BIT;
-    texture_params.m_InitialState = GFX_TEXTURE_STATE_SHADER_READ;
-    texture_params.m_Data = pixel_data;
-    texture_params.m_DataSize = pixel_data_size;
-    texture_params.m_GenerateMipmaps = true;
-    GfxTexture texture = GfxCreateTexture(device, texture_params);
+    return texture;
+}
+void ReleaseTextureLoad(TextureLoad* load)
+{
+    ReleaseFileRead(&load->m_ImageRead);
+    ReleaseFileRead(&load->m_BlobRead);
+    DestroyBlob(load->m_CookedBlob);
+    load->m_CookedBlob = Blob();
+    load->m_Cooked = false;
+}
+GfxTexture AcquireCachedTexture(GfxDevice device, const char* filepath)
+{
+    const uint64_t hash = HashAssetPath(filepath);
+    for (uint32_t i = 0; i < device->m_CachedTextures.Count(); ++i)
+    {
+        GfxTexture texture = device->m_CachedTextures[i];
+        if (texture->m_PathHash == hash)
+        {
+            ++texture->m_RefCount;
+            return texture;
+        }
+    }
+    return NULL;
+}
+void AddCachedTexture(GfxDevice device, const char* filepath, GfxTexture texture)
+{
+    texture->m_PathHash = HashAssetPath(filepath);
+    device->m_CachedTextures.Push(texture);
+}
+GfxTexture GfxLoadTexture(GfxDevice device, const char* filepath)
+{
+    if (GfxTexture texture = AcquireCachedTexture(device, filepath))
+        return texture;
+
+    String blob_filepath = GetBlobFilepath(filepath);
+
+    TextureLoad load;
+    load.m_Device = device;
+    load.m_Filepath = filepath;
+    load.m_BlobFilepath = blob_filepath.Data();
+    load.m_ImageRead.m_Path = filepath;
+    load.m_ImageRead.m_Mode = "rb";
+    load.m_BlobRead.m_Path = blob_filepath.Data();
+
+    // Packed blobs are used as they are without looking at the source file
+    const bool blob_packed = ResolvePackedFile(device, &load.m_BlobRead);
+    const bool image_exists = !blob_packed && GetFileStamp(filepath, &load.m_ImageStamp);
+
+    // The image is only read when the blob is missing or was cooked from another version of it
+    FileBatch batch;
+    if (!blob_packed)
+    {
+        SubmitFileBatch(device->m_FileQueue, &batch, &load.m_BlobRead, 1);
+        while (WaitFileBatch(device->m_FileQueue, &batch));
+    }
+    if (image_exists && !(load.m_BlobRead.m_Loaded && IsBlobStampCurrent(load.m_BlobRead.m_MappedFile.m_Data, load.m_BlobRead.m_MappedFile.m_Size, load.m_ImageStamp, GetTextureBlobFlags(device))))
+    {
+        SubmitFileBatch(device->m_FileQueue, &batch, &load.m_ImageRead, 1);
+        while (WaitFileBatch(device->m_FileQueue, &batch));
+    }
 
-    if (create_new_blob)
-        DestroyBlob(blob);
-    if (image_loaded)
-        Free(image_data);
-    if (blob_loaded)
-        Free(blob_data);
+    CookTextureLoad(&load, 0);
+    GfxTexture texture = CreateTextureFromLoad(&load);
+    if (texture)
+        AddCachedTexture(device, filepath, texture);
 
-    Print("Loaded %s", create_new_blob ? filepath : blob_filepath.Data());
+    ReleaseTextureLoad(&load);
 
     return texture;
 }
@@ -1107,7 +1605,7 @@ void GfxCmdBeginTechnique(GfxCommandBuffer cmd, GfxTechnique tech)
 
     cmd->m_DescriptorWrites.Resize(tech->m_ShaderBindingCount);
     cmd->m_DescriptorBufferInfo.Resize(tech->m_ShaderBindingCount);
-    cmd->m_DescriptorImageInfo.Resize(tech->m_ShaderBindingCount);
+    cmd->m_DescriptorImageInfo.Resize(tech->m_DescriptorImageInfoCount);
     cmd->m_IsDescriptorSetDirty = false;
 }
 void GfxCmdEndTechnique(GfxCommandBuffer cmd)
@@ -1191,6 +1689,11 @@ void GfxCmdBindVertexBuffer(GfxCommandBuffer cmd, uint32_t binding, GfxBuffer bu
 void GfxCmdBindIndexBuffer(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, uint32_t stride)
 {
     ASSERT(stride == sizeof(uint16_t) || stride == sizeof(uint32_t));
+    if (cmd->m_IndexBuffer == buffer && cmd->m_IndexBufferOffset == offset && cmd->m_IndexBufferStride == stride)
+        return;
+    cmd->m_IndexBuffer = buffer;
+    cmd->m_IndexBufferOffset = offset;
+    cmd->m_IndexBufferStride = stride;
     vkCmdBindIndexBuffer(cmd->m_CommandBuffer, buffer->m_Buffer, offset, stride == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
 }
 
@@ -1223,23 +1726,43 @@ void GfxCmdSetBuffer(GfxCommandBuffer cmd, uint64_t hash, GfxBuffer buffer, uint
 }
 void GfxCmdSetTexture(GfxCommandBuffer cmd, uint64_t hash, GfxTexture texture, GfxTextureState state)
 {
-    const GfxTechnique_T::ShaderBinding* binding = cmd->m_Technique->m_ShaderBindings.Find(hash);
+    GfxCmdSetTextures(cmd, hash, &texture, 1, state);
+}
+void GfxCmdSetTextures(GfxCommandBuffer cmd, uint64_t hash, const GfxTexture* textures, uint32_t texture_count, GfxTextureState state)
+{
+    GfxTechnique_T::ShaderBinding* binding = cmd->m_Technique->m_ShaderBindings.Find(hash);
     ASSERT(binding);
     ASSERT(binding->m_Type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
            binding->m_Type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    ASSERT(texture_count > 0);
+    if (texture_count > binding->m_Count)
+    {
+        if (!binding->m_Truncated)
+            Print("Error: %u textures bound to an array of %u, the rest are left out", texture_count, binding->m_Count);
+        binding->m_Truncated = true;
+        texture_count = binding->m_Count;
+    }
 
-    cmd->m_DescriptorImageInfo[binding->m_Binding].imageView = texture->m_ImageView;
-    cmd->m_DescriptorImageInfo[binding->m_Binding].imageLayout = ToVkImageLayout(state);
-    cmd->m_DescriptorImageInfo[binding->m_Binding].sampler = NULL;
+    // Every element of the array has to be valid, so unused elements repeat the first texture and textures that
+    // failed to load are replaced by the default one
+    VkDescriptorImageInfo* image_info = &cmd->m_DescriptorImageInfo[binding->m_ImageInfoOffset];
+    for (uint32_t i = 0; i < binding->m_Count; ++i)
+    {
+        GfxTexture texture = textures[i < texture_count ? i : 0];
+        ASSERT(texture || binding->m_Type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+        image_info[i].imageView = texture ? texture->m_ImageView : cmd->m_Device->m_DefaultTexture->m_ImageView;
+        image_info[i].imageLayout = texture ? ToVkImageLayout(state) : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info[i].sampler = NULL;
+    }
 
     cmd->m_DescriptorWrites[binding->m_Binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     cmd->m_DescriptorWrites[binding->m_Binding].pNext = NULL;
     cmd->m_DescriptorWrites[binding->m_Binding].dstBinding = binding->m_Binding;
     cmd->m_DescriptorWrites[binding->m_Binding].dstArrayElement = 0;
-    cmd->m_DescriptorWrites[binding->m_Binding].descriptorCount = 1;
+    cmd->m_DescriptorWrites[binding->m_Binding].descriptorCount = binding->m_Count;
     cmd->m_DescriptorWrites[binding->m_Binding].descriptorType = binding->m_Type;
     cmd->m_DescriptorWrites[binding->m_Binding].pBufferInfo = NULL;
-    cmd->m_DescriptorWrites[binding->m_Binding].pImageInfo = &cmd->m_DescriptorImageInfo[binding->m_Binding];
+    cmd->m_DescriptorWrites[binding->m_Binding].pImageInfo = image_info;
     cmd->m_DescriptorWrites[binding->m_Binding].pTexelBufferView = NULL;
 
     cmd->m_IsDescriptorSetDirty = true;
@@ -1250,9 +1773,9 @@ void GfxCmdSetSampler(GfxCommandBuffer cmd, uint64_t hash, GfxSampler sampler)
     ASSERT(binding);
     ASSERT(binding->m_Type == VK_DESCRIPTOR_TYPE_SAMPLER);
 
-    cmd->m_DescriptorImageInfo[binding->m_Binding].imageView = NULL;
-    cmd->m_DescriptorImageInfo[binding->m_Binding].imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    cmd->m_DescriptorImageInfo[binding->m_Binding].sampler = reinterpret_cast<VkSampler>(sampler);
+    cmd->m_DescriptorImageInfo[binding->m_ImageInfoOffset].imageView = NULL;
+    cmd->m_DescriptorImageInfo[binding->m_ImageInfoOffset].imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    cmd->m_DescriptorImageInfo[binding->m_ImageInfoOffset].sampler = reinterpret_cast<VkSampler>(sampler);
 
     cmd->m_DescriptorWrites[binding->m_Binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     cmd->m_DescriptorWrites[binding->m_Binding].pNext = NULL;
@@ -1261,7 +1784,7 @@ void GfxCmdSetSampler(GfxCommandBuffer cmd, uint64_t hash, GfxSampler sampler)
     cmd->m_DescriptorWrites[binding->m_Binding].descriptorCount = 1;
     cmd->m_DescriptorWrites[binding->m_Binding].descriptorType = binding->m_Type;
     cmd->m_DescriptorWrites[binding->m_Binding].pBufferInfo = NULL;
-    cmd->m_DescriptorWrites[binding->m_Binding].pImageInfo = &cmd->m_DescriptorImageInfo[binding->m_Binding];
+    cmd->m_DescriptorWrites[binding->m_Binding].pImageInfo = &cmd->m_DescriptorImageInfo[binding->m_ImageInfoOffset];
     cmd->m_DescriptorWrites[binding->m_Binding].pTexelBufferView = NULL;
 
     cmd->m_IsDescriptorSetDirty = true;
@@ -1318,21 +1841,64 @@ static void UpdateDescriptorSet(GfxCommandBuffer cmd)
     }
 }
 
-void GfxCmdDraw(GfxCommandBuffer cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex)
+void GfxCmdDraw(GfxCommandBuffer cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
 {
     UpdateDescriptorSet(cmd);
-    vkCmdDraw(cmd->m_CommandBuffer, vertex_count, instance_count, first_vertex, 0);
+    vkCmdDraw(cmd->m_CommandBuffer, vertex_count, instance_count, first_vertex, first_instance);
 }
-void GfxCmdDrawIndexed(GfxCommandBuffer cmd, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset)
+void GfxCmdDrawIndexed(GfxCommandBuffer cmd, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance)
 {
     UpdateDescriptorSet(cmd);
-    vkCmdDrawIndexed(cmd->m_CommandBuffer, index_count, instance_count, first_index, vertex_offset, 0);
+    vkCmdDrawIndexed(cmd->m_CommandBuffer, index_count, instance_count, first_index, vertex_offset, first_instance);
 }
 void GfxCmdDispatch(GfxCommandBuffer cmd, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z)
 {
     UpdateDescriptorSet(cmd);
     vkCmdDispatch(cmd->m_CommandBuffer, group_count_x, group_count_y, group_count_z);
 }
+void GfxCmdDrawIndirect(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, uint32_t draw_count, uint32_t stride)
+{
+    UpdateDescriptorSet(cmd);
+    if (draw_count <= 1 || cmd->m_Device->m_Caps.m_MultiDrawIndirect)
+    {
+        vkCmdDrawIndirect(cmd->m_CommandBuffer, buffer->m_Buffer, offset, draw_count, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < draw_count; ++i)
+            vkCmdDrawIndirect(cmd->m_CommandBuffer, buffer->m_Buffer, offset + i * static_cast<uint64_t>(stride), 1, stride);
+    }
+}
+void GfxCmdDrawIndexedIndirect(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, uint32_t draw_count, uint32_t stride)
+{
+    UpdateDescriptorSet(cmd);
+    if (draw_count <= 1 || cmd->m_Device->m_Caps.m_MultiDrawIndirect)
+    {
+        vkCmdDrawIndexedIndirect(cmd->m_CommandBuffer, buffer->m_Buffer, offset, draw_count, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < draw_count; ++i)
+            vkCmdDrawIndexedIndirect(cmd->m_CommandBuffer, buffer->m_Buffer, offset + i * static_cast<uint64_t>(stride), 1, stride);
+    }
+}
+void GfxCmdDrawIndirectCount(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, GfxBuffer count_buffer, uint64_t count_offset, uint32_t max_draw_count, uint32_t stride)
+{
+    ASSERT(cmd->m_Device->m_Caps.m_DrawIndirectCount);
+    UpdateDescriptorSet(cmd);
+    cmd->m_Device->m_CmdDrawIndirectCount(cmd->m_CommandBuffer, buffer->m_Buffer, offset, count_buffer->m_Buffer, count_offset, max_draw_count, stride);
+}
+void GfxCmdDrawIndexedIndirectCount(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset, GfxBuffer count_buffer, uint64_t count_offset, uint32_t max_draw_count, uint32_t stride)
+{
+    ASSERT(cmd->m_Device->m_Caps.m_DrawIndirectCount);
+    UpdateDescriptorSet(cmd);
+    cmd->m_Device->m_CmdDrawIndexedIndirectCount(cmd->m_CommandBuffer, buffer->m_Buffer, offset, count_buffer->m_Buffer, count_offset, max_draw_count, stride);
+}
+void GfxCmdDispatchIndirect(GfxCommandBuffer cmd, GfxBuffer buffer, uint64_t offset)
+{
+    UpdateDescriptorSet(cmd);
+    vkCmdDispatchIndirect(cmd->m_CommandBuffer, buffer->m_Buffer, offset);
+}
 
 void GfxCmdCopyBuffer(GfxCommandBuffer cmd, GfxBuffer dst_buffer, uint64_t dst_offset, GfxBuffer src_buffer, uint64_t src_offset, uint64_t size)
 {
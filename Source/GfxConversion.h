@@ -69,6 +69,14 @@ inline VkFormat ToVkFormat(GfxFormat format)
     case GFX_FORMAT_D32_SFLOAT:                         return VK_FORMAT_D32_SFLOAT;
     case GFX_FORMAT_D16_UNORM_S8_UINT:                  return VK_FORMAT_D16_UNORM_S8_UINT;
     case GFX_FORMAT_D32_SFLOAT_S8_UINT:                 return VK_FORMAT_D32_SFLOAT_S8_UINT;
+    case GFX_FORMAT_BC1_RGB_UNORM:                      return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case GFX_FORMAT_BC1_RGB_SRGB:                       return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case GFX_FORMAT_BC3_UNORM:                          return VK_FORMAT_BC3_UNORM_BLOCK;
+    case GFX_FORMAT_BC3_SRGB:                           return VK_FORMAT_BC3_SRGB_BLOCK;
+    case GFX_FORMAT_BC4_UNORM:                          return VK_FORMAT_BC4_UNORM_BLOCK;
+    case GFX_FORMAT_BC5_UNORM:                          return VK_FORMAT_BC5_UNORM_BLOCK;
+    case GFX_FORMAT_BC7_UNORM:                          return VK_FORMAT_BC7_UNORM_BLOCK;
+    case GFX_FORMAT_BC7_SRGB:                           return VK_FORMAT_BC7_SRGB_BLOCK;
     }
     return VK_FORMAT_MAX_ENUM;
 }
@@ -214,6 +222,31 @@ inline uint32_t ToTexelStride(VkFormat format)
     }
     return 0;
 }
+// Bytes per 4x4 block of a block compressed format, 0 for other formats
+inline uint32_t ToBlockStride(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+    }
+    return 0;
+}
+inline VkDeviceSize ToImageSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    const uint32_t block_stride = ToBlockStride(format);
+    if (block_stride)
+        return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * block_stride;
+    return static_cast<VkDeviceSize>(width) * height * ToTexelStride(format);
+}
 inline const char* ToShaderFormatString(VkFormat format)
 {
     switch (format)
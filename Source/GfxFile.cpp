@@ -0,0 +1,384 @@
+#include "GfxInternal.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define FILE_QUEUE_MAX_THREAD_COUNT 16
+
+struct FileQueue
+{
+    std::mutex                          m_Mutex;
+    std::condition_variable             m_WorkCondition;    // Signalled when reads are submitted or the queue shuts down
+    std::condition_variable             m_DoneCondition;    // Signalled when a read completes
+
+    Array<FileRead*>                    m_Pending;
+    uint32_t                            m_PendingHead       = 0;
+    bool                                m_Quit              = false;
+
+    std::thread                         m_Threads[FILE_QUEUE_MAX_THREAD_COUNT];
+    uint32_t                            m_ThreadCount       = 0;
+};
+
+// Touches a byte per page so the pages are read in here rather than on the thread that decodes them
+static void PrefetchMappedFile(const MappedFile& file, uint64_t offset, uint64_t size)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(file.m_Data);
+    const uint64_t end = offset + size < file.m_Size ? offset + size : file.m_Size;
+    volatile uint8_t sum = 0;
+    for (uint64_t i = offset; i < end; i += 4096)
+        sum += data[i];
+}
+
+static void FileQueueWorker(FileQueue* queue)
+{
+    std::unique_lock<std::mutex> lock(queue->m_Mutex);
+    for (;;)
+    {
+        while (!queue->m_Quit && queue->m_PendingHead == queue->m_Pending.Count())
+            queue->m_WorkCondition.wait(lock);
+        if (queue->m_Quit)
+            return;
+
+        FileRead* read = queue->m_Pending[queue->m_PendingHead++];
+        if (queue->m_PendingHead == queue->m_Pending.Count())
+        {
+            queue->m_Pending.Clear();
+            queue->m_PendingHead = 0;
+        }
+
+        // Packed reads are already mapped and only need their prefetch range
+        lock.unlock();
+        if (!read->m_Packed)
+        {
+            read->m_Loaded = read->m_Mode ?
+                ReadFile(read->m_Path, read->m_Mode, &read->m_Data, &read->m_Size) :
+                MapFile(read->m_Path, &read->m_MappedFile);
+        }
+        if (read->m_Loaded && !read->m_Mode && read->m_PrefetchSize > 0)
+            PrefetchMappedFile(read->m_MappedFile, read->m_PrefetchOffset, read->m_PrefetchSize);
+        if (read->m_Process)
+            read->m_Process(read->m_ProcessData);
+        lock.lock();
+
+        read->m_Batch->m_Completed.Push(read);
+        queue->m_DoneCondition.notify_all();
+    }
+}
+
+FileQueue* CreateFileQueue()
+{
+    FileQueue* queue = New<FileQueue>();
+
+    // One thread per core for the images cooked by FileRead::m_Process, reads mostly wait on the disk so small
+    // machines still get a couple
+    queue->m_ThreadCount = Clamp(std::thread::hardware_concurrency(), 2, FILE_QUEUE_MAX_THREAD_COUNT);
+    for (uint32_t i = 0; i < queue->m_ThreadCount; ++i)
+        queue->m_Threads[i] = std::thread(FileQueueWorker, queue);
+
+    return queue;
+}
+void DestroyFileQueue(FileQueue* queue)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue->m_Mutex);
+        queue->m_Quit = true;
+    }
+    queue->m_WorkCondition.notify_all();
+    for (uint32_t i = 0; i < queue->m_ThreadCount; ++i)
+        queue->m_Threads[i].join();
+
+    Delete<FileQueue>(queue);
+}
+
+void SubmitFileBatch(FileQueue* queue, FileBatch* batch, FileRead* reads, uint32_t read_count)
+{
+    std::lock_guard<std::mutex> lock(queue->m_Mutex);
+    for (uint32_t i = 0; i < read_count; ++i)
+    {
+        reads[i].m_Batch = batch;
+        queue->m_Pending.Push(&reads[i]);
+    }
+    batch->m_SubmittedCount += read_count;
+    queue->m_WorkCondition.notify_all();
+}
+FileRead* WaitFileBatch(FileQueue* queue, FileBatch* batch)
+{
+    std::unique_lock<std::mutex> lock(queue->m_Mutex);
+    if (batch->m_ReturnedCount == batch->m_SubmittedCount)
+        return NULL;
+    while (batch->m_Completed.Count() == batch->m_ReturnedCount)
+        queue->m_DoneCondition.wait(lock);
+    return batch->m_Completed[batch->m_ReturnedCount++];
+}
+FileRead* PollFileBatch(FileQueue* queue, FileBatch* batch)
+{
+    std::lock_guard<std::mutex> lock(queue->m_Mutex);
+    if (batch->m_Completed.Count() == batch->m_ReturnedCount)
+    {
+        // Long lived batches start over whenever they run dry
+        if (batch->m_ReturnedCount == batch->m_SubmittedCount)
+        {
+            batch->m_Completed.Clear();
+            batch->m_SubmittedCount = 0;
+            batch->m_ReturnedCount = 0;
+        }
+        return NULL;
+    }
+    return batch->m_Completed[batch->m_ReturnedCount++];
+}
+void ReleaseFileRead(FileRead* read)
+{
+    if (read->m_Mode)
+    {
+        if (read->m_Data)
+            Free(read->m_Data);
+        read->m_Data = NULL;
+        read->m_Size = 0;
+    }
+    else if (read->m_Packed)
+    {
+        read->m_MappedFile = MappedFile();
+        read->m_Packed = false;
+    }
+    else
+    {
+        UnmapFile(&read->m_MappedFile);
+    }
+    read->m_Loaded = false;
+}
+
+// Pack layout: header, entries sorted by path hash, then payloads aligned to ASSET_PACK_ALIGNMENT
+#define ASSET_PACK_MAGIC        0x50584647 // GFXP
+#define ASSET_PACK_VERSION      1
+#define ASSET_PACK_ALIGNMENT    4096
+
+struct AssetPackHeader
+{
+    uint32_t                            m_Magic;
+    uint32_t                            m_Version;
+    uint32_t                            m_EntryCount;
+    uint32_t                            m_BlobVersion;      // BLOB_VERSION of every packed blob
+};
+struct AssetPackEntry
+{
+    uint64_t                            m_Hash;             // HashAssetPath of the blob filepath
+    uint64_t                            m_Offset;           // From the start of the pack
+    uint64_t                            m_Size;
+    uint32_t                            m_Flags;            // BlobHeader flags of the blob
+    uint32_t                            m_Padding;
+};
+
+uint64_t HashAssetPath(const char* path)
+{
+    char path_buf[2048];
+    strncpy(path_buf, path, sizeof(path_buf) - 1);
+    path_buf[sizeof(path_buf) - 1] = '\0';
+    for (char* c = path_buf; *c; ++c)
+    {
+        if (*c == '\\')
+            *c = '/';
+    }
+    return HashData(path_buf, strlen(path_buf));
+}
+static int CompareAssetPackEntries(const void* a, const void* b)
+{
+    const uint64_t hash_a = static_cast<const AssetPackEntry*>(a)->m_Hash;
+    const uint64_t hash_b = static_cast<const AssetPackEntry*>(b)->m_Hash;
+    return hash_a < hash_b ? -1 : (hash_a > hash_b ? 1 : 0);
+}
+
+bool GfxMountAssetPack(GfxDevice device, const char* filepath)
+{
+    MappedFile pack;
+    if (!MapFile(filepath, &pack))
+    {
+        Print("Error: Failed to read from file %s", filepath);
+        return false;
+    }
+
+    const AssetPackHeader* header = static_cast<const AssetPackHeader*>(pack.m_Data);
+    if (pack.m_Size < sizeof(AssetPackHeader) ||
+        header->m_Magic != ASSET_PACK_MAGIC ||
+        header->m_Version != ASSET_PACK_VERSION ||
+        pack.m_Size < sizeof(AssetPackHeader) + sizeof(AssetPackEntry) * header->m_EntryCount)
+    {
+        Print("Error: %s is not a valid asset pack", filepath);
+        UnmapFile(&pack);
+        return false;
+    }
+    // Packed blobs are used without a header check, so a pack of blobs in another layout is turned down as a whole
+    if (header->m_BlobVersion != BLOB_VERSION)
+    {
+        Print("Error: %s holds blobs of version %u, this version loads %u", filepath, header->m_BlobVersion, BLOB_VERSION);
+        UnmapFile(&pack);
+        return false;
+    }
+
+    // Packed blobs skip the flag checks of loose blobs too, so a pack with blobs the device can't load is turned down
+    // here rather than failing once a BCn texture is created on a device without BC support
+    const uint32_t loadable_flags = GetTextureBlobFlags(device) | BLOB_FLAG_COMPRESSED;
+    const AssetPackEntry* entries = reinterpret_cast<const AssetPackEntry*>(header + 1);
+    for (uint32_t i = 0; i < header->m_EntryCount; ++i)
+    {
+        if ((entries[i].m_Flags & ~loadable_flags) != 0)
+        {
+            Print("Error: %s holds blobs cooked with flags 0x%x, which this device can't load", filepath, entries[i].m_Flags);
+            UnmapFile(&pack);
+            return false;
+        }
+    }
+
+    device->m_AssetPacks.Push(pack);
+    Print("Mounted %s", filepath);
+    return true;
+}
+void UnmountAssetPacks(GfxDevice device)
+{
+    for (uint32_t i = 0; i < device->m_AssetPacks.Count(); ++i)
+        UnmapFile(&device->m_AssetPacks[i]);
+    device->m_AssetPacks.Clear();
+}
+bool ResolvePackedFile(GfxDevice device, FileRead* read)
+{
+    if (read->m_Mode || device->m_AssetPacks.Count() == 0)
+        return false;
+
+    const uint64_t hash = HashAssetPath(read->m_Path);
+    for (uint32_t i = 0; i < device->m_AssetPacks.Count(); ++i)
+    {
+        const MappedFile& pack = device->m_AssetPacks[i];
+        const AssetPackHeader* header = static_cast<const AssetPackHeader*>(pack.m_Data);
+        const AssetPackEntry* entries = reinterpret_cast<const AssetPackEntry*>(header + 1);
+
+        uint32_t first = 0;
+        uint32_t last = header->m_EntryCount;
+        while (first < last)
+        {
+            const uint32_t middle = (first + last) / 2;
+            if (entries[middle].m_Hash < hash)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        if (first == header->m_EntryCount || entries[first].m_Hash != hash)
+            continue;
+
+        const AssetPackEntry& entry = entries[first];
+        if (entry.m_Offset + entry.m_Size > pack.m_Size)
+            continue;
+
+        read->m_MappedFile = MappedFile();
+        read->m_MappedFile.m_Data = static_cast<const uint8_t*>(pack.m_Data) + entry.m_Offset;
+        read->m_MappedFile.m_Size = static_cast<size_t>(entry.m_Size);
+        read->m_Packed = true;
+        read->m_Loaded = true;
+        return true;
+    }
+    return false;
+}
+
+bool GfxCreateAssetPack(const char* filepath, const char* const* source_filepaths, uint32_t source_filepath_count)
+{
+    Array<String> blob_filepaths;
+    Array<AssetPackEntry> entries;
+    for (uint32_t i = 0; i < source_filepath_count; ++i)
+    {
+        String blob_filepath = GetBlobFilepath(source_filepaths[i]);
+
+        FileStamp blob_stamp;
+        if (!GetFileStamp(blob_filepath.Data(), &blob_stamp))
+        {
+            Print("Error: Failed to read from file %s, load %s once to cook it", blob_filepath.Data(), source_filepaths[i]);
+            return false;
+        }
+
+        BlobHeader blob_header;
+        if (!ReadBlobHeader(blob_filepath.Data(), &blob_header))
+        {
+            Print("Error: Failed to read from file %s", blob_filepath.Data());
+            return false;
+        }
+        if (blob_header.m_Version != BLOB_VERSION)
+        {
+            Print("Error: %s was cooked by another version, load %s once to cook it again", blob_filepath.Data(), source_filepaths[i]);
+            return false;
+        }
+
+        AssetPackEntry entry = {};
+        entry.m_Hash = HashAssetPath(blob_filepath.Data());
+        entry.m_Size = blob_stamp.m_Size;
+        entry.m_Flags = blob_header.m_Flags;
+        entry.m_Offset = blob_filepaths.Count(); // Index into blob_filepaths until the entries are sorted
+        blob_filepaths.Push(blob_filepath);
+        entries.Push(entry);
+    }
+    qsort(entries.Data(), entries.Count(), sizeof(AssetPackEntry), CompareAssetPackEntries);
+
+    Array<uint32_t> blob_indices(entries.Count());
+    uint64_t offset = (sizeof(AssetPackHeader) + sizeof(AssetPackEntry) * entries.Count() + ASSET_PACK_ALIGNMENT - 1) & ~static_cast<uint64_t>(ASSET_PACK_ALIGNMENT - 1);
+    for (uint32_t i = 0; i < entries.Count(); ++i)
+    {
+        if (i > 0 && entries[i].m_Hash == entries[i - 1].m_Hash)
+        {
+            Print("Error: %s and %s have the same hash", blob_filepaths[static_cast<uint32_t>(entries[i].m_Offset)].Data(), blob_filepaths[blob_indices[i - 1]].Data());
+            return false;
+        }
+        blob_indices[i] = static_cast<uint32_t>(entries[i].m_Offset);
+        entries[i].m_Offset = offset;
+        offset = (offset + entries[i].m_Size + ASSET_PACK_ALIGNMENT - 1) & ~static_cast<uint64_t>(ASSET_PACK_ALIGNMENT - 1);
+    }
+
+    AssetPackHeader header = {};
+    header.m_Magic = ASSET_PACK_MAGIC;
+    header.m_Version = ASSET_PACK_VERSION;
+    header.m_EntryCount = entries.Count();
+    header.m_BlobVersion = BLOB_VERSION;
+
+    // WriteFile creates the directories, the payloads are then appended one blob at a time
+    const size_t table_size = sizeof(AssetPackHeader) + sizeof(AssetPackEntry) * entries.Count();
+    Array<uint8_t> table(static_cast<uint32_t>(entries.Count() > 0 ? entries[0].m_Offset : table_size));
+    memset(table.Data(), 0, table.Count());
+    memcpy(table.Data(), &header, sizeof(AssetPackHeader));
+    memcpy(table.Data() + sizeof(AssetPackHeader), entries.Data(), sizeof(AssetPackEntry) * entries.Count());
+    if (!WriteFile(filepath, "wb", table.Data(), table.Count()))
+    {
+        Print("Error: Failed to write to file %s", filepath);
+        return false;
+    }
+
+    FILE* file = fopen(filepath, "ab");
+    if (file == NULL)
+    {
+        Print("Error: Failed to write to file %s", filepath);
+        return false;
+    }
+    static const uint8_t padding[ASSET_PACK_ALIGNMENT] = {};
+    bool written = true;
+    for (uint32_t i = 0; i < entries.Count() && written; ++i)
+    {
+        MappedFile blob;
+        if (!MapFile(blob_filepaths[blob_indices[i]].Data(), &blob) || blob.m_Size != entries[i].m_Size)
+        {
+            Print("Error: Failed to read from file %s", blob_filepaths[blob_indices[i]].Data());
+            UnmapFile(&blob);
+            written = false;
+            break;
+        }
+        written = fwrite(blob.m_Data, 1, blob.m_Size, file) == blob.m_Size;
+        UnmapFile(&blob);
+
+        const uint64_t end = i + 1 < entries.Count() ? entries[i + 1].m_Offset : entries[i].m_Offset + entries[i].m_Size;
+        const size_t padding_size = static_cast<size_t>(end - entries[i].m_Offset - entries[i].m_Size);
+        written = written && fwrite(padding, 1, padding_size, file) == padding_size;
+    }
+    fclose(file);
+
+    if (!written)
+    {
+        Print("Error: Failed to write to file %s", filepath);
+        return false;
+    }
+    Print("Packed %u blobs into %s", entries.Count(), filepath);
+    return true;
+}
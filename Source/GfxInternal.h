@@ -16,13 +16,19 @@
 #include "GfxUtil.h"
 #include "GfxConversion.h"
 
+#define GFX_MAX_MIP_COUNT 16
+
 typedef void(*GfxCmdFunction)(VkCommandBuffer, void*);
 
+struct FileQueue;
+struct ModelTextureStreaming;
+
 struct GfxBuffer_T
 {
     VkBuffer						    m_Buffer;
     VmaAllocation					    m_Allocation;
     VkDeviceSize					    m_Size;
+    VkDeviceSize                        m_AllocationSize;   // Counted against the memory budget, 0 in host memory
 };
 
 struct GfxTexture_T
@@ -34,6 +40,9 @@ struct GfxTexture_T
     uint32_t						    m_Height;
     uint32_t                            m_Depth;
     VkFormat						    m_Format;
+    VkDeviceSize                        m_AllocationSize;   // Counted against the memory budget
+    uint32_t                            m_RefCount;         // GfxDestroyTexture only destroys the last reference
+    uint64_t                            m_PathHash;         // HashAssetPath of the file it was loaded from when cached, otherwise 0
 };
 
 struct GfxCommandBuffer_T
@@ -49,6 +58,10 @@ struct GfxCommandBuffer_T
     GfxTechnique                        m_Technique;
     GfxRenderSetup                      m_RenderSetup;
 
+    GfxBuffer                           m_IndexBuffer;          // Last bound index buffer, to skip redundant binds
+    uint64_t                            m_IndexBufferOffset;
+    uint32_t                            m_IndexBufferStride;
+
     VkDescriptorPool				    m_DescriptorPool;
     Array<VkWriteDescriptorSet>         m_DescriptorWrites;
     Array<VkDescriptorBufferInfo>       m_DescriptorBufferInfo;
@@ -63,6 +76,13 @@ struct GfxDevice_T
 	VkSurfaceKHR					    m_Surface;
 
 	VkPhysicalDevice				    m_PhysicalDevice;
+    VkPhysicalDeviceProperties          m_PhysicalDeviceProperties;
+    uint32_t                            m_ApiVersion;
+    GfxDeviceCaps                       m_Caps;
+
+    PFN_vkCmdDrawIndirectCountKHR       m_CmdDrawIndirectCount;
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_CmdDrawIndexedIndirectCount;
+    PFN_vkGetPhysicalDeviceMemoryProperties2 m_GetPhysicalDeviceMemoryProperties2;
 	VkDevice						    m_Device;
 
 	VkQueue							    m_GraphicsQueue;
@@ -98,9 +118,29 @@ struct GfxDevice_T
         GfxTechnique                    m_Technique;
         String                          m_Filepath;
         uint64_t                        m_Checksum;
+        FileStamp                       m_SourceStamp;
     };
     HashTable<TechniqueEntry>           m_TechniqueEntries;
 
+    GfxTechnique                        m_CullModelTechnique;
+    GfxTechnique                        m_CullModelMeshletsTechnique;
+
+    FileQueue*                          m_FileQueue;
+    GfxTexture                          m_DefaultTexture;       // White, bound in place of NULL textures
+    GfxBuffer                           m_DefaultFeedback;      // Feedback buffer of models that do not stream
+    Array<MappedFile>                   m_AssetPacks;
+    bool                                m_CompressBlobs;
+    bool                                m_StreamModelTextures;
+
+    uint64_t                            m_FrameIndex;           // Frames begun so far
+    uint64_t                            m_MemoryCap;            // GfxCreateDeviceParams::m_MemoryBudget or the device local heap size
+    VkDeviceSize                        m_AllocatedMemory;      // Device local memory of Gfx buffers and textures
+    GfxMemoryBudget                     m_MemoryBudget;
+    Array<GfxTexture>                   m_CachedTextures;       // Textures loaded whole from a file, see AcquireCachedTexture
+    Array<GfxModel>                     m_StreamingModels;      // Models whose textures may be evicted to stay within budget
+    int64_t                             m_StreamingHeadroom;    // Bytes streamed textures may still grow by this frame
+    uint64_t                            m_StreamingBudgetFrame; // Frame the headroom was worked out in
+
 #ifdef _DEBUG
 	VkDebugReportCallbackEXT		    m_DebugCallback;
 #endif
@@ -119,7 +159,17 @@ struct GfxTechniqueBlob_T
     {
         uint64_t					    m_Hash                          = 0;
         VkDescriptorType			    m_Type                          = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+        uint32_t                        m_Count                         = 1;
+        uint64_t                        m_CountHash                     = 0; // Specialization constant giving m_Count, if any
     } m_ShaderBindings[16];
+    struct SpecializationConstant
+    {
+        uint64_t                        m_Hash                          = 0;
+        uint32_t                        m_Value                         = 0; // Constant id is the array index
+    };
+    uint32_t                            m_SpecializationConstantCount   = 0;
+    SpecializationConstant              m_SpecializationConstants[16];
+    VkSubgroupFeatureFlags              m_SubgroupFeatures              = 0;
 };
 struct GfxGraphicsTechniqueBlob_T : public GfxTechniqueBlob_T
 {
@@ -189,13 +239,25 @@ struct GfxTechnique_T
     {
         uint32_t                        m_Binding;
         VkDescriptorType                m_Type;
+        uint32_t                        m_Count;
+        uint32_t                        m_ImageInfoOffset;
+        bool                            m_Truncated;    // Binding more textures than m_Count has been reported
     };
     HashTable<ShaderBinding>	        m_ShaderBindings;
     uint32_t                            m_ShaderBindingCount;
+    uint32_t                            m_DescriptorImageInfoCount;
+
+    uint32_t                            m_WorkGroupSize[3];
+
+    Blob                                m_Blob;
+    Array<GfxSpecializationConstant>    m_SpecializationConstants;
 
 #ifdef _DEBUG
     GfxRenderSetup                      m_RenderSetupHead;
     GfxRenderSetup                      m_RenderSetupTail;
+
+    GfxTechnique                        m_Base;
+    Array<GfxTechnique>                 m_Variants;
 #endif
 
     GfxTechnique_T()
@@ -219,15 +281,60 @@ struct GfxRenderSetup_T
 
 struct GfxModel_T
 {
+    struct Lod
+    {
+        uint32_t                        m_IndexOffset;
+        uint32_t                        m_IndexCount;
+        float                           m_Error;            // Largest distance from the full detail mesh in model space
+    };
     struct Mesh
     {
         uint32_t                        m_MaterialIndex;
         uint32_t                        m_VertexOffset;
         uint32_t                        m_VertexCount;
-        uint32_t                        m_IndexOffset;
+        uint32_t                        m_IndexOffset;      // In indices from the start of the index buffer region of m_IndexSize
         uint32_t                        m_IndexCount;
+        uint32_t                        m_IndexSize;        // 2 when every vertex index fits in 16 bits, otherwise 4
+        uint32_t                        m_LodCount;         // LOD 0 is the full detail mesh, all LODs share its vertices
+        Lod                             m_Lods[GFX_MODEL_MAX_LOD_COUNT];
+        uint32_t                        m_MeshletOffset;
+        uint32_t                        m_MeshletCount;
     };
     Array<Mesh>                         m_Meshes;
+    uint32_t                            m_Mesh16Count;      // Meshes with 16-bit indices come first
+
+    // Contiguous triangle ranges of a mesh, laid out as three uvec4 for the meshlet culling shader
+    struct Meshlet
+    {
+        float                           m_Center[3];
+        float                           m_Radius;
+        float                           m_ConeAxis[3];
+        float                           m_ConeCutoff;       // 1 when the triangles face too many directions to be back face culled
+        uint32_t                        m_MeshIndex;
+        uint32_t                        m_IndexOffset;
+        uint32_t                        m_IndexCount;
+        uint32_t                        m_VertexOffset;
+    };
+    Array<Meshlet>                      m_Meshlets;
+    uint32_t                            m_Meshlet16Count;
+
+    // Per mesh bounds as structure of arrays, each stream padded to a multiple of 8 meshes for SIMD culling
+    enum MeshBoundsStream
+    {
+        MESH_BOUNDS_MIN_X,
+        MESH_BOUNDS_MIN_Y,
+        MESH_BOUNDS_MIN_Z,
+        MESH_BOUNDS_MAX_X,
+        MESH_BOUNDS_MAX_Y,
+        MESH_BOUNDS_MAX_Z,
+        MESH_BOUNDS_SPHERE_X,
+        MESH_BOUNDS_SPHERE_Y,
+        MESH_BOUNDS_SPHERE_Z,
+        MESH_BOUNDS_SPHERE_RADIUS,
+        MESH_BOUNDS_STREAM_COUNT,
+    };
+    Array<float>                        m_MeshBounds;
+    uint32_t                            m_MeshBoundsStride;
 
     struct Material
     {
@@ -236,10 +343,20 @@ struct GfxModel_T
     Array<Material>                     m_Materials;
     Array<GfxTexture>                   m_Textures;
 
+    // One host visible buffer per frame in flight with a uint per texture, see GfxCmdSetModelTextureFeedback
+    Array<GfxBuffer>                    m_FeedbackBuffers;
+    Array<uint32_t*>                    m_FeedbackData;
+    ModelTextureStreaming*              m_TextureStreaming; // NULL unless the device streams model textures
+
     GfxBuffer                           m_VertexBuffer;
     GfxBuffer                           m_IndexBuffer;
+    GfxBuffer                           m_IndirectBuffer;   // One GfxDrawIndexedIndirectCommand per mesh
+    GfxBuffer                           m_DrawDataBuffer;   // One GfxModelDrawData per mesh
+    GfxBuffer                           m_MeshBoundsBuffer; // Bounding box min and max per mesh as two float4
+    GfxBuffer                           m_MeshletBuffer;    // One Meshlet per meshlet
 
     VkDeviceSize                        m_VertexBufferOffsets[GFX_MODEL_VERTEX_ATTRIBUTE_COUNT];
+    VkDeviceSize                        m_IndexBuffer32Offset;  // 16-bit indices are stored first, then 32-bit indices
 
     float                               m_BoundingBoxMin[3];
     float                               m_BoundingBoxMax[3];
@@ -247,4 +364,122 @@ struct GfxModel_T
     float                               m_QuantizationScale;
 };
 
+// Creates a technique from JSON embedded in the library, the blob is cached in Data/Builtin
+GfxTechnique CreateBuiltinTechnique(GfxDevice device, const char* name, const char* json);
+
+// Records into a standalone command buffer that is submitted and waited for on end
+GfxCommandBuffer BeginImmediateCommandBuffer(GfxDevice device);
+void EndImmediateCommandBuffer(GfxDevice device, GfxCommandBuffer cmd);
+
+// Reads files on a pool of worker threads. Every read of a batch is started at once and WaitFileBatch hands them back
+// one at a time in completion order, returning NULL once all have been handed back. Paths must outlive the batch.
+struct FileBatch;
+struct FileRead
+{
+    const char*                         m_Path              = NULL;
+    const char*                         m_Mode              = NULL;     // NULL maps the file, otherwise it is read with ReadFile in this mode
+    bool                                m_Loaded            = false;
+    void*                               m_Data              = NULL;     // ReadFile result
+    size_t                              m_Size              = 0;
+    MappedFile                          m_MappedFile;                   // MapFile result
+    bool                                m_Packed            = false;    // m_MappedFile points into a mounted asset pack
+    uint64_t                            m_PrefetchOffset    = 0;        // Range of the mapping the worker faults in
+    uint64_t                            m_PrefetchSize      = 0;
+    void                                (*m_Process)(void* data) = NULL;  // Run by the worker once the file is loaded
+    void*                               m_ProcessData       = NULL;
+    FileBatch*                          m_Batch             = NULL;
+};
+struct FileBatch
+{
+    Array<FileRead*>                    m_Completed;
+    uint32_t                            m_SubmittedCount    = 0;
+    uint32_t                            m_ReturnedCount     = 0;
+};
+FileQueue* CreateFileQueue();
+void DestroyFileQueue(FileQueue* queue);
+void SubmitFileBatch(FileQueue* queue, FileBatch* batch, FileRead* reads, uint32_t read_count);
+FileRead* WaitFileBatch(FileQueue* queue, FileBatch* batch);
+// Like WaitFileBatch but returns NULL straight away when no read has completed since the last call
+FileRead* PollFileBatch(FileQueue* queue, FileBatch* batch);
+void ReleaseFileRead(FileRead* read);
+
+// Completes a mapping read straight away when the file is found in a mounted asset pack
+bool ResolvePackedFile(GfxDevice device, FileRead* read);
+// Normalises the slashes of a path and hashes it
+uint64_t HashAssetPath(const char* path);
+void UnmountAssetPacks(GfxDevice device);
+
+// Texture blobs hold every mip as its own section, found through a table of offsets from the start of the blob
+struct TextureBlobInfo
+{
+    uint32_t                            m_Width;
+    uint32_t                            m_Height;
+    GfxFormat                           m_Format;
+    uint32_t                            m_MipCount;
+    uint64_t                            m_Checksum;         // Of the source image, tells a blob cooked again apart
+    uint64_t                            m_BlobSize;
+    uint64_t                            m_MipOffsets[GFX_MAX_MIP_COUNT];
+};
+bool ReadTextureBlobInfo(const void* blob_data, size_t blob_size, TextureBlobInfo* out_info);
+// First mip no larger than max_size texels on either side, the last mip when every mip is larger
+uint32_t GetTextureBlobTailMip(const TextureBlobInfo& info, uint32_t max_size);
+// Creates a texture holding mip first_mip and every smaller mip of the blob
+GfxTexture CreateTextureFromBlob(GfxDevice device, const void* blob_data, const TextureBlobInfo& info, uint32_t first_mip);
+
+// A texture loaded from its source image (mode "rb") and mapped Data blob, either read may have failed. The image read
+// may also be skipped when the blob stamp matches m_ImageStamp. Once the reads are done CookTextureLoad cooks a new
+// blob when the one read is missing or stale, it only touches the load so it may run on a file worker. thread_count
+// is passed on to CookTexture.
+struct TextureLoad
+{
+    GfxDevice                           m_Device            = NULL;
+    const char*                         m_Filepath          = NULL;
+    const char*                         m_BlobFilepath      = NULL;
+    FileStamp                           m_ImageStamp;
+    FileRead                            m_ImageRead;
+    FileRead                            m_BlobRead;
+    Blob                                m_CookedBlob;
+    bool                                m_Cooked            = false;    // m_CookedBlob is used in place of the blob read
+};
+void CookTextureLoad(TextureLoad* load, uint32_t thread_count);
+// A non-zero tail_size only creates the mips of at most tail_size texels, out_info receives what is needed to create
+// the rest later on
+GfxTexture CreateTextureFromLoad(TextureLoad* load, uint32_t tail_size = 0, TextureBlobInfo* out_info = NULL);
+void ReleaseTextureLoad(TextureLoad* load);
+
+// Textures loaded whole from a file are shared, keyed by HashAssetPath of the file. AcquireCachedTexture returns NULL
+// or the texture with another reference, which GfxDestroyTexture drops.
+GfxTexture AcquireCachedTexture(GfxDevice device, const char* filepath);
+void AddCachedTexture(GfxDevice device, const char* filepath, GfxTexture texture);
+
+// Like GfxCreateBuffer and GfxCreateTexture, with the initial data decoded from blob sections into staging memory
+GfxBuffer CreateBufferFromSections(GfxDevice device, const GfxCreateBufferParams& params, const StreamSection* sections, uint32_t section_count);
+GfxTexture CreateTextureFromSections(GfxDevice device, const GfxCreateTextureParams& params, const StreamSection* sections, uint32_t section_count);
+
+// Persistently mapped buffer in host coherent memory for the GPU to write and the host to read back
+GfxBuffer CreateReadbackBuffer(GfxDevice device, const GfxCreateBufferParams& params, void** out_data);
+
+// Flags that blobs cooked by this device are written with, blobs with other flags are cooked again. Model blobs hold
+// no pixels, so block compression support only matters to texture blobs.
+inline uint32_t GetModelBlobFlags(GfxDevice device)
+{
+    return device->m_CompressBlobs ? BLOB_FLAG_COMPRESSED : 0;
+}
+inline uint32_t GetTextureBlobFlags(GfxDevice device)
+{
+    return
+        GetModelBlobFlags(device) |
+        (device->m_Caps.m_TextureCompressionBC ? BLOB_FLAG_BCN : 0) |
+        BLOB_FLAG_MIP_SECTIONS;
+}
+
+// Texture cooking. The format is picked from the filename and the pixels: BC5 for normal maps, BC3 when any texel
+// has alpha and BC1 otherwise, or RGBA8 without block compression. CookTexture writes every mip after another,
+// filtering color as sRGB and normal maps as unit vectors. Textures found to be alpha tested keep the coverage of
+// their first mip at MIP_ALPHA_CUTOFF in the others. Block compression is spread over at most thread_count
+// threads, 0 for every core. File workers pass 1 since the other workers already keep the cores busy.
+GfxFormat ChooseTextureFormat(const char* filepath, const uint8_t* pixels, uint32_t width, uint32_t height, bool block_compression, bool* out_normal_map, bool* out_alpha_tested);
+size_t GetTextureDataSize(GfxFormat format, uint32_t width, uint32_t height, uint32_t mip_count);
+void CookTexture(GfxFormat format, bool normal_map, bool alpha_tested, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t mip_count, void* out_data, uint32_t thread_count);
+
 #endif
@@ -6,8 +6,1005 @@
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
 
-static Blob CreateModelBlob(const void* data, size_t size, const char* material_dir)
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MESHLET_MAX_VERTEX_COUNT    64
+#define MESHLET_MAX_TRIANGLE_COUNT  124
+#define VERTEX_CACHE_SIZE           16
+
+#define TEXTURE_STREAMING_TAIL_SIZE 64  // Largest mips GfxLoadModel creates when textures stream
+#define TEXTURE_STREAMING_MAX_READS 4   // Blob reads in flight per model
+
+struct ModelTextureStreaming
+{
+    struct Texture
+    {
+        String                          m_BlobFilepath;
+        TextureBlobInfo                 m_Info;
+        uint32_t                        m_ResidentMip;      // First mip of the texture in GfxModel_T::m_Textures
+        uint32_t                        m_RequestedMip;     // Finest mip the feedback asked for so far
+        uint32_t                        m_ReadMip;          // First mip of the texture created once the read completes
+        uint32_t                        m_TailMip;          // First mip GfxLoadModel created, evicted textures go back to it
+        uint64_t                        m_LastSampledFrame; // Frame the feedback last held a sample of the texture
+        bool                            m_Reading;
+        bool                            m_Failed;           // Keeps the mips it has when its blob can not be read again
+        GfxTexture                      m_PendingTexture;   // Replaces the resident texture on the next update
+    };
+    Array<Texture>                      m_Textures;
+    Array<FileRead>                     m_Reads;            // One per texture
+    uint32_t                            m_ReadCount;
+    FileBatch                           m_Batch;
+
+    struct RetiredTexture
+    {
+        GfxTexture                      m_Texture;
+        uint32_t                        m_UpdateCount;      // Updates left until no frame in flight samples it
+    };
+    Array<RetiredTexture>               m_RetiredTextures;
+};
+
+static const char* s_CullModelTechnique = R"(
+{
+    shader_bindings:
+    [
+        {
+            name: "Constants",
+            type: "cbuffer",
+            content:
+            "
+                vec4    Planes[6];
+                uint    MeshCount;
+                uint    Mesh16Count;
+                uint    InstanceCount;
+                uint    Compact;
+            "
+        },
+        { name: "MeshBounds",   type: "buffer", content: "vec4 MeshBoundsData[];"   },
+        { name: "MeshCommands", type: "buffer", content: "uint MeshCommandData[];"  },
+        { name: "Instances",    type: "buffer", content: "mat4 InstanceData[];"     },
+        { name: "OutCommands",  type: "buffer", content: "uint OutCommandData[];"   },
+        { name: "OutCount",     type: "buffer", content: "uint OutCountData[2];"    }
+    ],
+
+    compute_shader:
+    {
+        work_group_size: { x: 64, y: 1, z: 1 },
+        main:
+        "
+            uint index = gl_GlobalInvocationID.x;
+            if (index >= MeshCount * InstanceCount)
+                return;
+
+            uint mesh = index / InstanceCount;
+            uint instance = index % InstanceCount;
+
+            vec3 bounds_min = MeshBoundsData[mesh * 2 + 0].xyz;
+            vec3 bounds_max = MeshBoundsData[mesh * 2 + 1].xyz;
+            mat4 world = InstanceData[instance];
+
+            vec3 center = (world * vec4((bounds_min + bounds_max) * 0.5, 1.0)).xyz;
+            vec3 half_extent = (bounds_max - bounds_min) * 0.5;
+            vec3 extent =
+                abs(world[0].xyz) * half_extent.x +
+                abs(world[1].xyz) * half_extent.y +
+                abs(world[2].xyz) * half_extent.z;
+
+            bool visible = true;
+            for (uint i = 0; i < 6; ++i)
+                visible = visible && dot(Planes[i].xyz, center) + dot(abs(Planes[i].xyz), extent) + Planes[i].w >= 0.0;
+
+            // Without a count buffer every slot is written and culled draws get zero instances.
+            // Draws of meshes with 16 and 32-bit indices are counted separately since they bind different index buffers.
+            uint slot = index;
+            if (Compact != 0)
+            {
+                if (!visible)
+                    return;
+                uint index_type = mesh < Mesh16Count ? 0 : 1;
+                slot = index_type * Mesh16Count * InstanceCount + atomicAdd(OutCountData[index_type], 1u);
+            }
+
+            OutCommandData[slot * 5 + 0] = MeshCommandData[mesh * 5 + 0];
+            OutCommandData[slot * 5 + 1] = visible ? 1u : 0u;
+            OutCommandData[slot * 5 + 2] = MeshCommandData[mesh * 5 + 2];
+            OutCommandData[slot * 5 + 3] = MeshCommandData[mesh * 5 + 3];
+            OutCommandData[slot * 5 + 4] = index;
+        "
+    }
+}
+)";
+
+static const char* s_CullModelMeshletsTechnique = R"(
+{
+    shader_bindings:
+    [
+        {
+            name: "Constants",
+            type: "cbuffer",
+            content:
+            "
+                mat4    World;
+                vec4    Planes[6];
+                vec4    CameraPosition;
+                uint    MeshletCount;
+                uint    Meshlet16Count;
+                uint    Compact;
+            "
+        },
+        { name: "Meshlets",     type: "buffer", content: "uvec4 MeshletData[];"     },
+        { name: "OutCommands",  type: "buffer", content: "uint OutCommandData[];"   },
+        { name: "OutCount",     type: "buffer", content: "uint OutCountData[2];"    }
+    ],
+
+    compute_shader:
+    {
+        work_group_size: { x: 64, y: 1, z: 1 },
+        main:
+        "
+            uint index = gl_GlobalInvocationID.x;
+            if (index >= MeshletCount)
+                return;
+
+            vec4 sphere = uintBitsToFloat(MeshletData[index * 3 + 0]);
+            vec4 cone = uintBitsToFloat(MeshletData[index * 3 + 1]);
+            uvec4 range = MeshletData[index * 3 + 2];
+
+            vec3 center = (World * vec4(sphere.xyz, 1.0)).xyz;
+            float radius = sphere.w * max(max(length(World[0].xyz), length(World[1].xyz)), length(World[2].xyz));
+            vec3 axis = normalize(mat3(World) * cone.xyz);
+
+            bool visible = true;
+            for (uint i = 0; i < 6; ++i)
+                visible = visible && dot(Planes[i].xyz, center) + Planes[i].w >= -radius;
+
+            // Every triangle faces away when the camera is inside the cone behind the meshlet
+            vec3 view = center - CameraPosition.xyz;
+            visible = visible && dot(view, axis) < cone.w * length(view) + radius;
+
+            uint slot = index;
+            if (Compact != 0)
+            {
+                if (!visible)
+                    return;
+                uint index_type = index < Meshlet16Count ? 0 : 1;
+                slot = index_type * Meshlet16Count + atomicAdd(OutCountData[index_type], 1u);
+            }
+
+            OutCommandData[slot * 5 + 0] = range.z;
+            OutCommandData[slot * 5 + 1] = visible ? 1u : 0u;
+            OutCommandData[slot * 5 + 2] = range.y;
+            OutCommandData[slot * 5 + 3] = range.w;
+            OutCommandData[slot * 5 + 4] = range.x;
+        "
+    }
+}
+)";
+
+// Planes are extracted from the rows of the column major matrix, conservative for both depth ranges.
+// They are normalized so sphere radii can be compared against the plane distance.
+static void ExtractFrustumPlanes(const float view_proj[16], float out_planes[6][4])
+{
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        const uint32_t row = i / 2;
+        const float sign = (i & 1) ? -1.0f : 1.0f;
+        for (uint32_t j = 0; j < 4; ++j)
+            out_planes[i][j] = view_proj[j * 4 + 3] + sign * view_proj[j * 4 + row];
+
+        const float length = sqrtf(out_planes[i][0] * out_planes[i][0] + out_planes[i][1] * out_planes[i][1] + out_planes[i][2] * out_planes[i][2]);
+        if (length > 0.0f)
+        {
+            for (uint32_t j = 0; j < 4; ++j)
+                out_planes[i][j] /= length;
+        }
+    }
+}
+
+// Returns the number of vertex shader invocations with a FIFO post-transform cache
+static uint32_t SimulateVertexCache(const uint32_t* indices, uint32_t index_count, uint32_t vertex_count)
+{
+    Array<uint32_t> cache_times(vertex_count);
+    memset(cache_times.Data(), 0, sizeof(uint32_t) * vertex_count);
+
+    uint32_t time = VERTEX_CACHE_SIZE + 1;
+    uint32_t miss_count = 0;
+    for (uint32_t i = 0; i < index_count; ++i)
+    {
+        if (time - cache_times[indices[i]] > VERTEX_CACHE_SIZE)
+        {
+            cache_times[indices[i]] = time++;
+            ++miss_count;
+        }
+    }
+    return miss_count;
+}
+
+// Tipsify (Sander et al. 2007), the returned triangle offsets are where it ran out of neighbours and had to jump
+static void OptimizeVertexCache(uint32_t* indices, uint32_t index_count, uint32_t vertex_count, Array<uint32_t>& out_cluster_offsets)
+{
+    const uint32_t triangle_count = index_count / 3;
+
+    Array<uint32_t> live_counts(vertex_count);
+    Array<uint32_t> adjacency_offsets(vertex_count + 1);
+    Array<uint32_t> adjacency(index_count);
+    memset(live_counts.Data(), 0, sizeof(uint32_t) * vertex_count);
+    for (uint32_t i = 0; i < index_count; ++i)
+        ++live_counts[indices[i]];
+    adjacency_offsets[0] = 0;
+    for (uint32_t i = 0; i < vertex_count; ++i)
+        adjacency_offsets[i + 1] = adjacency_offsets[i] + live_counts[i];
+    for (uint32_t i = 0; i < index_count; ++i)
+        adjacency[adjacency_offsets[indices[i]]++] = i / 3;
+    for (uint32_t i = vertex_count; i > 0; --i)
+        adjacency_offsets[i] = adjacency_offsets[i - 1];
+    adjacency_offsets[0] = 0;
+
+    Array<uint32_t> cache_times(vertex_count);
+    Array<uint8_t> emitted(triangle_count);
+    memset(cache_times.Data(), 0, sizeof(uint32_t) * vertex_count);
+    memset(emitted.Data(), 0, triangle_count);
+
+    Array<uint32_t> dead_ends(index_count);
+    Array<uint32_t> candidates(index_count);
+    Array<uint32_t> optimized(index_count);
+    uint32_t dead_end_count = 0;
+    uint32_t optimized_count = 0;
+    uint32_t time = VERTEX_CACHE_SIZE + 1;
+    uint32_t cursor = 0;
+
+    out_cluster_offsets.Clear();
+    out_cluster_offsets.Push(0);
+
+    uint32_t vertex = index_count > 0 ? indices[0] : ~0u;
+    while (vertex != ~0u)
+    {
+        uint32_t candidate_count = 0;
+        for (uint32_t i = adjacency_offsets[vertex]; i < adjacency_offsets[vertex + 1]; ++i)
+        {
+            const uint32_t triangle = adjacency[i];
+            if (emitted[triangle])
+                continue;
+            emitted[triangle] = 1;
+
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                const uint32_t v = indices[triangle * 3 + j];
+                optimized[optimized_count++] = v;
+                dead_ends[dead_end_count++] = v;
+                candidates[candidate_count++] = v;
+                --live_counts[v];
+                if (time - cache_times[v] > VERTEX_CACHE_SIZE)
+                    cache_times[v] = time++;
+            }
+        }
+
+        // Prefer the oldest vertex that stays in the cache while its remaining triangles are emitted
+        uint32_t next_vertex = ~0u;
+        int32_t next_priority = -1;
+        for (uint32_t i = 0; i < candidate_count; ++i)
+        {
+            const uint32_t v = candidates[i];
+            if (live_counts[v] == 0)
+                continue;
+            int32_t priority = 0;
+            if (time - cache_times[v] + 2 * live_counts[v] <= VERTEX_CACHE_SIZE)
+                priority = static_cast<int32_t>(time - cache_times[v]);
+            if (priority > next_priority)
+            {
+                next_vertex = v;
+                next_priority = priority;
+            }
+        }
+
+        if (next_vertex == ~0u)
+        {
+            while (dead_end_count > 0 && next_vertex == ~0u)
+            {
+                const uint32_t v = dead_ends[--dead_end_count];
+                if (live_counts[v] > 0)
+                    next_vertex = v;
+            }
+            while (cursor < vertex_count && next_vertex == ~0u)
+            {
+                if (live_counts[cursor] > 0)
+                    next_vertex = cursor;
+                ++cursor;
+            }
+            if (next_vertex != ~0u)
+                out_cluster_offsets.Push(optimized_count / 3);
+        }
+        vertex = next_vertex;
+    }
+
+    ASSERT(optimized_count == index_count);
+    memcpy(indices, optimized.Data(), sizeof(uint32_t) * index_count);
+}
+
+struct ClusterSortKey
+{
+    float       m_Key;
+    uint32_t    m_Cluster;
+};
+static int CompareClusterSortKeys(const void* a, const void* b)
+{
+    const ClusterSortKey* key_a = static_cast<const ClusterSortKey*>(a);
+    const ClusterSortKey* key_b = static_cast<const ClusterSortKey*>(b);
+    if (key_a->m_Key != key_b->m_Key)
+        return key_a->m_Key > key_b->m_Key ? -1 : 1;
+    return key_a->m_Cluster < key_b->m_Cluster ? -1 : (key_a->m_Cluster > key_b->m_Cluster ? 1 : 0);
+}
+
+// Draws the clusters facing away from the mesh center first, they are the most likely to occlude the rest
+static void OptimizeOverdraw(uint32_t* indices, uint32_t index_count, const glm::vec3* positions, const Array<uint32_t>& cluster_offsets)
+{
+    const uint32_t triangle_count = index_count / 3;
+    const uint32_t cluster_count = cluster_offsets.Count();
+    if (cluster_count < 2)
+        return;
+
+    glm::vec3 mesh_centroid = glm::vec3(0.0f);
+    float mesh_area = 0.0f;
+    Array<glm::vec3> cluster_centroids(cluster_count);
+    Array<glm::vec3> cluster_normals(cluster_count);
+    for (uint32_t i = 0; i < cluster_count; ++i)
+    {
+        const uint32_t triangle_end = i + 1 < cluster_count ? cluster_offsets[i + 1] : triangle_count;
+
+        glm::vec3 centroid = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        float area = 0.0f;
+        for (uint32_t j = cluster_offsets[i]; j < triangle_end; ++j)
+        {
+            const glm::vec3& pos_a = positions[indices[j * 3 + 0]];
+            const glm::vec3& pos_b = positions[indices[j * 3 + 1]];
+            const glm::vec3& pos_c = positions[indices[j * 3 + 2]];
+
+            const glm::vec3 cross = glm::cross(pos_b - pos_a, pos_c - pos_a);
+            const float triangle_area = glm::length(cross);
+            centroid += (pos_a + pos_b + pos_c) * (triangle_area / 3.0f);
+            normal += cross;
+            area += triangle_area;
+        }
+
+        mesh_centroid += centroid;
+        mesh_area += area;
+
+        cluster_centroids[i] = area > 0.0f ? centroid / area : centroid;
+        const float normal_length = glm::length(normal);
+        cluster_normals[i] = normal_length > 0.0f ? normal / normal_length : normal;
+    }
+    if (mesh_area > 0.0f)
+        mesh_centroid /= mesh_area;
+
+    Array<ClusterSortKey> sort_keys(cluster_count);
+    for (uint32_t i = 0; i < cluster_count; ++i)
+    {
+        sort_keys[i].m_Key = glm::dot(cluster_centroids[i] - mesh_centroid, cluster_normals[i]);
+        sort_keys[i].m_Cluster = i;
+    }
+    qsort(sort_keys.Data(), cluster_count, sizeof(ClusterSortKey), CompareClusterSortKeys);
+
+    Array<uint32_t> sorted(index_count);
+    uint32_t sorted_count = 0;
+    for (uint32_t i = 0; i < cluster_count; ++i)
+    {
+        const uint32_t cluster = sort_keys[i].m_Cluster;
+        const uint32_t triangle_end = cluster + 1 < cluster_count ? cluster_offsets[cluster + 1] : triangle_count;
+        const uint32_t size = (triangle_end - cluster_offsets[cluster]) * 3;
+        memcpy(&sorted[sorted_count], &indices[cluster_offsets[cluster] * 3], sizeof(uint32_t) * size);
+        sorted_count += size;
+    }
+    memcpy(indices, sorted.Data(), sizeof(uint32_t) * index_count);
+}
+
+// Renumbers the vertices in the order they are first used, unused vertices are moved to the end
+static void OptimizeVertexFetch(uint32_t* indices, uint32_t index_count, glm::vec3* positions, glm::vec2* texcoords, glm::vec3* normals, uint32_t vertex_count)
+{
+    Array<uint32_t> remap(vertex_count);
+    memset(remap.Data(), 0xff, sizeof(uint32_t) * vertex_count);
+
+    uint32_t next_vertex = 0;
+    for (uint32_t i = 0; i < index_count; ++i)
+    {
+        if (remap[indices[i]] == ~0u)
+            remap[indices[i]] = next_vertex++;
+        indices[i] = remap[indices[i]];
+    }
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        if (remap[i] == ~0u)
+            remap[i] = next_vertex++;
+    }
+
+    Array<glm::vec3> old_positions(vertex_count);
+    Array<glm::vec2> old_texcoords(vertex_count);
+    Array<glm::vec3> old_normals(vertex_count);
+    memcpy(old_positions.Data(), positions, sizeof(glm::vec3) * vertex_count);
+    memcpy(old_texcoords.Data(), texcoords, sizeof(glm::vec2) * vertex_count);
+    memcpy(old_normals.Data(), normals, sizeof(glm::vec3) * vertex_count);
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        positions[remap[i]] = old_positions[i];
+        texcoords[remap[i]] = old_texcoords[i];
+        normals[remap[i]] = old_normals[i];
+    }
+}
+
+// Tangents follow the texture coordinate derivatives, the sign of w tells if the bitangent is flipped
+static void ComputeTangents(const uint32_t* indices, uint32_t index_count, const glm::vec3* positions, const glm::vec2* texcoords, const glm::vec3* normals, uint32_t vertex_count, glm::vec4* out_tangents)
+{
+    Array<glm::vec3> tangents(vertex_count);
+    Array<glm::vec3> bitangents(vertex_count);
+    memset(tangents.Data(), 0, sizeof(glm::vec3) * vertex_count);
+    memset(bitangents.Data(), 0, sizeof(glm::vec3) * vertex_count);
+
+    for (uint32_t i = 0; i < index_count; i += 3)
+    {
+        const uint32_t index_a = indices[i + 0];
+        const uint32_t index_b = indices[i + 1];
+        const uint32_t index_c = indices[i + 2];
+
+        const glm::vec3 edge_b = positions[index_b] - positions[index_a];
+        const glm::vec3 edge_c = positions[index_c] - positions[index_a];
+        const glm::vec2 delta_b = texcoords[index_b] - texcoords[index_a];
+        const glm::vec2 delta_c = texcoords[index_c] - texcoords[index_a];
+
+        const float det = delta_b.x * delta_c.y - delta_c.x * delta_b.y;
+        if (fabsf(det) < 1e-20f)
+            continue;
+
+        const glm::vec3 tangent = (edge_b * delta_c.y - edge_c * delta_b.y) / det;
+        const glm::vec3 bitangent = (edge_c * delta_b.x - edge_b * delta_c.x) / det;
+        tangents[index_a] += tangent;
+        tangents[index_b] += tangent;
+        tangents[index_c] += tangent;
+        bitangents[index_a] += bitangent;
+        bitangents[index_b] += bitangent;
+        bitangents[index_c] += bitangent;
+    }
+
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        const glm::vec3& n = normals[i];
+        glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+        if (glm::dot(t, t) < 1e-20f)
+            t = glm::cross(n, fabsf(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+        t = glm::dot(t, t) > 0.0f ? glm::normalize(t) : glm::vec3(1.0f, 0.0f, 0.0f);
+        out_tangents[i] = glm::vec4(t, glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? -1.0f : 1.0f);
+    }
+}
+
+static int16_t QuantizeSnorm16(float value)
+{
+    return static_cast<int16_t>(roundf(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// Octahedral encoding maps the sphere onto the [-1, 1] square, giving two channels with even precision
+static glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+{
+    const float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f, 0.0f);
+
+    const glm::vec3 n = normal / sum;
+    if (n.z >= 0.0f)
+        return glm::vec2(n.x, n.y);
+    return glm::vec2(
+        (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+        (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+// QTangent, a quaternion rotating the x axis to the tangent and the z axis to the normal.
+// w is kept away from zero so its sign can hold the bitangent sign after quantization.
+static glm::quat EncodeTangentFrame(const glm::vec3& normal, const glm::vec4& tangent)
+{
+    const glm::vec3 n = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 t = glm::vec3(tangent) - n * glm::dot(n, glm::vec3(tangent));
+    if (glm::dot(t, t) < 1e-20f)
+        t = glm::cross(n, fabsf(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+    t = glm::normalize(t);
+
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, glm::cross(n, t), n)));
+    if (q.w < 0.0f)
+        q = -q;
+
+    const float bias = 1.0f / 32767.0f;
+    if (q.w < bias)
+    {
+        const float scale = sqrtf(1.0f - bias * bias);
+        q.x *= scale;
+        q.y *= scale;
+        q.z *= scale;
+        q.w = bias;
+    }
+    return tangent.w < 0.0f ? -q : q;
+}
+
+// Sum of squared distances to the planes of the triangles around a vertex, weighted by triangle area
+struct Quadric
+{
+    float   m_A2, m_AB, m_AC, m_AD, m_B2, m_BC, m_BD, m_C2, m_CD, m_D2;
+    float   m_Weight;
+};
+static void AddQuadric(Quadric& dst, const Quadric& src)
+{
+    dst.m_A2 += src.m_A2; dst.m_AB += src.m_AB; dst.m_AC += src.m_AC; dst.m_AD += src.m_AD; dst.m_B2 += src.m_B2;
+    dst.m_BC += src.m_BC; dst.m_BD += src.m_BD; dst.m_C2 += src.m_C2; dst.m_CD += src.m_CD; dst.m_D2 += src.m_D2;
+    dst.m_Weight += src.m_Weight;
+}
+static float EvaluateQuadric(const Quadric& q, const glm::vec3& p)
+{
+    const float value =
+        q.m_A2 * p.x * p.x + 2.0f * q.m_AB * p.x * p.y + 2.0f * q.m_AC * p.x * p.z + 2.0f * q.m_AD * p.x +
+        q.m_B2 * p.y * p.y + 2.0f * q.m_BC * p.y * p.z + 2.0f * q.m_BD * p.y +
+        q.m_C2 * p.z * p.z + 2.0f * q.m_CD * p.z + q.m_D2;
+    return q.m_Weight > 0.0f ? fabsf(value) / q.m_Weight : 0.0f;
+}
+
+struct Collapse
+{
+    uint32_t    m_From;
+    uint32_t    m_To;
+    float       m_Cost;
+};
+static int CompareCollapses(const void* a, const void* b)
+{
+    const Collapse* collapse_a = static_cast<const Collapse*>(a);
+    const Collapse* collapse_b = static_cast<const Collapse*>(b);
+    if (collapse_a->m_Cost != collapse_b->m_Cost)
+        return collapse_a->m_Cost < collapse_b->m_Cost ? -1 : 1;
+    if (collapse_a->m_From != collapse_b->m_From)
+        return collapse_a->m_From < collapse_b->m_From ? -1 : 1;
+    return collapse_a->m_To < collapse_b->m_To ? -1 : (collapse_a->m_To > collapse_b->m_To ? 1 : 0);
+}
+
+// Vertices sharing a position with another vertex lie on a UV or normal seam, and vertices on an open edge lie on
+// the mesh border where it meets other meshes or materials. Both are locked so the simplified mesh keeps its outline.
+static void FindLockedVertices(const uint32_t* indices, uint32_t index_count, const glm::vec3* positions, uint32_t vertex_count, Array<uint8_t>& out_locked)
+{
+    uint32_t table_size = 1;
+    while (table_size < vertex_count * 2)
+        table_size *= 2;
+    Array<uint32_t> table(table_size);
+    memset(table.Data(), 0xff, sizeof(uint32_t) * table_size);
+
+    out_locked.Resize(vertex_count);
+    memset(out_locked.Data(), 0, vertex_count);
+
+    Array<uint32_t> position_ids(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        uint32_t slot = static_cast<uint32_t>(GfxHash(reinterpret_cast<const char*>(&positions[i]), sizeof(glm::vec3))) & (table_size - 1);
+        while (table[slot] != ~0u && memcmp(&positions[table[slot]], &positions[i], sizeof(glm::vec3)) != 0)
+            slot = (slot + 1) & (table_size - 1);
+        if (table[slot] == ~0u)
+        {
+            table[slot] = i;
+        }
+        else
+        {
+            out_locked[table[slot]] = 1;
+            out_locked[i] = 1;
+        }
+        position_ids[i] = table[slot];
+    }
+
+    // An edge is open when no triangle has it in the opposite direction
+    uint32_t edge_table_size = 1;
+    while (edge_table_size < index_count * 2)
+        edge_table_size *= 2;
+    Array<uint64_t> edge_table(edge_table_size);
+    memset(edge_table.Data(), 0xff, sizeof(uint64_t) * edge_table_size);
+    for (uint32_t pass = 0; pass < 2; ++pass)
+    {
+        for (uint32_t i = 0; i < index_count; ++i)
+        {
+            const uint32_t from = position_ids[indices[i]];
+            const uint32_t to = position_ids[indices[i % 3 == 2 ? i - 2 : i + 1]];
+            const uint64_t key = pass == 0 ? (static_cast<uint64_t>(from) << 32 | to) : (static_cast<uint64_t>(to) << 32 | from);
+
+            uint32_t slot = static_cast<uint32_t>(GfxHash(reinterpret_cast<const char*>(&key), sizeof(uint64_t))) & (edge_table_size - 1);
+            while (edge_table[slot] != ~0ull && edge_table[slot] != key)
+                slot = (slot + 1) & (edge_table_size - 1);
+
+            if (pass == 0)
+            {
+                edge_table[slot] = key;
+            }
+            else if (edge_table[slot] == ~0ull)
+            {
+                out_locked[indices[i]] = 1;
+                out_locked[indices[i % 3 == 2 ? i - 2 : i + 1]] = 1;
+            }
+        }
+    }
+}
+
+// Collapses edges by moving an unlocked vertex onto a neighbour, cheapest quadric error first, until the index count
+// reaches the target or nothing more can be collapsed. Only existing vertices are used, so all LODs share the vertex buffer.
+// Returns the largest collapse error as a distance in model space.
+static float SimplifyMesh(Array<uint32_t>& indices, const glm::vec3* positions, uint32_t vertex_count, const uint8_t* locked, Quadric* quadrics, uint32_t target_index_count)
+{
+    float max_error = 0.0f;
+
+    Array<Collapse> collapses;
+    Array<uint32_t> remap(vertex_count);
+    Array<uint8_t> touched(vertex_count);
+    Array<uint32_t> adjacency_offsets(vertex_count + 1);
+    Array<uint32_t> adjacency;
+
+    while (indices.Count() > target_index_count)
+    {
+        const uint32_t index_count = indices.Count();
+
+        collapses.Clear();
+        for (uint32_t i = 0; i < index_count; ++i)
+        {
+            const uint32_t from = indices[i];
+            const uint32_t to = indices[i % 3 == 2 ? i - 2 : i + 1];
+            for (uint32_t j = 0; j < 2; ++j)
+            {
+                const uint32_t a = j == 0 ? from : to;
+                const uint32_t b = j == 0 ? to : from;
+                if (locked[a])
+                    continue;
+
+                Quadric q = quadrics[a];
+                AddQuadric(q, quadrics[b]);
+
+                Collapse collapse;
+                collapse.m_From = a;
+                collapse.m_To = b;
+                collapse.m_Cost = EvaluateQuadric(q, positions[b]);
+                collapses.Push(collapse);
+            }
+        }
+        if (collapses.Count() == 0)
+            break;
+        qsort(collapses.Data(), collapses.Count(), sizeof(Collapse), CompareCollapses);
+
+        memset(adjacency_offsets.Data(), 0, sizeof(uint32_t) * (vertex_count + 1));
+        for (uint32_t i = 0; i < index_count; ++i)
+            ++adjacency_offsets[indices[i] + 1];
+        for (uint32_t i = 0; i < vertex_count; ++i)
+            adjacency_offsets[i + 1] += adjacency_offsets[i];
+        adjacency.Resize(index_count);
+        for (uint32_t i = 0; i < index_count; ++i)
+            adjacency[adjacency_offsets[indices[i]]++] = i / 3;
+        for (uint32_t i = vertex_count; i > 0; --i)
+            adjacency_offsets[i] = adjacency_offsets[i - 1];
+        adjacency_offsets[0] = 0;
+
+        for (uint32_t i = 0; i < vertex_count; ++i)
+            remap[i] = i;
+        memset(touched.Data(), 0, vertex_count);
+
+        // Each pass only collapses edges whose surroundings are untouched, so the flip test sees the final positions
+        const uint32_t triangles_to_remove = (index_count - target_index_count) / 3;
+        uint32_t removed_triangle_count = 0;
+        uint32_t collapse_count = 0;
+        for (uint32_t i = 0; i < collapses.Count() && removed_triangle_count < triangles_to_remove; ++i)
+        {
+            const Collapse& collapse = collapses[i];
+            const uint32_t a = collapse.m_From;
+            const uint32_t b = collapse.m_To;
+            if (touched[a] || touched[b])
+                continue;
+
+            bool flipped = false;
+            uint32_t shared_triangle_count = 0;
+            for (uint32_t j = adjacency_offsets[a]; j < adjacency_offsets[a + 1] && !flipped; ++j)
+            {
+                const uint32_t* triangle = &indices[adjacency[j] * 3];
+                if (triangle[0] == b || triangle[1] == b || triangle[2] == b)
+                {
+                    ++shared_triangle_count;
+                    continue;
+                }
+
+                glm::vec3 corners[3];
+                for (uint32_t k = 0; k < 3; ++k)
+                    corners[k] = positions[triangle[k]];
+                const glm::vec3 old_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                for (uint32_t k = 0; k < 3; ++k)
+                    corners[k] = triangle[k] == a ? positions[b] : corners[k];
+                const glm::vec3 new_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                // Rejects normals turning by more than about 75 degrees, not just full flips
+                flipped = glm::dot(old_normal, new_normal) <= 0.25f * glm::length(old_normal) * glm::length(new_normal);
+            }
+            if (flipped)
+                continue;
+
+            remap[a] = b;
+            AddQuadric(quadrics[b], quadrics[a]);
+            max_error = fmaxf(max_error, collapse.m_Cost);
+            removed_triangle_count += shared_triangle_count;
+            ++collapse_count;
+
+            for (uint32_t j = 0; j < 2; ++j)
+            {
+                const uint32_t v = j == 0 ? a : b;
+                for (uint32_t k = adjacency_offsets[v]; k < adjacency_offsets[v + 1]; ++k)
+                {
+                    touched[indices[adjacency[k] * 3 + 0]] = 1;
+                    touched[indices[adjacency[k] * 3 + 1]] = 1;
+                    touched[indices[adjacency[k] * 3 + 2]] = 1;
+                }
+            }
+        }
+        if (collapse_count == 0)
+            break;
+
+        uint32_t new_index_count = 0;
+        for (uint32_t i = 0; i < index_count; i += 3)
+        {
+            const uint32_t a = remap[indices[i + 0]];
+            const uint32_t b = remap[indices[i + 1]];
+            const uint32_t c = remap[indices[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            indices[new_index_count++] = a;
+            indices[new_index_count++] = b;
+            indices[new_index_count++] = c;
+        }
+        indices.Resize(new_index_count);
+    }
+
+    return sqrtf(max_error);
+}
+
+// Builds up to GFX_MODEL_MAX_LOD_COUNT - 1 simplified index lists, each with about half the triangles of the previous one
+static uint32_t BuildLods(const uint32_t* indices, uint32_t index_count, const glm::vec3* positions, uint32_t vertex_count, Array<uint32_t>* out_lods, float* out_errors)
+{
+    Array<uint8_t> locked;
+    FindLockedVertices(indices, index_count, positions, vertex_count, locked);
+
+    Array<Quadric> quadrics(vertex_count);
+    memset(quadrics.Data(), 0, sizeof(Quadric) * vertex_count);
+    for (uint32_t i = 0; i < index_count; i += 3)
+    {
+        const glm::vec3& pos_a = positions[indices[i + 0]];
+        const glm::vec3& pos_b = positions[indices[i + 1]];
+        const glm::vec3& pos_c = positions[indices[i + 2]];
+
+        const glm::vec3 cross = glm::cross(pos_b - pos_a, pos_c - pos_a);
+        const float area = glm::length(cross);
+        if (area <= 0.0f)
+            continue;
+
+        const glm::vec3 n = cross / area;
+        const float d = -glm::dot(n, pos_a);
+
+        Quadric q;
+        q.m_A2 = area * n.x * n.x; q.m_AB = area * n.x * n.y; q.m_AC = area * n.x * n.z; q.m_AD = area * n.x * d;
+        q.m_B2 = area * n.y * n.y; q.m_BC = area * n.y * n.z; q.m_BD = area * n.y * d;
+        q.m_C2 = area * n.z * n.z; q.m_CD = area * n.z * d;
+        q.m_D2 = area * d * d;
+        q.m_Weight = area;
+        for (uint32_t j = 0; j < 3; ++j)
+            AddQuadric(quadrics[indices[i + j]], q);
+    }
+
+    Array<uint32_t> lod_indices(index_count);
+    memcpy(lod_indices.Data(), indices, sizeof(uint32_t) * index_count);
+
+    uint32_t lod_count = 0;
+    float error = 0.0f;
+    while (lod_count < GFX_MODEL_MAX_LOD_COUNT - 1 && lod_indices.Count() >= 64 * 3)
+    {
+        const uint32_t prev_index_count = lod_indices.Count();
+        error = fmaxf(error, SimplifyMesh(lod_indices, positions, vertex_count, locked.Data(), quadrics.Data(), (prev_index_count / 6) * 3));
+        if (lod_indices.Count() > prev_index_count - prev_index_count / 10)
+            break;
+
+        Array<uint32_t>& lod = out_lods[lod_count];
+        lod.Resize(lod_indices.Count());
+        memcpy(lod.Data(), lod_indices.Data(), sizeof(uint32_t) * lod_indices.Count());
+
+        Array<uint32_t> cluster_offsets;
+        OptimizeVertexCache(lod.Data(), lod.Count(), vertex_count, cluster_offsets);
+
+        out_errors[lod_count] = error;
+        ++lod_count;
+    }
+    return lod_count;
+}
+
+// Merges vertices with bit identical attributes and returns the new vertex count.
+// The first vertex of each set of duplicates is kept, in order, so the result is deterministic.
+static uint32_t WeldVertices(uint32_t* indices, uint32_t index_count, glm::vec3* positions, glm::vec2* texcoords, glm::vec3* normals, uint32_t vertex_count)
+{
+    struct Vertex
+    {
+        glm::vec3   m_Position;
+        glm::vec2   m_Texcoord;
+        glm::vec3   m_Normal;
+    };
+
+    uint32_t table_size = 1;
+    while (table_size < vertex_count * 2)
+        table_size *= 2;
+    Array<uint32_t> table(table_size);
+    memset(table.Data(), 0xff, sizeof(uint32_t) * table_size);
+
+    Array<uint32_t> remap(vertex_count);
+    uint32_t welded_vertex_count = 0;
+    for (uint32_t i = 0; i < vertex_count; ++i)
+    {
+        // Adding zero turns negative zero into positive zero so both compare equal bitwise
+        Vertex vertex;
+        vertex.m_Position = positions[i] + glm::vec3(0.0f);
+        vertex.m_Texcoord = texcoords[i] + glm::vec2(0.0f);
+        vertex.m_Normal = normals[i] + glm::vec3(0.0f);
+
+        uint32_t slot = static_cast<uint32_t>(GfxHash(reinterpret_cast<const char*>(&vertex), sizeof(Vertex))) & (table_size - 1);
+        while (table[slot] != ~0u)
+        {
+            const uint32_t j = table[slot];
+            if (memcmp(&positions[j], &vertex.m_Position, sizeof(glm::vec3)) == 0 &&
+                memcmp(&texcoords[j], &vertex.m_Texcoord, sizeof(glm::vec2)) == 0 &&
+                memcmp(&normals[j], &vertex.m_Normal, sizeof(glm::vec3)) == 0)
+            {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == ~0u)
+        {
+            // Vertices before i have already been read, so they can be compacted in place
+            table[slot] = welded_vertex_count;
+            positions[welded_vertex_count] = vertex.m_Position;
+            texcoords[welded_vertex_count] = vertex.m_Texcoord;
+            normals[welded_vertex_count] = vertex.m_Normal;
+            ++welded_vertex_count;
+        }
+        remap[i] = table[slot];
+    }
+
+    for (uint32_t i = 0; i < index_count; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+    return welded_vertex_count;
+}
+
+// Reorders triangles and vertices, deterministic so the same model always cooks to the same blob
+static void OptimizeMesh(uint32_t mesh_index, uint32_t* indices, uint32_t index_count, glm::vec3* positions, glm::vec2* texcoords, glm::vec3* normals, uint32_t vertex_count)
+{
+    const uint32_t triangle_count = index_count / 3;
+    if (triangle_count == 0)
+        return;
+
+    uint32_t used_vertex_count = 0;
+    Array<uint8_t> used(vertex_count);
+    memset(used.Data(), 0, vertex_count);
+    for (uint32_t i = 0; i < index_count; ++i)
+    {
+        used_vertex_count += used[indices[i]] ? 0 : 1;
+        used[indices[i]] = 1;
+    }
+
+    const uint32_t miss_count_before = SimulateVertexCache(indices, index_count, vertex_count);
+
+    Array<uint32_t> cluster_offsets;
+    OptimizeVertexCache(indices, index_count, vertex_count, cluster_offsets);
+    OptimizeOverdraw(indices, index_count, positions, cluster_offsets);
+    OptimizeVertexFetch(indices, index_count, positions, texcoords, normals, vertex_count);
+
+    const uint32_t miss_count_after = SimulateVertexCache(indices, index_count, vertex_count);
+
+    // ACMR is vertex shader invocations per triangle and ATVR per used vertex, where 1 is optimal
+    Print("Optimized mesh %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", mesh_index,
+        static_cast<float>(miss_count_before) / triangle_count, static_cast<float>(miss_count_after) / triangle_count,
+        static_cast<float>(miss_count_before) / used_vertex_count, static_cast<float>(miss_count_after) / used_vertex_count);
+}
+
+static void FinishMeshlet(GfxModel_T::Meshlet& meshlet, const glm::vec3* positions, const uint32_t* indices)
+{
+    // indices points at the whole model, positions at the vertices of the mesh
+    glm::vec3 bounding_box_min = glm::vec3(FLT_MAX);
+    glm::vec3 bounding_box_max = glm::vec3(-FLT_MAX);
+    glm::vec3 normal_sum = glm::vec3(0.0f);
+    for (uint32_t i = 0; i < meshlet.m_IndexCount; i += 3)
+    {
+        const glm::vec3& pos_a = positions[indices[meshlet.m_IndexOffset + i + 0]];
+        const glm::vec3& pos_b = positions[indices[meshlet.m_IndexOffset + i + 1]];
+        const glm::vec3& pos_c = positions[indices[meshlet.m_IndexOffset + i + 2]];
+
+        bounding_box_min = glm::min(bounding_box_min, glm::min(pos_a, glm::min(pos_b, pos_c)));
+        bounding_box_max = glm::max(bounding_box_max, glm::max(pos_a, glm::max(pos_b, pos_c)));
+
+        const glm::vec3 normal = glm::cross(pos_b - pos_a, pos_c - pos_a);
+        const float length = glm::length(normal);
+        if (length > 0.0f)
+            normal_sum += normal / length;
+    }
+
+    const glm::vec3 center = (bounding_box_min + bounding_box_max) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.m_IndexCount; ++i)
+    {
+        radius = fmaxf(radius, glm::length(positions[indices[meshlet.m_IndexOffset + i]] - center));
+    }
+
+    // The cone holds every triangle normal, the cutoff is the sine of its half angle
+    const float normal_sum_length = glm::length(normal_sum);
+    const glm::vec3 axis = normal_sum_length > 0.0f ? normal_sum / normal_sum_length : glm::vec3(0.0f, 0.0f, 1.0f);
+    float min_dot = normal_sum_length > 0.0f ? 1.0f : -1.0f;
+    for (uint32_t i = 0; i < meshlet.m_IndexCount; i += 3)
+    {
+        const glm::vec3& pos_a = positions[indices[meshlet.m_IndexOffset + i + 0]];
+        const glm::vec3& pos_b = positions[indices[meshlet.m_IndexOffset + i + 1]];
+        const glm::vec3& pos_c = positions[indices[meshlet.m_IndexOffset + i + 2]];
+
+        const glm::vec3 normal = glm::cross(pos_b - pos_a, pos_c - pos_a);
+        const float length = glm::length(normal);
+        if (length > 0.0f)
+            min_dot = fminf(min_dot, glm::dot(axis, normal / length));
+    }
+
+    memcpy(meshlet.m_Center, &center.x, sizeof(float) * 3);
+    meshlet.m_Radius = radius;
+    memcpy(meshlet.m_ConeAxis, &axis.x, sizeof(float) * 3);
+    meshlet.m_ConeCutoff = min_dot <= 0.1f ? 1.0f : sqrtf(1.0f - min_dot * min_dot);
+}
+
+// Splits the triangles of a mesh in order, so every meshlet is a contiguous index range
+static void BuildMeshlets(Array<GfxModel_T::Meshlet>& meshlets, const glm::vec3* positions, const uint32_t* indices, uint32_t mesh_index, uint32_t vertex_offset, uint32_t vertex_count, uint32_t index_offset, uint32_t index_count)
+{
+    Array<uint32_t> vertex_tags(vertex_count);
+    memset(vertex_tags.Data(), 0, sizeof(uint32_t) * vertex_count);
+
+    GfxModel_T::Meshlet meshlet;
+    meshlet.m_MeshIndex = mesh_index;
+    meshlet.m_IndexOffset = index_offset;
+    meshlet.m_IndexCount = 0;
+    meshlet.m_VertexOffset = vertex_offset;
+
+    uint32_t meshlet_tag = 1;
+    uint32_t meshlet_vertex_count = 0;
+    for (uint32_t i = 0; i < index_count; i += 3)
+    {
+        uint32_t new_vertex_count = 0;
+        for (uint32_t j = 0; j < 3; ++j)
+            new_vertex_count += vertex_tags[indices[index_offset + i + j]] != meshlet_tag ? 1 : 0;
+
+        if (meshlet_vertex_count + new_vertex_count > MESHLET_MAX_VERTEX_COUNT || meshlet.m_IndexCount / 3 == MESHLET_MAX_TRIANGLE_COUNT)
+        {
+            FinishMeshlet(meshlet, positions + vertex_offset, indices);
+            meshlets.Push(meshlet);
+
+            meshlet.m_IndexOffset += meshlet.m_IndexCount;
+            meshlet.m_IndexCount = 0;
+            meshlet_vertex_count = 0;
+            ++meshlet_tag;
+        }
+
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            uint32_t& tag = vertex_tags[indices[index_offset + i + j]];
+            if (tag != meshlet_tag)
+            {
+                tag = meshlet_tag;
+                ++meshlet_vertex_count;
+            }
+        }
+        meshlet.m_IndexCount += 3;
+    }
+
+    if (meshlet.m_IndexCount > 0)
+    {
+        FinishMeshlet(meshlet, positions + vertex_offset, indices);
+        meshlets.Push(meshlet);
+    }
+}
+
+static Blob CreateModelBlob(const void* data, size_t size, const FileStamp& stamp, const char* material_dir, uint32_t flags)
 {
     Blob blob;
     blob.m_Data = NULL;
@@ -36,27 +1033,95 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
         total_triangle_count += static_cast<uint32_t>(shapes[i].mesh.indices.size() / 3);
     }
     
+    // Meshes whose vertices can be indexed with 16 bits come first, so each index size is one contiguous range of meshes
+    Array<uint32_t> shape_order(shape_count);
+    uint32_t index16_count = 0;
+    uint32_t index32_count = 0;
+    uint32_t shape16_count = 0;
+    for (uint32_t i = 0; i < shape_count; ++i)
+    {
+        if (shapes[i].mesh.positions.size() / 3 <= 0x10000)
+        {
+            shape_order[shape16_count++] = i;
+            index16_count += static_cast<uint32_t>(shapes[i].mesh.indices.size());
+        }
+    }
+    for (uint32_t i = 0, j = shape16_count; i < shape_count; ++i)
+    {
+        if (shapes[i].mesh.positions.size() / 3 > 0x10000)
+        {
+            shape_order[j++] = i;
+            index32_count += static_cast<uint32_t>(shapes[i].mesh.indices.size());
+        }
+    }
+
     glm::vec3* positions = static_cast<glm::vec3*>(Alloc(sizeof(glm::vec3) * total_vertex_count));
     glm::vec2* texcoords = static_cast<glm::vec2*>(Alloc(sizeof(glm::vec2) * total_vertex_count));
     glm::vec3* normals = static_cast<glm::vec3*>(Alloc(sizeof(glm::vec3) * total_vertex_count));
+    glm::vec4* tangents = static_cast<glm::vec4*>(Alloc(sizeof(glm::vec4) * total_vertex_count));
     uint32_t* indices = static_cast<uint32_t*>(Alloc(sizeof(uint32_t) * 3 * total_triangle_count));
     
     glm::vec3 bounding_box_min = glm::vec3(FLT_MAX);
     glm::vec3 bounding_box_max = glm::vec3(-FLT_MAX);
+
+    const uint32_t mesh_bounds_stride = (shape_count + 7) & ~7u;
+    Array<float> mesh_bounds(mesh_bounds_stride * GfxModel_T::MESH_BOUNDS_STREAM_COUNT);
+    memset(mesh_bounds.Data(), 0, sizeof(float) * mesh_bounds.Count());
+
+    Array<GfxModel_T::Meshlet> meshlets;
+    Array<uint32_t> mesh_meshlet_offsets(shape_count);
     
-    for (uint32_t i = 0, vertex_offset = 0, triangle_offset = 0; i < shape_count; ++i)
+    Array<uint32_t> mesh_vertex_counts(shape_count);
+
+    // LOD index lists go after the full detail indices of their index buffer region
+    Array<GfxModel_T::Lod> mesh_lods(shape_count * GFX_MODEL_MAX_LOD_COUNT);
+    Array<uint32_t> mesh_lod_counts(shape_count);
+    Array<uint32_t> lod16_indices;
+    Array<uint32_t> lod32_indices;
+    memset(mesh_lods.Data(), 0, sizeof(GfxModel_T::Lod) * mesh_lods.Count());
+    const uint32_t unwelded_vertex_count = total_vertex_count;
+    total_vertex_count = 0;
+    
+    for (uint32_t i = 0, triangle_offset = 0; i < shape_count; ++i)
     {
-        const tinyobj::mesh_t& mesh = shapes[i].mesh;
+        const tinyobj::mesh_t& mesh = shapes[shape_order[i]].mesh;
     
-        const uint32_t vertex_count = static_cast<uint32_t>(mesh.positions.size() / 3);
+        const uint32_t vertex_offset = total_vertex_count;
+        uint32_t vertex_count = static_cast<uint32_t>(mesh.positions.size() / 3);
         const uint32_t triangle_count = static_cast<uint32_t>(mesh.indices.size() / 3);
     
+        glm::vec3 mesh_bounding_box_min = glm::vec3(FLT_MAX);
+        glm::vec3 mesh_bounding_box_max = glm::vec3(-FLT_MAX);
         for (uint32_t j = 0; j < vertex_count; ++j)
         {
             positions[vertex_offset + j] = glm::make_vec3(&mesh.positions[j * 3]);
     
-            bounding_box_min = glm::min(bounding_box_min, positions[vertex_offset + j]);
-            bounding_box_max = glm::max(bounding_box_max, positions[vertex_offset + j]);
+            mesh_bounding_box_min = glm::min(mesh_bounding_box_min, positions[vertex_offset + j]);
+            mesh_bounding_box_max = glm::max(mesh_bounding_box_max, positions[vertex_offset + j]);
+        }
+        bounding_box_min = glm::min(bounding_box_min, mesh_bounding_box_min);
+        bounding_box_max = glm::max(bounding_box_max, mesh_bounding_box_max);
+
+        // The sphere is centered on the box but only as large as the farthest vertex
+        const glm::vec3 mesh_bounding_sphere_center = (mesh_bounding_box_min + mesh_bounding_box_max) * 0.5f;
+        float mesh_bounding_sphere_radius = 0.0f;
+        for (uint32_t j = 0; j < vertex_count; ++j)
+        {
+            mesh_bounding_sphere_radius = fmaxf(mesh_bounding_sphere_radius, glm::length(positions[vertex_offset + j] - mesh_bounding_sphere_center));
+        }
+
+        if (vertex_count > 0)
+        {
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_MIN_X * mesh_bounds_stride + i] = mesh_bounding_box_min.x;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_MIN_Y * mesh_bounds_stride + i] = mesh_bounding_box_min.y;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_MIN_Z * mesh_bounds_stride + i] = mesh_bounding_box_min.z;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_MAX_X * mesh_bounds_stride + i] = mesh_bounding_box_max.x;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_MAX_Y * mesh_bounds_stride + i] = mesh_bounding_box_max.y;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_MAX_Z * mesh_bounds_stride + i] = mesh_bounding_box_max.z;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_SPHERE_X * mesh_bounds_stride + i] = mesh_bounding_sphere_center.x;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_SPHERE_Y * mesh_bounds_stride + i] = mesh_bounding_sphere_center.y;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_SPHERE_Z * mesh_bounds_stride + i] = mesh_bounding_sphere_center.z;
+            mesh_bounds[GfxModel_T::MESH_BOUNDS_SPHERE_RADIUS * mesh_bounds_stride + i] = mesh_bounding_sphere_radius;
         }
         
         const bool has_texcoords = mesh.texcoords.size() / 2 == vertex_count;
@@ -118,11 +1183,60 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
             indices[(triangle_offset + j) * 3 + 1] = mesh.indices[j * 3 + 1];
             indices[(triangle_offset + j) * 3 + 2] = mesh.indices[j * 3 + 2];
         }
+
+        vertex_count = WeldVertices(indices + triangle_offset * 3, triangle_count * 3, positions + vertex_offset, texcoords + vertex_offset, normals + vertex_offset, vertex_count);
+        mesh_vertex_counts[i] = vertex_count;
+
+        OptimizeMesh(i, indices + triangle_offset * 3, triangle_count * 3, positions + vertex_offset, texcoords + vertex_offset, normals + vertex_offset, vertex_count);
+        ComputeTangents(indices + triangle_offset * 3, triangle_count * 3, positions + vertex_offset, texcoords + vertex_offset, normals + vertex_offset, vertex_count, tangents + vertex_offset);
+
+        mesh_meshlet_offsets[i] = meshlets.Count();
+        BuildMeshlets(meshlets, positions, indices, i, vertex_offset, vertex_count, triangle_offset * 3, triangle_count * 3);
+
+        {
+            GfxModel_T::Lod* lods = &mesh_lods[i * GFX_MODEL_MAX_LOD_COUNT];
+            lods[0].m_IndexOffset = i < shape16_count ? triangle_offset * 3 : triangle_offset * 3 - index16_count;
+            lods[0].m_IndexCount = triangle_count * 3;
+            lods[0].m_Error = 0.0f;
+
+            Array<uint32_t> lod_indices[GFX_MODEL_MAX_LOD_COUNT - 1];
+            float lod_errors[GFX_MODEL_MAX_LOD_COUNT - 1];
+            const uint32_t lod_count = BuildLods(indices + triangle_offset * 3, triangle_count * 3, positions + vertex_offset, vertex_count, lod_indices, lod_errors);
+
+            Array<uint32_t>& region_indices = i < shape16_count ? lod16_indices : lod32_indices;
+            const uint32_t region_offset = i < shape16_count ? index16_count : index32_count;
+            for (uint32_t j = 0; j < lod_count; ++j)
+            {
+                lods[j + 1].m_IndexOffset = region_offset + region_indices.Count();
+                lods[j + 1].m_IndexCount = lod_indices[j].Count();
+                lods[j + 1].m_Error = lod_errors[j];
+                for (uint32_t k = 0; k < lod_indices[j].Count(); ++k)
+                    region_indices.Push(lod_indices[j][k]);
+            }
+            mesh_lod_counts[i] = lod_count + 1;
+        }
     
-        vertex_offset += vertex_count;
+        total_vertex_count += vertex_count;
         triangle_offset += triangle_count;
     }
 
+    if (unwelded_vertex_count > 0)
+    {
+        Print("Welded vertices: %u -> %u (%.1f%% fewer)", unwelded_vertex_count, total_vertex_count,
+            100.0f * static_cast<float>(unwelded_vertex_count - total_vertex_count) / unwelded_vertex_count);
+    }
+
+    // Meshlet index offsets are relative to the index buffer region of their mesh, like the mesh index offsets
+    for (uint32_t i = 0; i < meshlets.Count(); ++i)
+    {
+        if (meshlets[i].m_MeshIndex >= shape16_count)
+            meshlets[i].m_IndexOffset -= index16_count;
+    }
+
+    const uint32_t total_index16_count = index16_count + lod16_indices.Count();
+    const uint32_t total_index32_count = index32_count + lod32_indices.Count();
+    const uint32_t index_buffer32_offset = (sizeof(uint16_t) * total_index16_count + 3) & ~3u;
+
     HashTable<int32_t> texture_index_table(256);
     Array<String> texture_filepaths;
     size_t texture_filepaths_size = 0;
@@ -154,7 +1268,7 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
     }
     
     blob.m_Size =
-        sizeof(uint64_t) +                              // Checksum
+        sizeof(BlobHeader) +                            // Header
         sizeof(uint32_t) +                              // Mesh count
         sizeof(GfxModel_T::Mesh) * shape_count +        // Meshes
         sizeof(uint32_t) +                              // Material count
@@ -162,27 +1276,46 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
         sizeof(uint32_t) +                              // Texture count
         texture_filepaths_size +                        // Texture filepaths
         sizeof(float) * 3 * 2 +                         // Bounding box
+        sizeof(uint64_t) +                              // Mesh bounds size
+        sizeof(float) * mesh_bounds.Count() +           // Mesh bounds
+        sizeof(uint64_t) +                              // Meshlets size
+        sizeof(GfxModel_T::Meshlet) * meshlets.Count() +// Meshlets
         sizeof(float) +                                 // Vertex position scale
+        sizeof(uint64_t) * 2 * (GFX_MODEL_VERTEX_ATTRIBUTE_COUNT + 1) + // Vertex and index section sizes
         sizeof(uint16_t) * 4 * total_vertex_count +     // Vertex positions
         sizeof(uint16_t) * 2 * total_vertex_count +     // Vertex texture coordinates
-        sizeof(uint8_t)  * 4 * total_vertex_count +     // Vertex normals
-        sizeof(uint32_t) * 3 * total_triangle_count;    // Indices
+        sizeof(int16_t)  * 2 * total_vertex_count +     // Vertex normals
+        sizeof(int16_t)  * 4 * total_vertex_count +     // Vertex tangent frames
+        index_buffer32_offset +                         // 16-bit indices
+        sizeof(uint32_t) * total_index32_count;         // 32-bit indices
     blob.m_Data = Alloc(blob.m_Size);
 
     WriteStream stream(blob.m_Data, blob.m_Size);
-    stream.WriteUint64(GfxHash(static_cast<const char*>(data), size));
+    WriteBlobHeader(stream, data, size, stamp, flags);
+    const bool compress = (flags & BLOB_FLAG_COMPRESSED) != 0;
 
     stream.WriteUint32(shape_count);
     for (uint32_t i = 0, vertex_offset = 0, triangle_offset = 0; i < shape_count; ++i)
     {
-        const uint32_t vertex_count = static_cast<uint32_t>(shapes[i].mesh.positions.size() / 3);
-        const uint32_t triangle_count = static_cast<uint32_t>(shapes[i].mesh.indices.size() / 3);
+        const tinyobj::mesh_t& mesh = shapes[shape_order[i]].mesh;
+        const uint32_t vertex_count = mesh_vertex_counts[i];
+        const uint32_t triangle_count = static_cast<uint32_t>(mesh.indices.size() / 3);
 
-        stream.WriteUint32(shapes[i].mesh.material_ids.empty() ? 0xffffffff : shapes[i].mesh.material_ids[0]);
+        stream.WriteUint32(mesh.material_ids.empty() ? 0xffffffff : mesh.material_ids[0]);
         stream.WriteUint32(vertex_offset);
         stream.WriteUint32(vertex_count);
-        stream.WriteUint32(triangle_offset * 3);
+        stream.WriteUint32(i < shape16_count ? triangle_offset * 3 : triangle_offset * 3 - index16_count);
         stream.WriteUint32(triangle_count * 3);
+        stream.WriteUint32(i < shape16_count ? sizeof(uint16_t) : sizeof(uint32_t));
+        stream.WriteUint32(mesh_lod_counts[i]);
+        for (uint32_t j = 0; j < GFX_MODEL_MAX_LOD_COUNT; ++j)
+        {
+            stream.WriteUint32(mesh_lods[i * GFX_MODEL_MAX_LOD_COUNT + j].m_IndexOffset);
+            stream.WriteUint32(mesh_lods[i * GFX_MODEL_MAX_LOD_COUNT + j].m_IndexCount);
+            stream.WriteFloat(mesh_lods[i * GFX_MODEL_MAX_LOD_COUNT + j].m_Error);
+        }
+        stream.WriteUint32(mesh_meshlet_offsets[i]);
+        stream.WriteUint32((i + 1 < shape_count ? mesh_meshlet_offsets[i + 1] : meshlets.Count()) - mesh_meshlet_offsets[i]);
     
         vertex_offset += vertex_count;
         triangle_offset += triangle_count;
@@ -204,6 +1337,10 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
     stream.WriteFloat3(&bounding_box_min.x);
     stream.WriteFloat3(&bounding_box_max.x);
 
+    stream.Write(mesh_bounds.Data(), sizeof(float) * mesh_bounds.Count());
+
+    stream.Write(meshlets.Data(), sizeof(GfxModel_T::Meshlet) * meshlets.Count());
+
     // Find the absolute maximum value of all floats to get the quantization scale
     float q = 1.f / 65535.f;
     for (uint32_t i = 0; i < total_vertex_count; ++i)
@@ -220,6 +1357,8 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
     // Store the quantization scale
     stream.WriteFloat(q);
 
+    // Every vertex attribute stream and the index buffer are sections of their own
+    void* section = stream.BeginSection();
     for (uint32_t i = 0; i < total_vertex_count; ++i)
     {
         float r = positions[i].x;
@@ -255,64 +1394,100 @@ static Blob CreateModelBlob(const void* data, size_t size, const char* material_
         stream.WriteUint16(static_cast<uint16_t>(b));
         stream.WriteUint16(static_cast<uint16_t>(m));
     }
-    
+    stream.EndSection(section, compress);
+
+    section = stream.BeginSection();
     for (uint32_t i = 0; i < total_vertex_count; ++i)
     {
         stream.WriteUint32(glm::packHalf2x16(texcoords[i]));
     }
+    stream.EndSection(section, compress);
 
+    section = stream.BeginSection();
     for (uint32_t i = 0; i < total_vertex_count; ++i)
     {
-        float r = normals[i].x;
-        float g = normals[i].y;
-        float b = normals[i].z;
-        float a = 0.f;
+        const glm::vec2 n = EncodeOctahedral(normals[i]);
 
-        // [-1, 1] -> [0, 1]
-        r = r * 0.5f + 0.5f;
-        g = g * 0.5f + 0.5f;
-        b = b * 0.5f + 0.5f;
-        a = a * 0.5f + 0.5f;
+        stream.WriteUint16(static_cast<uint16_t>(QuantizeSnorm16(n.x)));
+        stream.WriteUint16(static_cast<uint16_t>(QuantizeSnorm16(n.y)));
+    }
+    stream.EndSection(section, compress);
 
-        // Convert from float scale to integer scale
-        r = r * 255.f + 0.5f;
-        g = g * 255.f + 0.5f;
-        b = b * 255.f + 0.5f;
-        a = a * 255.f + 0.5f;
+    section = stream.BeginSection();
+    for (uint32_t i = 0; i < total_vertex_count; ++i)
+    {
+        const glm::quat q = EncodeTangentFrame(normals[i], tangents[i]);
 
-        stream.WriteUint8(static_cast<uint8_t>(r));
-        stream.WriteUint8(static_cast<uint8_t>(g));
-        stream.WriteUint8(static_cast<uint8_t>(b));
-        stream.WriteUint8(static_cast<uint8_t>(a));
+        stream.WriteUint16(static_cast<uint16_t>(QuantizeSnorm16(q.x)));
+        stream.WriteUint16(static_cast<uint16_t>(QuantizeSnorm16(q.y)));
+        stream.WriteUint16(static_cast<uint16_t>(QuantizeSnorm16(q.z)));
+        stream.WriteUint16(static_cast<uint16_t>(QuantizeSnorm16(q.w)));
     }
+    stream.EndSection(section, compress);
 
-    for (uint32_t i = 0; i < total_triangle_count; ++i)
+    section = stream.BeginSection();
+    for (uint32_t i = 0; i < index16_count; ++i)
+    {
+        stream.WriteUint16(static_cast<uint16_t>(indices[i]));
+    }
+    for (uint32_t i = 0; i < lod16_indices.Count(); ++i)
+    {
+        stream.WriteUint16(static_cast<uint16_t>(lod16_indices[i]));
+    }
+    if (total_index16_count & 1)
+    {
+        stream.WriteUint16(0); // Keeps the 32-bit indices aligned
+    }
+    for (uint32_t i = 0; i < index32_count; ++i)
     {
-        stream.WriteUint32(indices[i * 3 + 0]);
-        stream.WriteUint32(indices[i * 3 + 1]);
-        stream.WriteUint32(indices[i * 3 + 2]);
+        stream.WriteUint32(indices[index16_count + i]);
     }
+    for (uint32_t i = 0; i < lod32_indices.Count(); ++i)
+    {
+        stream.WriteUint32(lod32_indices[i]);
+    }
+    stream.EndSection(section, compress);
 
-    ASSERT(stream.IsEndOfStream());
+    // Compressed sections leave the stream short of the size it was allocated with
+    blob.m_Size = static_cast<const uint8_t*>(stream.GetPtr()) - static_cast<const uint8_t*>(blob.m_Data);
     
     Free(positions);
     Free(texcoords);
     Free(normals);
+    Free(tangents);
     Free(indices);
 
     return blob;
 }
 
-static GfxModel CreateModel(GfxDevice device, const Blob& blob)
+static void CookModelTexture(void* data)
+{
+    // Every file worker may be cooking a texture at the same time, so each one encodes on its own thread
+    CookTextureLoad(static_cast<TextureLoad*>(data), 1);
+}
+static GfxTexture CreateModelTexture(GfxDevice device, GfxModel model, uint32_t index, TextureLoad* load, uint32_t tail_size)
+{
+    GfxTexture texture = CreateTextureFromLoad(load, tail_size, model->m_TextureStreaming ? &model->m_TextureStreaming->m_Textures[index].m_Info : NULL);
+    if (texture && !model->m_TextureStreaming)
+        AddCachedTexture(device, load->m_Filepath, texture);
+    ReleaseTextureLoad(load);
+    return texture;
+}
+
+// The vertex and index sections are copied or decompressed straight from the blob into staging memory, so a mapped
+// blob is only touched once
+static GfxModel CreateModel(GfxDevice device, const void* blob_data, size_t blob_size)
 {
     GfxModel model = New<GfxModel_T>();
 
-    ReadStream stream(blob.m_Data, blob.m_Size);
-    stream.ReadUint64(); // Checksum
+    ReadStream stream(blob_data, blob_size);
+    stream.IncrPtr(sizeof(BlobHeader)); // Header
 
     uint32_t total_vertex_count = 0;
-    uint32_t total_index_count = 0;
+    uint32_t total_index16_count = 0;
+    uint32_t total_index32_count = 0;
 
+    model->m_Mesh16Count = 0;
     model->m_Meshes.Resize(stream.ReadUint32());
     for (uint32_t i = 0; i < model->m_Meshes.Count(); ++i)
     {
@@ -321,9 +1496,30 @@ static GfxModel CreateModel(GfxDevice device, const Blob& blob)
         model->m_Meshes[i].m_VertexCount = stream.ReadUint32();
         model->m_Meshes[i].m_IndexOffset = stream.ReadUint32();
         model->m_Meshes[i].m_IndexCount = stream.ReadUint32();
+        model->m_Meshes[i].m_IndexSize = stream.ReadUint32();
+        model->m_Meshes[i].m_LodCount = stream.ReadUint32();
+        for (uint32_t j = 0; j < GFX_MODEL_MAX_LOD_COUNT; ++j)
+        {
+            model->m_Meshes[i].m_Lods[j].m_IndexOffset = stream.ReadUint32();
+            model->m_Meshes[i].m_Lods[j].m_IndexCount = stream.ReadUint32();
+            model->m_Meshes[i].m_Lods[j].m_Error = stream.ReadFloat();
+        }
+        model->m_Meshes[i].m_MeshletOffset = stream.ReadUint32();
+        model->m_Meshes[i].m_MeshletCount = stream.ReadUint32();
 
         total_vertex_count += model->m_Meshes[i].m_VertexCount;
-        total_index_count += model->m_Meshes[i].m_IndexCount;
+        uint32_t mesh_index_count = 0;
+        for (uint32_t j = 0; j < model->m_Meshes[i].m_LodCount; ++j)
+            mesh_index_count += model->m_Meshes[i].m_Lods[j].m_IndexCount;
+        if (model->m_Meshes[i].m_IndexSize == sizeof(uint16_t))
+        {
+            total_index16_count += mesh_index_count;
+            ++model->m_Mesh16Count;
+        }
+        else
+        {
+            total_index32_count += mesh_index_count;
+        }
     }
 
     model->m_Materials.Resize(stream.ReadUint32());
@@ -332,16 +1528,108 @@ static GfxModel CreateModel(GfxDevice device, const Blob& blob)
         model->m_Materials[i].m_DiffuseTextureIndex = stream.ReadInt32();
     }
 
-    model->m_Textures.Resize(stream.ReadUint32());
-    for (uint32_t i = 0; i < model->m_Textures.Count(); ++i)
+    // Every texture blob read is started at once. Each texture is created as soon as its blob is in, unless the blob
+    // turns out to be missing or stale, then its image read is queued on the same batch and the worker that reads it
+    // cooks it too, so images are decoded and compressed on every core.
+    const uint32_t texture_count = stream.ReadUint32();
+    model->m_Textures.Resize(texture_count);
+    // Without fragment stores shaders write no feedback to stream by, so the full mip chains are loaded instead
+    const bool stream_textures = device->m_StreamModelTextures && device->m_Caps.m_FragmentStoresAndAtomics;
+    model->m_TextureStreaming = NULL;
+    if (stream_textures)
+    {
+        model->m_TextureStreaming = New<ModelTextureStreaming>();
+        model->m_TextureStreaming->m_Textures.Resize(texture_count);
+        model->m_TextureStreaming->m_Reads.Resize(texture_count);
+        model->m_TextureStreaming->m_ReadCount = 0;
+    }
+    const uint32_t texture_tail_size = stream_textures ? TEXTURE_STREAMING_TAIL_SIZE : 0;
+    Array<const char*> texture_filepaths(texture_count);
+    Array<String> texture_blob_filepaths;
+    Array<uint8_t> texture_image_exists(texture_count);
+    Array<TextureLoad> texture_loads(texture_count);
+    for (uint32_t i = 0; i < texture_count; ++i)
+    {
+        texture_filepaths[i] = static_cast<const char*>(stream.Read());
+        texture_blob_filepaths.Push(GetBlobFilepath(texture_filepaths[i]));
+    }
+
+    FileBatch texture_batch;
+    for (uint32_t i = 0; i < texture_count; ++i)
+    {
+        new(&texture_loads[i]) TextureLoad();
+        if (model->m_TextureStreaming)
+        {
+            new(&model->m_TextureStreaming->m_Textures[i]) ModelTextureStreaming::Texture();
+            new(&model->m_TextureStreaming->m_Reads[i]) FileRead();
+            model->m_TextureStreaming->m_Textures[i].m_BlobFilepath = texture_blob_filepaths[i];
+        }
+
+        // Streamed textures change with what this model samples, only those loaded whole are shared with other loads
+        model->m_Textures[i] = model->m_TextureStreaming ? NULL : AcquireCachedTexture(device, texture_filepaths[i]);
+        if (model->m_Textures[i])
+            continue;
+
+        TextureLoad& load = texture_loads[i];
+        load.m_Device = device;
+        load.m_Filepath = texture_filepaths[i];
+        load.m_BlobFilepath = texture_blob_filepaths[i].Data();
+        load.m_ImageRead.m_Path = texture_filepaths[i];
+        load.m_ImageRead.m_Mode = "rb";
+        load.m_ImageRead.m_Process = CookModelTexture;
+        load.m_ImageRead.m_ProcessData = &load;
+        load.m_BlobRead.m_Path = texture_blob_filepaths[i].Data();
+
+        texture_image_exists[i] = !ResolvePackedFile(device, &load.m_BlobRead) && GetFileStamp(texture_filepaths[i], &load.m_ImageStamp);
+        if (load.m_BlobRead.m_Packed)
+        {
+            model->m_Textures[i] = CreateModelTexture(device, model, i, &load, texture_tail_size);
+            continue;
+        }
+        SubmitFileBatch(device->m_FileQueue, &texture_batch, &load.m_BlobRead, 1);
+    }
+    while (FileRead* read = WaitFileBatch(device->m_FileQueue, &texture_batch))
+    {
+        const uint32_t i = static_cast<uint32_t>((reinterpret_cast<uint8_t*>(read) - reinterpret_cast<uint8_t*>(texture_loads.Data())) / sizeof(TextureLoad));
+        TextureLoad& load = texture_loads[i];
+        if (read == &load.m_BlobRead && texture_image_exists[i] &&
+            !(load.m_BlobRead.m_Loaded && IsBlobStampCurrent(load.m_BlobRead.m_MappedFile.m_Data, load.m_BlobRead.m_MappedFile.m_Size, load.m_ImageStamp, GetTextureBlobFlags(device))))
+        {
+            SubmitFileBatch(device->m_FileQueue, &texture_batch, &load.m_ImageRead, 1);
+            continue;
+        }
+        model->m_Textures[i] = CreateModelTexture(device, model, i, &load, texture_tail_size);
+    }
+    for (uint32_t i = 0; model->m_TextureStreaming && i < texture_count; ++i)
     {
-        const char* texture_filepath = static_cast<const char*>(stream.Read());
-        model->m_Textures[i] = GfxLoadTexture(device, texture_filepath);
+        ModelTextureStreaming::Texture& texture = model->m_TextureStreaming->m_Textures[i];
+        texture.m_ResidentMip = model->m_Textures[i] ? GetTextureBlobTailMip(texture.m_Info, TEXTURE_STREAMING_TAIL_SIZE) : 0;
+        texture.m_TailMip = texture.m_ResidentMip;
+        texture.m_RequestedMip = texture.m_ResidentMip;
+        texture.m_LastSampledFrame = device->m_FrameIndex;
+        texture.m_Failed = model->m_Textures[i] == NULL;
     }
+    if (model->m_TextureStreaming)
+        device->m_StreamingModels.Push(model);
 
     memcpy(model->m_BoundingBoxMin, stream.ReadFloat3(), sizeof(float) * 3);
     memcpy(model->m_BoundingBoxMax, stream.ReadFloat3(), sizeof(float) * 3);
 
+    size_t mesh_bounds_size = 0;
+    const void* mesh_bounds_data = stream.Read(&mesh_bounds_size);
+    model->m_MeshBoundsStride = (model->m_Meshes.Count() + 7) & ~7u;
+    model->m_MeshBounds.Resize(static_cast<uint32_t>(mesh_bounds_size / sizeof(float)));
+    ASSERT(model->m_MeshBounds.Count() == model->m_MeshBoundsStride * GfxModel_T::MESH_BOUNDS_STREAM_COUNT);
+    memcpy(model->m_MeshBounds.Data(), mesh_bounds_data, mesh_bounds_size);
+
+    size_t meshlets_size = 0;
+    const void* meshlets_data = stream.Read(&meshlets_size);
+    model->m_Meshlets.Resize(static_cast<uint32_t>(meshlets_size / sizeof(GfxModel_T::Meshlet)));
+    memcpy(model->m_Meshlets.Data(), meshlets_data, meshlets_size);
+    model->m_Meshlet16Count = 0;
+    while (model->m_Meshlet16Count < model->m_Meshlets.Count() && model->m_Meshlets[model->m_Meshlet16Count].m_MeshIndex < model->m_Mesh16Count)
+        ++model->m_Meshlet16Count;
+
     model->m_QuantizationScale = stream.ReadFloat();
 
     uint32_t vertex_buffer_size = 0;
@@ -357,61 +1645,178 @@ static GfxModel CreateModel(GfxDevice device, const Blob& blob)
                 vertex_buffer_size += sizeof(uint16_t) * 2 * total_vertex_count;
                 break;
             case GFX_MODEL_VERTEX_ATTRIBUTE_NORMAL:
-                vertex_buffer_size += sizeof(uint8_t) * 4 * total_vertex_count;
+                vertex_buffer_size += sizeof(int16_t) * 2 * total_vertex_count;
+                break;
+            case GFX_MODEL_VERTEX_ATTRIBUTE_TANGENT_FRAME:
+                vertex_buffer_size += sizeof(int16_t) * 4 * total_vertex_count;
                 break;
         }
     }
 
+    StreamSection vertex_sections[GFX_MODEL_VERTEX_ATTRIBUTE_COUNT];
+    for (uint32_t attribute = 0; attribute < GFX_MODEL_VERTEX_ATTRIBUTE_COUNT; ++attribute)
+    {
+        vertex_sections[attribute] = stream.ReadSection();
+        ASSERT(vertex_sections[attribute].m_Size == (attribute + 1 < GFX_MODEL_VERTEX_ATTRIBUTE_COUNT ? model->m_VertexBufferOffsets[attribute + 1] : vertex_buffer_size) - model->m_VertexBufferOffsets[attribute]);
+    }
+
     GfxCreateBufferParams vertex_buffer_params;
     vertex_buffer_params.m_Usage = GFX_BUFFER_USAGE_VERTEX_BUFFER_BIT;
     vertex_buffer_params.m_Size = vertex_buffer_size;
-    vertex_buffer_params.m_Data = stream.GetPtr();
-    model->m_VertexBuffer = GfxCreateBuffer(device, vertex_buffer_params);
+    model->m_VertexBuffer = CreateBufferFromSections(device, vertex_buffer_params, vertex_sections, GFX_MODEL_VERTEX_ATTRIBUTE_COUNT);
 
-    stream.IncrPtr(vertex_buffer_params.m_Size);
+    StreamSection index_section = stream.ReadSection();
 
     GfxCreateBufferParams index_buffer_params;
     index_buffer_params.m_Usage = GFX_BUFFER_USAGE_INDEX_BUFFER_BIT;
-    index_buffer_params.m_Size = sizeof(uint32_t) * total_index_count;
-    index_buffer_params.m_Data = stream.GetPtr();
-    model->m_IndexBuffer = GfxCreateBuffer(device, index_buffer_params);
-
-    stream.IncrPtr(index_buffer_params.m_Size);
+    model->m_IndexBuffer32Offset = (sizeof(uint16_t) * total_index16_count + 3) & ~3u;
+    index_buffer_params.m_Size = model->m_IndexBuffer32Offset + sizeof(uint32_t) * total_index32_count;
+    ASSERT(index_section.m_Size == index_buffer_params.m_Size);
+    model->m_IndexBuffer = CreateBufferFromSections(device, index_buffer_params, &index_section, 1);
 
     ASSERT(stream.IsEndOfStream());
 
+    const uint32_t mesh_count = model->m_Meshes.Count();
+    Array<GfxDrawIndexedIndirectCommand> indirect_commands(mesh_count);
+    Array<GfxModelDrawData> draw_data(mesh_count);
+    Array<float> mesh_bounds(mesh_count * 8);
+    for (uint32_t i = 0; i < mesh_count; ++i)
+    {
+        const GfxModel_T::Mesh& mesh = model->m_Meshes[i];
+
+        indirect_commands[i].m_IndexCount = mesh.m_IndexCount;
+        indirect_commands[i].m_InstanceCount = 1;
+        indirect_commands[i].m_FirstIndex = mesh.m_IndexOffset;
+        indirect_commands[i].m_VertexOffset = static_cast<int32_t>(mesh.m_VertexOffset);
+        indirect_commands[i].m_FirstInstance = i;
+
+        draw_data[i].m_MeshIndex = i;
+        draw_data[i].m_MaterialIndex = mesh.m_MaterialIndex;
+        draw_data[i].m_DiffuseTextureIndex = mesh.m_MaterialIndex < model->m_Materials.Count() ? model->m_Materials[mesh.m_MaterialIndex].m_DiffuseTextureIndex : -1;
+        draw_data[i].m_Padding = 0;
+
+        float* bounds = &mesh_bounds[i * 8];
+        GfxGetModelMeshBoundingBox(model, i, bounds + 0, bounds + 4);
+        bounds[3] = 1.0f;
+        bounds[7] = 1.0f;
+    }
+
+    GfxCreateBufferParams indirect_buffer_params;
+    indirect_buffer_params.m_Usage = GFX_BUFFER_USAGE_INDIRECT_BUFFER_BIT | GFX_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    indirect_buffer_params.m_Size = sizeof(GfxDrawIndexedIndirectCommand) * mesh_count;
+    indirect_buffer_params.m_Data = indirect_commands.Data();
+    model->m_IndirectBuffer = GfxCreateBuffer(device, indirect_buffer_params);
+
+    GfxCreateBufferParams draw_data_buffer_params;
+    draw_data_buffer_params.m_Usage = GFX_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    draw_data_buffer_params.m_Size = sizeof(GfxModelDrawData) * mesh_count;
+    draw_data_buffer_params.m_Data = draw_data.Data();
+    model->m_DrawDataBuffer = GfxCreateBuffer(device, draw_data_buffer_params);
+
+    // Only streaming models read feedback back, the others bind the device default feedback buffer
+    if (model->m_TextureStreaming)
+    {
+        GfxCreateBufferParams feedback_buffer_params;
+        feedback_buffer_params.m_Usage = GFX_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        feedback_buffer_params.m_Size = sizeof(uint32_t) * Max(model->m_Textures.Count(), 1);
+        model->m_FeedbackBuffers.Resize(device->m_CommandBuffers.Count());
+        model->m_FeedbackData.Resize(device->m_CommandBuffers.Count());
+        for (uint32_t i = 0; i < model->m_FeedbackBuffers.Count(); ++i)
+        {
+            void* feedback_data = NULL;
+            model->m_FeedbackBuffers[i] = CreateReadbackBuffer(device, feedback_buffer_params, &feedback_data);
+            model->m_FeedbackData[i] = static_cast<uint32_t*>(feedback_data);
+            memset(feedback_data, 0, feedback_buffer_params.m_Size);
+        }
+    }
+
+    GfxCreateBufferParams mesh_bounds_buffer_params;
+    mesh_bounds_buffer_params.m_Usage = GFX_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    mesh_bounds_buffer_params.m_Size = sizeof(float) * mesh_bounds.Count();
+    mesh_bounds_buffer_params.m_Data = mesh_bounds.Data();
+    model->m_MeshBoundsBuffer = GfxCreateBuffer(device, mesh_bounds_buffer_params);
+
+    GfxCreateBufferParams meshlet_buffer_params;
+    meshlet_buffer_params.m_Usage = GFX_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    meshlet_buffer_params.m_Size = sizeof(GfxModel_T::Meshlet) * model->m_Meshlets.Count();
+    meshlet_buffer_params.m_Data = model->m_Meshlets.Data();
+    model->m_MeshletBuffer = GfxCreateBuffer(device, meshlet_buffer_params);
+
     return model;
 }
 
 void GfxDestroyModel(GfxDevice device, GfxModel model)
 {
+    if (ModelTextureStreaming* streaming = model->m_TextureStreaming)
+    {
+        for (uint32_t i = 0; i < device->m_StreamingModels.Count(); ++i)
+        {
+            if (device->m_StreamingModels[i] == model)
+            {
+                device->m_StreamingModels.EraseSwap(i);
+                break;
+            }
+        }
+        while (FileRead* read = WaitFileBatch(device->m_FileQueue, &streaming->m_Batch))
+            ReleaseFileRead(read);
+        for (uint32_t i = 0; i < streaming->m_Textures.Count(); ++i)
+        {
+            if (streaming->m_Textures[i].m_PendingTexture)
+                GfxDestroyTexture(device, streaming->m_Textures[i].m_PendingTexture);
+        }
+        for (uint32_t i = 0; i < streaming->m_RetiredTextures.Count(); ++i)
+            GfxDestroyTexture(device, streaming->m_RetiredTextures[i].m_Texture);
+        Delete<ModelTextureStreaming>(streaming);
+    }
+    for (uint32_t i = 0; i < model->m_FeedbackBuffers.Count(); ++i)
+        GfxDestroyBuffer(device, model->m_FeedbackBuffers[i]);
     for (uint32_t i = 0; i < model->m_Textures.Count(); ++i)
-        GfxDestroyTexture(device, model->m_Textures[i]);
+    {
+        if (model->m_Textures[i])
+            GfxDestroyTexture(device, model->m_Textures[i]);
+    }
     GfxDestroyBuffer(device, model->m_VertexBuffer);
     GfxDestroyBuffer(device, model->m_IndexBuffer);
+    GfxDestroyBuffer(device, model->m_IndirectBuffer);
+    GfxDestroyBuffer(device, model->m_DrawDataBuffer);
+    GfxDestroyBuffer(device, model->m_MeshBoundsBuffer);
+    GfxDestroyBuffer(device, model->m_MeshletBuffer);
     Delete<GfxModel_T>(model);
 }
 
 GfxModel GfxLoadModel(GfxDevice device, const char* filepath, const char* material_dir)
 {
-    const size_t filepath_len = strlen(filepath);
+    String blob_filepath = GetBlobFilepath(filepath);
 
-    size_t blob_filepath_offset = 0;
-    while (blob_filepath_offset < filepath_len &&
-        (filepath[blob_filepath_offset] == '.' ||
-         filepath[blob_filepath_offset] == '/' ||
-         filepath[blob_filepath_offset] == '\\'))
+    FileRead reads[2];
+    reads[0].m_Path = filepath;
+    reads[0].m_Mode = "r";
+    reads[1].m_Path = blob_filepath.Data();
+
+    // Packed blobs are used as they are without looking at the source file
+    const bool blob_packed = ResolvePackedFile(device, &reads[1]);
+
+    FileStamp model_stamp;
+    const bool model_exists = !blob_packed && GetFileStamp(filepath, &model_stamp);
+
+    // The model is only read when the blob is missing or was cooked from another version of it
+    FileBatch batch;
+    if (!blob_packed)
+    {
+        SubmitFileBatch(device->m_FileQueue, &batch, &reads[1], 1);
+        while (WaitFileBatch(device->m_FileQueue, &batch));
+    }
+    if (model_exists && !(reads[1].m_Loaded && IsBlobStampCurrent(reads[1].m_MappedFile.m_Data, reads[1].m_MappedFile.m_Size, model_stamp, GetModelBlobFlags(device))))
     {
-        ++blob_filepath_offset;
+        SubmitFileBatch(device->m_FileQueue, &batch, &reads[0], 1);
+        while (WaitFileBatch(device->m_FileQueue, &batch));
     }
-    String blob_filepath("Data/%s.blob", filepath + blob_filepath_offset);
 
-    void* model_data = NULL;
-    void* blob_data = NULL;
-    size_t model_size = 0;
-    size_t blob_size = 0;
-    bool model_loaded = ReadFile(filepath, "r", &model_data, &model_size);
-    bool blob_loaded = ReadFile(blob_filepath.Data(), "rb", &blob_data, &blob_size);
+    const void* model_data = reads[0].m_Data;
+    const size_t model_size = reads[0].m_Size;
+    const MappedFile& blob_file = reads[1].m_MappedFile;
+    const bool model_loaded = reads[0].m_Loaded;
+    const bool blob_loaded = reads[1].m_Loaded;
     if (!model_loaded && !blob_loaded)
     {
         Print("Error: Failed to read from file %s", filepath);
@@ -421,9 +1826,9 @@ GfxModel GfxLoadModel(GfxDevice device, const char* filepath, const char* materi
     bool create_new_blob = false;
     if (model_loaded && blob_loaded)
     {
-        uint64_t mesh_checksum = GfxHash(static_cast<const char*>(model_data), model_size);
-        uint64_t blob_checksum = *static_cast<const uint64_t*>(blob_data);
-        create_new_blob = mesh_checksum != blob_checksum;
+        create_new_blob = !IsBlobChecksumCurrent(blob_file.m_Data, blob_file.m_Size, model_data, model_size, GetModelBlobFlags(device));
+        if (!create_new_blob)
+            UpdateBlobSourceStamp(blob_filepath.Data(), model_stamp);
     }
     else if (model_loaded)
     {
@@ -433,13 +1838,14 @@ GfxModel GfxLoadModel(GfxDevice device, const char* filepath, const char* materi
     Blob blob;
     if (create_new_blob)
     {
-        blob = CreateModelBlob(model_data, model_size, material_dir ? material_dir : "");
+        // The stale blob is unmapped before its file is overwritten
+        ReleaseFileRead(&reads[1]);
+
+        blob = CreateModelBlob(model_data, model_size, model_stamp, material_dir ? material_dir : "", GetModelBlobFlags(device));
         if (!blob.m_Data || !blob.m_Size)
         {
-            if (model_loaded)
-                Free(model_data);
-            if (blob_loaded)
-                Free(blob_data);
+            ReleaseFileRead(&reads[0]);
+            ReleaseFileRead(&reads[1]);
             return NULL;
         }
         if (!WriteFile(blob_filepath.Data(), "wb", blob.m_Data, blob.m_Size))
@@ -447,20 +1853,15 @@ GfxModel GfxLoadModel(GfxDevice device, const char* filepath, const char* materi
             Print("Error: Failed to write to file %s", blob_filepath.Data());
         }
     }
-    else
-    {
-        blob.m_Data = blob_data;
-        blob.m_Size = blob_size;
-    }
 
-    GfxModel model = CreateModel(device, blob);
+    GfxModel model = create_new_blob ?
+        CreateModel(device, blob.m_Data, blob.m_Size) :
+        CreateModel(device, blob_file.m_Data, blob_file.m_Size);
 
     if (create_new_blob)
         DestroyBlob(blob);
-    if (model_loaded)
-        Free(model_data);
-    if (blob_loaded)
-        Free(blob_data);
+    ReleaseFileRead(&reads[0]);
+    ReleaseFileRead(&reads[1]);
 
     Print("Loaded %s", create_new_blob ? filepath : blob_filepath.Data());
 
@@ -480,6 +1881,238 @@ GfxTexture GfxGetModelDiffuseTexture(GfxModel model, uint32_t material_index)
     int32_t texture_index = model->m_Materials[material_index].m_DiffuseTextureIndex;
     return texture_index == -1 ? NULL : model->m_Textures[texture_index];
 }
+uint32_t GfxGetModelTextureCount(GfxModel model)
+{
+    return model->m_Textures.Count();
+}
+const GfxTexture* GfxGetModelTextures(GfxModel model)
+{
+    return model->m_Textures.Data();
+}
+
+// Finest mip at least as wide as the width the feedback holds
+static uint32_t FindRequestedMip(const TextureBlobInfo& info, uint32_t feedback_width)
+{
+    uint32_t mip = 0;
+    while (mip + 1 < info.m_MipCount && (info.m_Width >> (mip + 1)) >= feedback_width)
+        ++mip;
+    return mip;
+}
+
+// Device local size of a texture holding the mips from first_mip down
+static int64_t GetStreamedTextureSize(const TextureBlobInfo& info, uint32_t first_mip)
+{
+    return static_cast<int64_t>(GetTextureDataSize(info.m_Format, Max(info.m_Width >> first_mip, 1), Max(info.m_Height >> first_mip, 1), info.m_MipCount - first_mip));
+}
+
+static void StartTextureRead(GfxDevice device, ModelTextureStreaming* streaming, uint32_t index, uint32_t read_mip)
+{
+    ModelTextureStreaming::Texture& texture = streaming->m_Textures[index];
+    texture.m_ReadMip = read_mip;
+    texture.m_Reading = true;
+
+    // Only the pages of mips the resident texture lacks are prefetched, all of them when it is evicted
+    FileRead& read = streaming->m_Reads[index];
+    read = FileRead();
+    read.m_Path = texture.m_BlobFilepath.Data();
+    read.m_PrefetchOffset = texture.m_Info.m_MipOffsets[read_mip];
+    read.m_PrefetchSize = (read_mip < texture.m_ResidentMip ? texture.m_Info.m_MipOffsets[texture.m_ResidentMip] : texture.m_Info.m_BlobSize) - read.m_PrefetchOffset;
+    ResolvePackedFile(device, &read);
+    SubmitFileBatch(device->m_FileQueue, &streaming->m_Batch, &read, 1);
+    ++streaming->m_ReadCount;
+}
+
+// Works out what streamed textures will use once the reads in flight land, evicting the least recently sampled ones
+// to their tail while that is over budget. What is left over is the headroom stream-in may use this frame.
+static void UpdateStreamingBudget(GfxDevice device)
+{
+    int64_t usage = static_cast<int64_t>(device->m_MemoryBudget.m_Usage);
+    for (uint32_t m = 0; m < device->m_StreamingModels.Count(); ++m)
+    {
+        GfxModel model = device->m_StreamingModels[m];
+        ModelTextureStreaming* streaming = model->m_TextureStreaming;
+        for (uint32_t i = 0; i < streaming->m_RetiredTextures.Count(); ++i)
+            usage -= streaming->m_RetiredTextures[i].m_Texture->m_AllocationSize;
+        for (uint32_t i = 0; i < streaming->m_Textures.Count(); ++i)
+        {
+            const ModelTextureStreaming::Texture& texture = streaming->m_Textures[i];
+            if (texture.m_Reading)
+                usage += GetStreamedTextureSize(texture.m_Info, texture.m_ReadMip) - model->m_Textures[i]->m_AllocationSize;
+            else if (texture.m_PendingTexture)
+                usage -= model->m_Textures[i]->m_AllocationSize;
+        }
+    }
+
+    // Textures sampled by a frame that may still be in flight are left alone
+    const int64_t budget = static_cast<int64_t>(device->m_MemoryBudget.m_Budget);
+    const uint64_t recent_frame_count = device->m_CommandBuffers.Count() + 1;
+    while (usage > budget)
+    {
+        GfxModel evict_model = NULL;
+        uint32_t evict_index = 0;
+        uint64_t evict_frame = device->m_FrameIndex;
+        for (uint32_t m = 0; m < device->m_StreamingModels.Count(); ++m)
+        {
+            GfxModel model = device->m_StreamingModels[m];
+            ModelTextureStreaming* streaming = model->m_TextureStreaming;
+            for (uint32_t i = 0; i < streaming->m_Textures.Count(); ++i)
+            {
+                const ModelTextureStreaming::Texture& texture = streaming->m_Textures[i];
+                if (!texture.m_Failed && !texture.m_Reading && !texture.m_PendingTexture && texture.m_ResidentMip < texture.m_TailMip &&
+                    texture.m_LastSampledFrame + recent_frame_count <= device->m_FrameIndex && texture.m_LastSampledFrame < evict_frame)
+                {
+                    evict_model = model;
+                    evict_index = i;
+                    evict_frame = texture.m_LastSampledFrame;
+                }
+            }
+        }
+        if (evict_model == NULL)
+            break;
+
+        ModelTextureStreaming::Texture& texture = evict_model->m_TextureStreaming->m_Textures[evict_index];
+        usage -= evict_model->m_Textures[evict_index]->m_AllocationSize - GetStreamedTextureSize(texture.m_Info, texture.m_TailMip);
+        texture.m_RequestedMip = texture.m_TailMip;
+        StartTextureRead(device, evict_model->m_TextureStreaming, evict_index, texture.m_TailMip);
+    }
+
+    device->m_StreamingHeadroom = budget - usage;
+    device->m_StreamingBudgetFrame = device->m_FrameIndex;
+}
+
+void GfxUpdateModelTextureStreaming(GfxDevice device, GfxModel model)
+{
+    ModelTextureStreaming* streaming = model->m_TextureStreaming;
+    if (streaming == NULL)
+        return;
+
+    // GfxBeginFrame waited for the last frame that used this buffer, so it holds everything that frame sampled
+    uint32_t* feedback = model->m_FeedbackData[device->m_CommandBufferIndexCurr % model->m_FeedbackData.Count()];
+
+    for (uint32_t i = 0; i < streaming->m_RetiredTextures.Count();)
+    {
+        if (--streaming->m_RetiredTextures[i].m_UpdateCount == 0)
+        {
+            GfxDestroyTexture(device, streaming->m_RetiredTextures[i].m_Texture);
+            streaming->m_RetiredTextures.EraseSwap(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    for (uint32_t i = 0; i < streaming->m_Textures.Count(); ++i)
+    {
+        ModelTextureStreaming::Texture& texture = streaming->m_Textures[i];
+
+        // Textures created by the last update had their upload recorded at the start of this frame, ahead of any draw
+        if (texture.m_PendingTexture)
+        {
+            ModelTextureStreaming::RetiredTexture retired;
+            retired.m_Texture = model->m_Textures[i];
+            retired.m_UpdateCount = device->m_CommandBuffers.Count();
+            streaming->m_RetiredTextures.Push(retired);
+
+            model->m_Textures[i] = texture.m_PendingTexture;
+            texture.m_ResidentMip = texture.m_ReadMip;
+            texture.m_PendingTexture = NULL;
+        }
+
+        // Mips are only ever added, textures that go unsampled keep what they have
+        if (feedback[i] > 0)
+        {
+            texture.m_RequestedMip = Min(texture.m_RequestedMip, FindRequestedMip(texture.m_Info, feedback[i]));
+            texture.m_LastSampledFrame = device->m_FrameIndex;
+        }
+    }
+    memset(feedback, 0, static_cast<size_t>(model->m_FeedbackBuffers[0]->m_Size));
+
+    // The file workers have faulted in the pages of the new mips, what is left here is decoding into staging memory
+    while (FileRead* read = PollFileBatch(device->m_FileQueue, &streaming->m_Batch))
+    {
+        const uint32_t i = static_cast<uint32_t>(read - streaming->m_Reads.Data());
+        ModelTextureStreaming::Texture& texture = streaming->m_Textures[i];
+        const MappedFile& blob_file = read->m_MappedFile;
+        if (read->m_Loaded && blob_file.m_Size == texture.m_Info.m_BlobSize && static_cast<const BlobHeader*>(blob_file.m_Data)->m_Checksum == texture.m_Info.m_Checksum)
+        {
+            texture.m_PendingTexture = CreateTextureFromBlob(device, blob_file.m_Data, texture.m_Info, texture.m_ReadMip);
+        }
+        else
+        {
+            Print("Error: Failed to stream %s, it is missing or was cooked again", texture.m_BlobFilepath.Data());
+            texture.m_Failed = true;
+        }
+        ReleaseFileRead(read);
+        texture.m_Reading = false;
+        --streaming->m_ReadCount;
+    }
+
+    if (device->m_StreamingBudgetFrame != device->m_FrameIndex)
+        UpdateStreamingBudget(device);
+
+    // Textures missing the most mips are read first, each with as many of its requested mips as the budget has room for
+    Array<uint8_t> skipped(streaming->m_Textures.Count());
+    memset(skipped.Data(), 0, skipped.Count());
+    while (streaming->m_ReadCount < TEXTURE_STREAMING_MAX_READS)
+    {
+        uint32_t read_index = ~0U;
+        uint32_t read_mip_count = 0;
+        for (uint32_t i = 0; i < streaming->m_Textures.Count(); ++i)
+        {
+            const ModelTextureStreaming::Texture& texture = streaming->m_Textures[i];
+            if (!skipped[i] && !texture.m_Failed && !texture.m_Reading && !texture.m_PendingTexture && texture.m_RequestedMip < texture.m_ResidentMip && texture.m_ResidentMip - texture.m_RequestedMip > read_mip_count)
+            {
+                read_index = i;
+                read_mip_count = texture.m_ResidentMip - texture.m_RequestedMip;
+            }
+        }
+        if (read_index == ~0U)
+            break;
+
+        const ModelTextureStreaming::Texture& texture = streaming->m_Textures[read_index];
+        const int64_t resident_size = model->m_Textures[read_index]->m_AllocationSize;
+        uint32_t read_mip = texture.m_RequestedMip;
+        while (read_mip < texture.m_ResidentMip && GetStreamedTextureSize(texture.m_Info, read_mip) - resident_size > device->m_StreamingHeadroom)
+            ++read_mip;
+        if (read_mip == texture.m_ResidentMip)
+        {
+            skipped[read_index] = 1;
+            continue;
+        }
+
+        device->m_StreamingHeadroom -= GetStreamedTextureSize(texture.m_Info, read_mip) - resident_size;
+        StartTextureRead(device, streaming, read_index, read_mip);
+    }
+}
+void GfxCmdSetModelTextureFeedback(GfxCommandBuffer cmd, uint64_t hash, GfxModel model)
+{
+    GfxBuffer buffer = cmd->m_Device->m_DefaultFeedback;
+    if (model->m_FeedbackBuffers.Count() > 0)
+        buffer = model->m_FeedbackBuffers[cmd->m_Device->m_CommandBufferIndexCurr % model->m_FeedbackBuffers.Count()];
+    GfxCmdSetBuffer(cmd, hash, buffer, 0, buffer->m_Size);
+}
+
+void GfxGetModelMeshBoundingBox(GfxModel model, uint32_t mesh_index, float out_min[3], float out_max[3])
+{
+    const float* bounds = model->m_MeshBounds.Data() + mesh_index;
+    const uint32_t stride = model->m_MeshBoundsStride;
+    out_min[0] = bounds[GfxModel_T::MESH_BOUNDS_MIN_X * stride];
+    out_min[1] = bounds[GfxModel_T::MESH_BOUNDS_MIN_Y * stride];
+    out_min[2] = bounds[GfxModel_T::MESH_BOUNDS_MIN_Z * stride];
+    out_max[0] = bounds[GfxModel_T::MESH_BOUNDS_MAX_X * stride];
+    out_max[1] = bounds[GfxModel_T::MESH_BOUNDS_MAX_Y * stride];
+    out_max[2] = bounds[GfxModel_T::MESH_BOUNDS_MAX_Z * stride];
+}
+void GfxGetModelMeshBoundingSphere(GfxModel model, uint32_t mesh_index, float out_center[3], float* out_radius)
+{
+    const float* bounds = model->m_MeshBounds.Data() + mesh_index;
+    const uint32_t stride = model->m_MeshBoundsStride;
+    out_center[0] = bounds[GfxModel_T::MESH_BOUNDS_SPHERE_X * stride];
+    out_center[1] = bounds[GfxModel_T::MESH_BOUNDS_SPHERE_Y * stride];
+    out_center[2] = bounds[GfxModel_T::MESH_BOUNDS_SPHERE_Z * stride];
+    *out_radius = bounds[GfxModel_T::MESH_BOUNDS_SPHERE_RADIUS * stride];
+}
 const float* GfxGetModelBoundingBoxMin(GfxModel model)
 {
     return model->m_BoundingBoxMin;
@@ -493,15 +2126,341 @@ float GfxGetModelQuantizationScale(GfxModel model)
     return model->m_QuantizationScale;
 }
 
+uint32_t GfxCullModelMeshes(GfxModel model, const float view_proj[16], uint32_t* out_visible)
+{
+    float planes[6][4];
+    ExtractFrustumPlanes(view_proj, planes);
+
+    // Only the box corner farthest along each plane normal needs testing, with structure of arrays
+    // the corner is picked once per plane rather than per mesh
+    const float* corner_x[6];
+    const float* corner_y[6];
+    const float* corner_z[6];
+    const float* bounds = model->m_MeshBounds.Data();
+    const uint32_t stride = model->m_MeshBoundsStride;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        corner_x[i] = bounds + stride * (planes[i][0] >= 0.0f ? GfxModel_T::MESH_BOUNDS_MAX_X : GfxModel_T::MESH_BOUNDS_MIN_X);
+        corner_y[i] = bounds + stride * (planes[i][1] >= 0.0f ? GfxModel_T::MESH_BOUNDS_MAX_Y : GfxModel_T::MESH_BOUNDS_MIN_Y);
+        corner_z[i] = bounds + stride * (planes[i][2] >= 0.0f ? GfxModel_T::MESH_BOUNDS_MAX_Z : GfxModel_T::MESH_BOUNDS_MIN_Z);
+    }
+
+    const uint32_t mesh_count = model->m_Meshes.Count();
+    uint32_t visible_count = 0;
+    for (uint32_t i = 0; i < mesh_count; i += 8)
+    {
+        uint32_t visible_mask = 0xff;
+#if defined(_M_X64) || defined(__SSE2__)
+        for (uint32_t j = 0; j < 6; ++j)
+        {
+            const __m128 w = _mm_set1_ps(planes[j][3]);
+            const __m128 x = _mm_set1_ps(planes[j][0]);
+            const __m128 y = _mm_set1_ps(planes[j][1]);
+            const __m128 z = _mm_set1_ps(planes[j][2]);
+            __m128 d0 = _mm_add_ps(w, _mm_mul_ps(x, _mm_loadu_ps(corner_x[j] + i + 0)));
+            __m128 d1 = _mm_add_ps(w, _mm_mul_ps(x, _mm_loadu_ps(corner_x[j] + i + 4)));
+            d0 = _mm_add_ps(d0, _mm_mul_ps(y, _mm_loadu_ps(corner_y[j] + i + 0)));
+            d1 = _mm_add_ps(d1, _mm_mul_ps(y, _mm_loadu_ps(corner_y[j] + i + 4)));
+            d0 = _mm_add_ps(d0, _mm_mul_ps(z, _mm_loadu_ps(corner_z[j] + i + 0)));
+            d1 = _mm_add_ps(d1, _mm_mul_ps(z, _mm_loadu_ps(corner_z[j] + i + 4)));
+            visible_mask &= ~static_cast<uint32_t>(_mm_movemask_ps(d0) | (_mm_movemask_ps(d1) << 4));
+        }
+#else
+        for (uint32_t j = 0; j < 6; ++j)
+        {
+            for (uint32_t k = 0; k < 8; ++k)
+            {
+                const float d = planes[j][3] + planes[j][0] * corner_x[j][i + k] + planes[j][1] * corner_y[j][i + k] + planes[j][2] * corner_z[j][i + k];
+                visible_mask &= ~(static_cast<uint32_t>(d < 0.0f) << k);
+            }
+        }
+#endif
+        // Padding meshes past the end are never written since the write index can't pass the mesh index
+        const uint32_t lane_count = mesh_count - i < 8 ? mesh_count - i : 8;
+        for (uint32_t k = 0; k < lane_count; ++k)
+        {
+            out_visible[visible_count] = i + k;
+            visible_count += (visible_mask >> k) & 1;
+        }
+    }
+    return visible_count;
+}
+
 void GfxCmdBindModelVertexBuffer(GfxCommandBuffer cmd, GfxModel model, GfxModelVertexAttribute attribute, uint32_t binding)
 {
     GfxCmdBindVertexBuffer(cmd, binding, model->m_VertexBuffer, model->m_VertexBufferOffsets[attribute]);
 }
+static void BindModelIndexBuffer(GfxCommandBuffer cmd, GfxModel model, uint32_t index_size)
+{
+    GfxCmdBindIndexBuffer(cmd, model->m_IndexBuffer, index_size == sizeof(uint16_t) ? 0 : model->m_IndexBuffer32Offset, index_size);
+}
+// The first draw16_count commands use 16-bit indices and the rest 32-bit indices, count_buffer holds one count for each when set
+static void DrawModelIndexedIndirect(GfxCommandBuffer cmd, GfxModel model, GfxBuffer buffer, uint64_t offset, uint32_t draw16_count, uint32_t draw_count, GfxBuffer count_buffer)
+{
+    if (draw16_count > 0)
+    {
+        BindModelIndexBuffer(cmd, model, sizeof(uint16_t));
+        if (count_buffer)
+            GfxCmdDrawIndexedIndirectCount(cmd, buffer, offset, count_buffer, 0, draw16_count);
+        else
+            GfxCmdDrawIndexedIndirect(cmd, buffer, offset, draw16_count);
+    }
+    if (draw_count > draw16_count)
+    {
+        const uint64_t offset32 = offset + sizeof(GfxDrawIndexedIndirectCommand) * draw16_count;
+        BindModelIndexBuffer(cmd, model, sizeof(uint32_t));
+        if (count_buffer)
+            GfxCmdDrawIndexedIndirectCount(cmd, buffer, offset32, count_buffer, sizeof(uint32_t), draw_count - draw16_count);
+        else
+            GfxCmdDrawIndexedIndirect(cmd, buffer, offset32, draw_count - draw16_count);
+    }
+}
+
 void GfxCmdBindModelIndexBuffer(GfxCommandBuffer cmd, GfxModel model)
 {
-    GfxCmdBindIndexBuffer(cmd, model->m_IndexBuffer, 0, sizeof(uint32_t));
+    BindModelIndexBuffer(cmd, model, model->m_Mesh16Count > 0 ? sizeof(uint16_t) : sizeof(uint32_t));
 }
 void GfxCmdDrawModel(GfxCommandBuffer cmd, GfxModel model, uint32_t mesh_index, uint32_t instance_count)
 {
-    GfxCmdDrawIndexed(cmd, model->m_Meshes[mesh_index].m_IndexCount, instance_count, model->m_Meshes[mesh_index].m_IndexOffset, model->m_Meshes[mesh_index].m_VertexOffset);
+    const GfxModel_T::Mesh& mesh = model->m_Meshes[mesh_index];
+    BindModelIndexBuffer(cmd, model, mesh.m_IndexSize);
+    GfxCmdDrawIndexed(cmd, mesh.m_IndexCount, instance_count, mesh.m_IndexOffset, mesh.m_VertexOffset);
+}
+
+uint32_t GfxGetModelMeshLodCount(GfxModel model, uint32_t mesh_index)
+{
+    return model->m_Meshes[mesh_index].m_LodCount;
+}
+uint32_t GfxSelectModelMeshLod(GfxModel model, uint32_t mesh_index, const float world[16], const float camera_position[3], float projection_scale, float max_pixel_error)
+{
+    const GfxModel_T::Mesh& mesh = model->m_Meshes[mesh_index];
+
+    float center[3];
+    float radius;
+    GfxGetModelMeshBoundingSphere(model, mesh_index, center, &radius);
+
+    // Errors are in model space, scale them by the largest world axis to stay conservative
+    float scale = 0.0f;
+    for (uint32_t i = 0; i < 3; ++i)
+        scale = glm::max(scale, world[i * 4 + 0] * world[i * 4 + 0] + world[i * 4 + 1] * world[i * 4 + 1] + world[i * 4 + 2] * world[i * 4 + 2]);
+    scale = sqrtf(scale);
+
+    float distance = 0.0f;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        const float world_center = world[0 * 4 + i] * center[0] + world[1 * 4 + i] * center[1] + world[2 * 4 + i] * center[2] + world[3 * 4 + i];
+        distance += (world_center - camera_position[i]) * (world_center - camera_position[i]);
+    }
+    distance = sqrtf(distance) - radius * scale;
+    if (distance <= 0.0f)
+        return 0;
+
+    uint32_t lod = 0;
+    while (lod + 1 < mesh.m_LodCount && mesh.m_Lods[lod + 1].m_Error * scale * projection_scale / distance <= max_pixel_error)
+        ++lod;
+    return lod;
+}
+void GfxCmdDrawModelLod(GfxCommandBuffer cmd, GfxModel model, uint32_t mesh_index, uint32_t lod, uint32_t instance_count)
+{
+    const GfxModel_T::Mesh& mesh = model->m_Meshes[mesh_index];
+    const GfxModel_T::Lod& mesh_lod = mesh.m_Lods[glm::min(lod, mesh.m_LodCount - 1)];
+    BindModelIndexBuffer(cmd, model, mesh.m_IndexSize);
+    GfxCmdDrawIndexed(cmd, mesh_lod.m_IndexCount, instance_count, mesh_lod.m_IndexOffset, mesh.m_VertexOffset);
+}
+
+void GfxCmdSetModelDrawData(GfxCommandBuffer cmd, uint64_t hash, GfxModel model)
+{
+    GfxCmdSetBuffer(cmd, hash, model->m_DrawDataBuffer, 0, model->m_DrawDataBuffer->m_Size);
+}
+void GfxCmdDrawModelMeshes(GfxCommandBuffer cmd, GfxModel model, const uint32_t* mesh_indices, uint32_t mesh_index_count, uint32_t instance_count, const uint32_t* lods)
+{
+    if (mesh_index_count == 0)
+        return;
+
+    if (!cmd->m_Device->m_Caps.m_DrawIndirectFirstInstance)
+    {
+        for (uint32_t i = 0; i < mesh_index_count; ++i)
+        {
+            const GfxModel_T::Mesh& mesh = model->m_Meshes[mesh_indices[i]];
+            const GfxModel_T::Lod& mesh_lod = mesh.m_Lods[lods ? glm::min(lods[i], mesh.m_LodCount - 1) : 0];
+            BindModelIndexBuffer(cmd, model, mesh.m_IndexSize);
+            GfxCmdDrawIndexed(cmd, mesh_lod.m_IndexCount, instance_count, mesh_lod.m_IndexOffset, mesh.m_VertexOffset, mesh_indices[i] * instance_count);
+        }
+        return;
+    }
+
+    GfxAllocation allocation = GfxAllocateUploadBuffer(cmd->m_Device, sizeof(GfxDrawIndexedIndirectCommand) * mesh_index_count);
+    GfxDrawIndexedIndirectCommand* commands = reinterpret_cast<GfxDrawIndexedIndirectCommand*>(allocation.m_Data);
+    for (uint32_t i = 0; i < mesh_index_count; ++i)
+    {
+        const GfxModel_T::Mesh& mesh = model->m_Meshes[mesh_indices[i]];
+        const GfxModel_T::Lod& mesh_lod = mesh.m_Lods[lods ? glm::min(lods[i], mesh.m_LodCount - 1) : 0];
+        commands[i].m_IndexCount = mesh_lod.m_IndexCount;
+        commands[i].m_InstanceCount = instance_count;
+        commands[i].m_FirstIndex = mesh_lod.m_IndexOffset;
+        commands[i].m_VertexOffset = static_cast<int32_t>(mesh.m_VertexOffset);
+        commands[i].m_FirstInstance = mesh_indices[i] * instance_count;
+    }
+
+    // One multi draw per run of meshes with the same index size
+    for (uint32_t i = 0, j = 0; i < mesh_index_count; i = j)
+    {
+        const uint32_t index_size = model->m_Meshes[mesh_indices[i]].m_IndexSize;
+        while (j < mesh_index_count && model->m_Meshes[mesh_indices[j]].m_IndexSize == index_size)
+            ++j;
+        BindModelIndexBuffer(cmd, model, index_size);
+        GfxCmdDrawIndexedIndirect(cmd, allocation.m_Buffer, allocation.m_Offset + sizeof(GfxDrawIndexedIndirectCommand) * i, j - i);
+    }
+}
+void GfxCmdDrawModelAll(GfxCommandBuffer cmd, GfxModel model, uint32_t instance_count)
+{
+    const uint32_t mesh_count = model->m_Meshes.Count();
+
+    // Indirect draws can only offset the instance index with drawIndirectFirstInstance
+    if (!cmd->m_Device->m_Caps.m_DrawIndirectFirstInstance)
+    {
+        for (uint32_t i = 0; i < mesh_count; ++i)
+        {
+            const GfxModel_T::Mesh& mesh = model->m_Meshes[i];
+            BindModelIndexBuffer(cmd, model, mesh.m_IndexSize);
+            GfxCmdDrawIndexed(cmd, mesh.m_IndexCount, instance_count, mesh.m_IndexOffset, mesh.m_VertexOffset, i * instance_count);
+        }
+        return;
+    }
+
+    if (instance_count == 1)
+    {
+        DrawModelIndexedIndirect(cmd, model, model->m_IndirectBuffer, 0, model->m_Mesh16Count, mesh_count, NULL);
+    }
+    else
+    {
+        GfxAllocation allocation = GfxAllocateUploadBuffer(cmd->m_Device, sizeof(GfxDrawIndexedIndirectCommand) * mesh_count);
+        GfxDrawIndexedIndirectCommand* commands = reinterpret_cast<GfxDrawIndexedIndirectCommand*>(allocation.m_Data);
+        for (uint32_t i = 0; i < mesh_count; ++i)
+        {
+            commands[i].m_IndexCount = model->m_Meshes[i].m_IndexCount;
+            commands[i].m_InstanceCount = instance_count;
+            commands[i].m_FirstIndex = model->m_Meshes[i].m_IndexOffset;
+            commands[i].m_VertexOffset = static_cast<int32_t>(model->m_Meshes[i].m_VertexOffset);
+            commands[i].m_FirstInstance = i * instance_count;
+        }
+        DrawModelIndexedIndirect(cmd, model, allocation.m_Buffer, allocation.m_Offset, model->m_Mesh16Count, mesh_count, NULL);
+    }
+}
+
+void GfxCmdCullModel(GfxCommandBuffer cmd, GfxModel model, GfxBuffer instance_buffer, uint32_t instance_count, const float view_proj[16], GfxBuffer indirect_buffer, GfxBuffer count_buffer)
+{
+    ASSERT(cmd->m_Technique == NULL);
+
+    GfxDevice device = cmd->m_Device;
+    if (!device->m_CullModelTechnique)
+        device->m_CullModelTechnique = CreateBuiltinTechnique(device, "CullModel", s_CullModelTechnique);
+
+    const uint32_t mesh_count = model->m_Meshes.Count();
+    const bool compact = device->m_Caps.m_DrawIndirectCount;
+
+    GfxCmdTransitionBuffer(cmd, indirect_buffer, GFX_BUFFER_ACCESS_INDIRECT_READ, GFX_BUFFER_ACCESS_SHADER_WRITE);
+    GfxCmdTransitionBuffer(cmd, count_buffer, GFX_BUFFER_ACCESS_INDIRECT_READ, GFX_BUFFER_ACCESS_COPY_DST);
+    vkCmdFillBuffer(cmd->m_CommandBuffer, count_buffer->m_Buffer, 0, sizeof(uint32_t) * 2, 0);
+    GfxCmdTransitionBuffer(cmd, count_buffer, GFX_BUFFER_ACCESS_COPY_DST, GFX_BUFFER_ACCESS_SHADER_WRITE);
+
+    GfxCmdBeginTechnique(cmd, device->m_CullModelTechnique);
+
+    GfxCmdSetBuffer(cmd, GFX_HASH("MeshBounds"), model->m_MeshBoundsBuffer, 0, model->m_MeshBoundsBuffer->m_Size);
+    GfxCmdSetBuffer(cmd, GFX_HASH("MeshCommands"), model->m_IndirectBuffer, 0, model->m_IndirectBuffer->m_Size);
+    GfxCmdSetBuffer(cmd, GFX_HASH("Instances"), instance_buffer, 0, sizeof(float) * 16 * instance_count);
+    GfxCmdSetBuffer(cmd, GFX_HASH("OutCommands"), indirect_buffer, 0, sizeof(GfxDrawIndexedIndirectCommand) * mesh_count * instance_count);
+    GfxCmdSetBuffer(cmd, GFX_HASH("OutCount"), count_buffer, 0, sizeof(uint32_t) * 2);
+
+    struct Constants
+    {
+        float       m_Planes[6][4];
+        uint32_t    m_MeshCount;
+        uint32_t    m_Mesh16Count;
+        uint32_t    m_InstanceCount;
+        uint32_t    m_Compact;
+    };
+    Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+    ExtractFrustumPlanes(view_proj, constants->m_Planes);
+    constants->m_MeshCount = mesh_count;
+    constants->m_Mesh16Count = model->m_Mesh16Count;
+    constants->m_InstanceCount = instance_count;
+    constants->m_Compact = compact ? 1 : 0;
+
+    const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(device->m_CullModelTechnique);
+    GfxCmdDispatch(cmd, (mesh_count * instance_count + work_group_size[0] - 1) / work_group_size[0], 1, 1);
+
+    GfxCmdEndTechnique(cmd);
+
+    GfxCmdTransitionBuffer(cmd, indirect_buffer, GFX_BUFFER_ACCESS_SHADER_WRITE, GFX_BUFFER_ACCESS_INDIRECT_READ);
+    GfxCmdTransitionBuffer(cmd, count_buffer, GFX_BUFFER_ACCESS_SHADER_WRITE, GFX_BUFFER_ACCESS_INDIRECT_READ);
+}
+void GfxCmdDrawModelCulled(GfxCommandBuffer cmd, GfxModel model, uint32_t instance_count, GfxBuffer indirect_buffer, GfxBuffer count_buffer)
+{
+    // The culled commands only exist on the GPU, so there is no per draw fallback
+    ASSERT(cmd->m_Device->m_Caps.m_DrawIndirectFirstInstance);
+
+    const bool compact = cmd->m_Device->m_Caps.m_DrawIndirectCount;
+    DrawModelIndexedIndirect(cmd, model, indirect_buffer, 0, model->m_Mesh16Count * instance_count, model->m_Meshes.Count() * instance_count, compact ? count_buffer : NULL);
+}
+
+uint32_t GfxGetModelMeshletCount(GfxModel model)
+{
+    return model->m_Meshlets.Count();
+}
+void GfxCmdCullModelMeshlets(GfxCommandBuffer cmd, GfxModel model, const float world[16], const float view_proj[16], const float camera_position[3], GfxBuffer indirect_buffer, GfxBuffer count_buffer)
+{
+    ASSERT(cmd->m_Technique == NULL);
+
+    GfxDevice device = cmd->m_Device;
+    if (!device->m_CullModelMeshletsTechnique)
+        device->m_CullModelMeshletsTechnique = CreateBuiltinTechnique(device, "CullModelMeshlets", s_CullModelMeshletsTechnique);
+
+    const uint32_t meshlet_count = model->m_Meshlets.Count();
+    const bool compact = device->m_Caps.m_DrawIndirectCount;
+
+    GfxCmdTransitionBuffer(cmd, indirect_buffer, GFX_BUFFER_ACCESS_INDIRECT_READ, GFX_BUFFER_ACCESS_SHADER_WRITE);
+    GfxCmdTransitionBuffer(cmd, count_buffer, GFX_BUFFER_ACCESS_INDIRECT_READ, GFX_BUFFER_ACCESS_COPY_DST);
+    vkCmdFillBuffer(cmd->m_CommandBuffer, count_buffer->m_Buffer, 0, sizeof(uint32_t) * 2, 0);
+    GfxCmdTransitionBuffer(cmd, count_buffer, GFX_BUFFER_ACCESS_COPY_DST, GFX_BUFFER_ACCESS_SHADER_WRITE);
+
+    GfxCmdBeginTechnique(cmd, device->m_CullModelMeshletsTechnique);
+
+    GfxCmdSetBuffer(cmd, GFX_HASH("Meshlets"), model->m_MeshletBuffer, 0, model->m_MeshletBuffer->m_Size);
+    GfxCmdSetBuffer(cmd, GFX_HASH("OutCommands"), indirect_buffer, 0, sizeof(GfxDrawIndexedIndirectCommand) * meshlet_count);
+    GfxCmdSetBuffer(cmd, GFX_HASH("OutCount"), count_buffer, 0, sizeof(uint32_t) * 2);
+
+    struct Constants
+    {
+        float       m_World[16];
+        float       m_Planes[6][4];
+        float       m_CameraPosition[4];
+        uint32_t    m_MeshletCount;
+        uint32_t    m_Meshlet16Count;
+        uint32_t    m_Compact;
+    };
+    Constants* constants = static_cast<Constants*>(GfxCmdAllocUploadBuffer(cmd, GFX_HASH("Constants"), sizeof(Constants)));
+    memcpy(constants->m_World, world, sizeof(float) * 16);
+    ExtractFrustumPlanes(view_proj, constants->m_Planes);
+    memcpy(constants->m_CameraPosition, camera_position, sizeof(float) * 3);
+    constants->m_CameraPosition[3] = 1.0f;
+    constants->m_MeshletCount = meshlet_count;
+    constants->m_Meshlet16Count = model->m_Meshlet16Count;
+    constants->m_Compact = compact ? 1 : 0;
+
+    const uint32_t* work_group_size = GfxGetTechniqueWorkGroupSize(device->m_CullModelMeshletsTechnique);
+    GfxCmdDispatch(cmd, (meshlet_count + work_group_size[0] - 1) / work_group_size[0], 1, 1);
+
+    GfxCmdEndTechnique(cmd);
+
+    GfxCmdTransitionBuffer(cmd, indirect_buffer, GFX_BUFFER_ACCESS_SHADER_WRITE, GFX_BUFFER_ACCESS_INDIRECT_READ);
+    GfxCmdTransitionBuffer(cmd, count_buffer, GFX_BUFFER_ACCESS_SHADER_WRITE, GFX_BUFFER_ACCESS_INDIRECT_READ);
+}
+void GfxCmdDrawModelMeshletsCulled(GfxCommandBuffer cmd, GfxModel model, GfxBuffer indirect_buffer, GfxBuffer count_buffer)
+{
+    // The first instance carries the mesh index, see GfxCmdDrawModelCulled
+    ASSERT(cmd->m_Device->m_Caps.m_DrawIndirectFirstInstance);
+
+    const bool compact = cmd->m_Device->m_Caps.m_DrawIndirectCount;
+    DrawModelIndexedIndirect(cmd, model, indirect_buffer, 0, model->m_Meshlet16Count, model->m_Meshlets.Count(), compact ? count_buffer : NULL);
 }
@@ -7,7 +7,32 @@
 #define pclose _pclose
 #endif
 
-static bool CompileShader(const char* src, const char* stage, void** out_data, size_t* out_size)
+static bool OptimizeShader(const char* src_filepath, const char* dst_filepath, const char* target_env, const char* flags)
+{
+#ifdef _WIN32
+    const char* executable_prefix = "";
+#else
+    const char* executable_prefix = "./";
+#endif
+    String command("%sspirv-opt --target-env=%s %s --strip-debug -o %s %s", executable_prefix, target_env, flags, dst_filepath, src_filepath);
+
+    FILE* stream = popen(command.Data(), "r");
+    if (!stream)
+        return false;
+
+    char stream_buf[2048];
+    while (fgets(stream_buf, sizeof(stream_buf), stream))
+    {
+        char* msg_end = strchr(stream_buf, '\n');
+        if (msg_end)
+            *msg_end = '\0';
+        Print("%s", stream_buf);
+    }
+
+    return pclose(stream) == 0 && FileExists(dst_filepath);
+}
+
+static bool CompileShader(const char* src, const char* stage, const char* target_env, const char* optimize_flags, void** out_data, size_t* out_size)
 {
     char src_filepath[L_tmpnam];
     char dst_filepath[L_tmpnam];
@@ -22,18 +47,21 @@ static bool CompileShader(const char* src, const char* stage, void** out_data, s
 #else
     const char* executable_prefix = "./";
 #endif
-    String command("%sglslangValidator -V -S %s -o %s %s", executable_prefix, stage, dst_filepath, src_filepath);
+    String command("%sglslangValidator -V --target-env %s -S %s -o %s %s", executable_prefix, target_env, stage, dst_filepath, src_filepath);
     
     FILE* stream = popen(command.Data(), "r");
     if (!stream)
         return false;
 
+    bool compile_error = false;
     char stream_buf[2048];
     while (fgets(stream_buf, sizeof(stream_buf), stream))
     {
         char* error = strstr(stream_buf, "ERROR");
         if (error)
         {
+            compile_error = true;
+
             char* line_nr_beg = error + strlen("ERROR: ") + strlen(src_filepath) + strlen(":");
             char* line_nr_end = strchr(line_nr_beg, ':');
             *line_nr_end = '\0';
@@ -71,10 +99,45 @@ static bool CompileShader(const char* src, const char* stage, void** out_data, s
         }
     }
 
-    pclose(stream);
+    compile_error |= pclose(stream) != 0;
 
     remove(src_filepath);
 
+    // The optimizer only ever sees SPIR-V that glslang produced
+    if (compile_error || !FileExists(dst_filepath))
+    {
+        Print("Error: Failed to compile %s shader", stage);
+        remove(dst_filepath);
+        return false;
+    }
+
+    if (optimize_flags)
+    {
+        char opt_filepath[L_tmpnam];
+        tmpnam(opt_filepath);
+
+        if (OptimizeShader(dst_filepath, opt_filepath, target_env, optimize_flags))
+        {
+            size_t unoptimized_size = 0;
+            void* unoptimized_data = NULL;
+            if (ReadFile(dst_filepath, "rb", &unoptimized_data, &unoptimized_size))
+                Free(unoptimized_data);
+            remove(dst_filepath);
+
+            if (!ReadFile(opt_filepath, "rb", out_data, out_size))
+                return false;
+
+            remove(opt_filepath);
+
+            Print("Optimized %s shader: %zu -> %zu bytes", stage, unoptimized_size, *out_size);
+
+            return true;
+        }
+
+        Print("Error: Failed to optimize %s shader, keeping unoptimized SPIR-V", stage);
+        remove(opt_filepath);
+    }
+
     if (!ReadFile(dst_filepath, "rb", out_data, out_size))
         return false;
 
@@ -83,7 +146,23 @@ static bool CompileShader(const char* src, const char* stage, void** out_data, s
     return true;
 }
 
-static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
+static const struct
+{
+    const char*                         m_Name;
+    VkSubgroupFeatureFlagBits           m_Feature;
+} s_SubgroupExtensions[] =
+{
+    { "subgroup_basic",             VK_SUBGROUP_FEATURE_BASIC_BIT               },
+    { "subgroup_vote",              VK_SUBGROUP_FEATURE_VOTE_BIT                },
+    { "subgroup_arithmetic",        VK_SUBGROUP_FEATURE_ARITHMETIC_BIT          },
+    { "subgroup_ballot",            VK_SUBGROUP_FEATURE_BALLOT_BIT              },
+    { "subgroup_shuffle",           VK_SUBGROUP_FEATURE_SHUFFLE_BIT             },
+    { "subgroup_shuffle_relative",  VK_SUBGROUP_FEATURE_SHUFFLE_RELATIVE_BIT    },
+    { "subgroup_clustered",         VK_SUBGROUP_FEATURE_CLUSTERED_BIT           },
+    { "subgroup_quad",              VK_SUBGROUP_FEATURE_QUAD_BIT                },
+};
+
+static Blob CreateTechniqueBlob(const void* json_data, size_t json_size, const FileStamp& json_stamp)
 {
     #define VERIFY(cond) if (!(cond)) { Print("Error: %s", #cond); free(root); return blob; }
 
@@ -116,13 +195,136 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
     VERIFY(has_vertex_shader || has_compute_shader);
     VERIFY(!(has_vertex_shader && has_compute_shader));
 
+    const char* optimize_flags = "-O";
+
+    String preamble("#version 450\n#extension GL_ARB_separate_shader_objects : enable\n#extension GL_ARB_shading_language_packing : enable\n");
+    VkSubgroupFeatureFlags subgroup_features = 0;
+
+    GfxTechniqueBlob_T::SpecializationConstant specialization_constants[ARRAY_COUNT(GfxTechniqueBlob_T::m_SpecializationConstants)];
+    uint32_t specialization_constant_count = 0;
+    String specialization_include;
+
+    curr_elem = root_elem;
+    while (curr_elem)
+    {
+        if (strcmp(curr_elem->name->string, "optimize") == 0)
+        {
+            VERIFY(curr_elem->value->type == json_type_string);
+            json_string_s* optimize_str = static_cast<json_string_s*>(curr_elem->value->payload);
+            if (strcmp(optimize_str->string, "performance") == 0)
+                optimize_flags = "-O";
+            else if (strcmp(optimize_str->string, "size") == 0)
+                optimize_flags = "-Os";
+            else
+            {
+                VERIFY(strcmp(optimize_str->string, "none") == 0);
+                optimize_flags = NULL;
+            }
+        }
+        else if (strcmp(curr_elem->name->string, "extensions") == 0)
+        {
+            VERIFY(curr_elem->value->type == json_type_array);
+            json_array_s* extensions = static_cast<json_array_s*>(curr_elem->value->payload);
+            for (json_array_element_s* extension = extensions->start; extension != NULL; extension = extension->next)
+            {
+                VERIFY(extension->value->type == json_type_string);
+                json_string_s* extension_str = static_cast<json_string_s*>(extension->value->payload);
+                uint32_t i = 0;
+                while (i < ARRAY_COUNT(s_SubgroupExtensions) && strcmp(extension_str->string, s_SubgroupExtensions[i].m_Name) != 0)
+                    ++i;
+                VERIFY(i < ARRAY_COUNT(s_SubgroupExtensions));
+                subgroup_features |= s_SubgroupExtensions[i].m_Feature;
+                preamble.AppendFormat("#extension GL_KHR_shader_%s : enable\n", s_SubgroupExtensions[i].m_Name);
+            }
+        }
+        else if (strcmp(curr_elem->name->string, "specialization_constants") == 0)
+        {
+            VERIFY(curr_elem->value->type == json_type_array);
+            json_array_s* constants = static_cast<json_array_s*>(curr_elem->value->payload);
+            VERIFY(constants->length <= ARRAY_COUNT(GfxTechniqueBlob_T::m_SpecializationConstants));
+            for (json_array_element_s* constant = constants->start; constant != NULL; constant = constant->next)
+            {
+                VERIFY(constant->value->type == json_type_object);
+                json_object_element_s* constant_elem = static_cast<json_object_s*>(constant->value->payload)->start;
+                const char* name = NULL;
+                const char* type = NULL;
+                json_value_s* value = NULL;
+                while (constant_elem)
+                {
+                    if (strcmp(constant_elem->name->string, "name") == 0)
+                    {
+                        VERIFY(constant_elem->value->type == json_type_string);
+                        json_string_s* constant_elem_str = static_cast<json_string_s*>(constant_elem->value->payload);
+                        name = constant_elem_str->string;
+                    }
+                    else if (strcmp(constant_elem->name->string, "type") == 0)
+                    {
+                        VERIFY(constant_elem->value->type == json_type_string);
+                        json_string_s* constant_elem_str = static_cast<json_string_s*>(constant_elem->value->payload);
+                        type = constant_elem_str->string;
+                    }
+                    else if (strcmp(constant_elem->name->string, "value") == 0)
+                    {
+                        value = constant_elem->value;
+                    }
+                    constant_elem = constant_elem->next;
+                }
+                VERIFY(name && type && value);
+
+                const uint32_t i = specialization_constant_count++;
+                specialization_constants[i].m_Hash = GfxHash(name, strlen(name));
+                VERIFY(specialization_constants[i].m_Hash != 0);
+                if (strcmp(type, "bool") == 0)
+                {
+                    VERIFY(value->type == json_type_true || value->type == json_type_false);
+                    specialization_constants[i].m_Value = value->type == json_type_true ? VK_TRUE : VK_FALSE;
+                    specialization_include.AppendFormat("layout(constant_id = %u) const bool %s = %s;\n", i, name, value->type == json_type_true ? "true" : "false");
+                }
+                else
+                {
+                    VERIFY(value->type == json_type_number);
+                    const char* number = static_cast<json_number_s*>(value->payload)->number;
+                    if (strcmp(type, "int") == 0)
+                    {
+                        const int32_t int_value = static_cast<int32_t>(atoi(number));
+                        memcpy(&specialization_constants[i].m_Value, &int_value, sizeof(int32_t));
+                        specialization_include.AppendFormat("layout(constant_id = %u) const int %s = %d;\n", i, name, int_value);
+                    }
+                    else if (strcmp(type, "uint") == 0)
+                    {
+                        const uint32_t uint_value = static_cast<uint32_t>(strtoul(number, NULL, 10));
+                        specialization_constants[i].m_Value = uint_value;
+                        specialization_include.AppendFormat("layout(constant_id = %u) const uint %s = %uu;\n", i, name, uint_value);
+                    }
+                    else
+                    {
+                        VERIFY(strcmp(type, "float") == 0);
+                        const float float_value = strtof(number, NULL);
+                        memcpy(&specialization_constants[i].m_Value, &float_value, sizeof(float));
+                        specialization_include.AppendFormat("layout(constant_id = %u) const float %s = %.9g;\n", i, name, float_value);
+                    }
+                }
+            }
+        }
+        curr_elem = curr_elem->next;
+    }
+
+    // Subgroup operations need SPIR-V 1.3
+    const char* target_env = subgroup_features ? "vulkan1.1" : "vulkan1.0";
+
     if (has_vertex_shader)
     {
         GfxGraphicsTechniqueBlob_T graphics_blob;
         graphics_blob.m_BindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 
+        graphics_blob.m_SubgroupFeatures = subgroup_features;
+        graphics_blob.m_SpecializationConstantCount = specialization_constant_count;
+        memcpy(graphics_blob.m_SpecializationConstants, specialization_constants, specialization_constant_count * sizeof(GfxTechniqueBlob_T::SpecializationConstant));
+
         String vs_include, vs_input, vs_main;
         String fs_include, fs_input, fs_main;
+        vs_include.Append(specialization_include);
+        fs_include.Append(specialization_include);
 
         curr_elem = root_elem;
         while (curr_elem)
@@ -303,6 +505,8 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                     const char* type = NULL;
                     const char* format = NULL;
                     const char* content = NULL;
+                    uint32_t count = 1;
+                    const char* count_constant = NULL; // Specialization constant sizing the array
                     while (binding_elem)
                     {
                         if (strcmp(binding_elem->name->string, "name") == 0)
@@ -329,6 +533,20 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                             json_string_s* binding_elem_str = static_cast<json_string_s*>(binding_elem->value->payload);
                             content = binding_elem_str->string;
                         }
+                        else if (strcmp(binding_elem->name->string, "count") == 0)
+                        {
+                            if (binding_elem->value->type == json_type_string)
+                            {
+                                json_string_s* binding_elem_str = static_cast<json_string_s*>(binding_elem->value->payload);
+                                count_constant = binding_elem_str->string;
+                            }
+                            else
+                            {
+                                VERIFY(binding_elem->value->type == json_type_number);
+                                json_number_s* binding_elem_num = static_cast<json_number_s*>(binding_elem->value->payload);
+                                count = static_cast<uint32_t>(atoi(binding_elem_num->number));
+                            }
+                        }
                         binding_elem = binding_elem->next;
                     }
                     VERIFY(name && type);
@@ -336,6 +554,20 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                     graphics_blob.m_ShaderBindings[i].m_Type = ToVkDescriptorType(type);
                     VERIFY(graphics_blob.m_ShaderBindings[i].m_Hash != 0);
                     VERIFY(graphics_blob.m_ShaderBindings[i].m_Type != VK_DESCRIPTOR_TYPE_MAX_ENUM);
+                    VERIFY((count == 1 && count_constant == NULL) || ((count > 1 || count_constant) && (graphics_blob.m_ShaderBindings[i].m_Type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || graphics_blob.m_ShaderBindings[i].m_Type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)));
+                    graphics_blob.m_ShaderBindings[i].m_Count = count;
+                    graphics_blob.m_ShaderBindings[i].m_CountHash = count_constant ? GfxHash(count_constant, strlen(count_constant)) : 0;
+                    String array_name;
+                    if (count_constant)
+                    {
+                        array_name.AppendFormat("%s[%s]", name, count_constant);
+                        name = array_name.Data();
+                    }
+                    else if (count > 1)
+                    {
+                        array_name.AppendFormat("%s[%u]", name, count);
+                        name = array_name.Data();
+                    }
                     String shader_str;
                     if (format && content)
                         shader_str.AppendFormat("layout(binding = %u, %s) %s %s\n{%s};\n", i, format, ToShaderDescriptorString(type), name, content);
@@ -698,12 +930,12 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
         size_t fs_size = 0;
 
         String vs_src;
-        vs_src.Append("#version 450\n#extension GL_ARB_separate_shader_objects : enable\n#extension GL_ARB_shading_language_packing : enable\n");
+        vs_src.Append(preamble);
         vs_src.Append(vs_include);
         vs_src.Append("out gl_PerVertex { vec4 gl_Position; };\nvoid main()\n{");
         vs_src.Append(vs_main);
         vs_src.Append("}");
-        if (!CompileShader(vs_src.Data(), "vert", &vs_code, &vs_size))
+        if (!CompileShader(vs_src.Data(), "vert", target_env, optimize_flags, &vs_code, &vs_size))
         {
             free(root);
             return blob;
@@ -712,12 +944,12 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
         if (fs_main.Length())
         {
             String fs_src;
-            fs_src.Append("#version 450\n#extension GL_ARB_separate_shader_objects : enable\n#extension GL_ARB_shading_language_packing : enable\n");
+            fs_src.Append(preamble);
             fs_src.Append(fs_include);
             fs_src.Append("void main()\n{");
             fs_src.Append(fs_main);
             fs_src.Append("}");
-            if (!CompileShader(fs_src.Data(), "frag", &fs_code, &fs_size))
+            if (!CompileShader(fs_src.Data(), "frag", target_env, optimize_flags, &fs_code, &fs_size))
             {
                 free(root);
                 return blob;
@@ -725,14 +957,14 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
         }
 
         blob.m_Size =
-            sizeof(uint64_t) +                                      // Checksum
+            sizeof(BlobHeader) +                                    // Header
             sizeof(uint64_t) + sizeof(GfxGraphicsTechniqueBlob_T) + // Main blob
             sizeof(uint64_t) + vs_size +                            // Vertex shader
             sizeof(uint64_t) + fs_size;                             // Fragment shader
         blob.m_Data = Alloc(blob.m_Size);
 
         WriteStream stream(blob.m_Data, blob.m_Size);
-        stream.WriteUint64(GfxHash(static_cast<const char*>(json_data), json_size));
+        WriteBlobHeader(stream, json_data, json_size, json_stamp);
         stream.Write(&graphics_blob, sizeof(GfxGraphicsTechniqueBlob_T));
         stream.Write(vs_code, vs_size);
         stream.Write(fs_code, fs_size);
@@ -747,7 +979,12 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
         GfxTechniqueBlob_T compute_blob;
         compute_blob.m_BindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
 
+        compute_blob.m_SubgroupFeatures = subgroup_features;
+        compute_blob.m_SpecializationConstantCount = specialization_constant_count;
+        memcpy(compute_blob.m_SpecializationConstants, specialization_constants, specialization_constant_count * sizeof(GfxTechniqueBlob_T::SpecializationConstant));
+
         String cs_include, cs_main;
+        cs_include.Append(specialization_include);
 
         curr_elem = root_elem;
         while (curr_elem)
@@ -785,7 +1022,16 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                             }
                             size_elem = size_elem->next;
                         }
-                        cs_include.AppendFormat("layout (local_size_x = %u, local_size_y = %u, local_size_z = %u) in;\n", x, y, z);
+                        VERIFY(compute_blob.m_SpecializationConstantCount + 3 <= ARRAY_COUNT(GfxTechniqueBlob_T::m_SpecializationConstants));
+                        const uint32_t size_id = compute_blob.m_SpecializationConstantCount;
+                        compute_blob.m_SpecializationConstants[size_id + 0].m_Hash = GFX_HASH("local_size_x");
+                        compute_blob.m_SpecializationConstants[size_id + 0].m_Value = x;
+                        compute_blob.m_SpecializationConstants[size_id + 1].m_Hash = GFX_HASH("local_size_y");
+                        compute_blob.m_SpecializationConstants[size_id + 1].m_Value = y;
+                        compute_blob.m_SpecializationConstants[size_id + 2].m_Hash = GFX_HASH("local_size_z");
+                        compute_blob.m_SpecializationConstants[size_id + 2].m_Value = z;
+                        compute_blob.m_SpecializationConstantCount += 3;
+                        cs_include.AppendFormat("layout (local_size_x = %u, local_size_y = %u, local_size_z = %u, local_size_x_id = %u, local_size_y_id = %u, local_size_z_id = %u) in;\n", x, y, z, size_id + 0, size_id + 1, size_id + 2);
                     }
                     else if (strcmp(cs_elem->name->string, "include") == 0)
                     {
@@ -816,6 +1062,8 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                     const char* type = NULL;
                     const char* format = NULL;
                     const char* content = NULL;
+                    uint32_t count = 1;
+                    const char* count_constant = NULL; // Specialization constant sizing the array
                     while (binding_elem)
                     {
                         if (strcmp(binding_elem->name->string, "name") == 0)
@@ -842,6 +1090,20 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                             json_string_s* binding_elem_str = static_cast<json_string_s*>(binding_elem->value->payload);
                             content = binding_elem_str->string;
                         }
+                        else if (strcmp(binding_elem->name->string, "count") == 0)
+                        {
+                            if (binding_elem->value->type == json_type_string)
+                            {
+                                json_string_s* binding_elem_str = static_cast<json_string_s*>(binding_elem->value->payload);
+                                count_constant = binding_elem_str->string;
+                            }
+                            else
+                            {
+                                VERIFY(binding_elem->value->type == json_type_number);
+                                json_number_s* binding_elem_num = static_cast<json_number_s*>(binding_elem->value->payload);
+                                count = static_cast<uint32_t>(atoi(binding_elem_num->number));
+                            }
+                        }
                         binding_elem = binding_elem->next;
                     }
                     VERIFY(name && type);
@@ -849,6 +1111,20 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
                     compute_blob.m_ShaderBindings[i].m_Type = ToVkDescriptorType(type);
                     VERIFY(compute_blob.m_ShaderBindings[i].m_Hash != 0);
                     VERIFY(compute_blob.m_ShaderBindings[i].m_Type != VK_DESCRIPTOR_TYPE_MAX_ENUM);
+                    VERIFY((count == 1 && count_constant == NULL) || ((count > 1 || count_constant) && (compute_blob.m_ShaderBindings[i].m_Type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || compute_blob.m_ShaderBindings[i].m_Type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)));
+                    compute_blob.m_ShaderBindings[i].m_Count = count;
+                    compute_blob.m_ShaderBindings[i].m_CountHash = count_constant ? GfxHash(count_constant, strlen(count_constant)) : 0;
+                    String array_name;
+                    if (count_constant)
+                    {
+                        array_name.AppendFormat("%s[%s]", name, count_constant);
+                        name = array_name.Data();
+                    }
+                    else if (count > 1)
+                    {
+                        array_name.AppendFormat("%s[%u]", name, count);
+                        name = array_name.Data();
+                    }
                     String shader_str;
                     if (format && content)
                         shader_str.AppendFormat("layout(binding = %u, %s) %s %s {%s};\n", i, format, ToShaderDescriptorString(type), name, content);
@@ -869,25 +1145,25 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
         size_t cs_size = 0;
 
         String cs_src;
-        cs_src.Append("#version 450\n#extension GL_ARB_separate_shader_objects : enable\n#extension GL_ARB_shading_language_packing : enable\n");
+        cs_src.Append(preamble);
         cs_src.Append(cs_include);
         cs_src.Append("void main()\n{");
         cs_src.Append(cs_main);
         cs_src.Append("}");
-        if (!CompileShader(cs_src.Data(), "comp", &cs_code, &cs_size))
+        if (!CompileShader(cs_src.Data(), "comp", target_env, optimize_flags, &cs_code, &cs_size))
         {
             free(root);
             return blob;
         }
 
         blob.m_Size =
-            sizeof(uint64_t) +                              // Checksum
+            sizeof(BlobHeader) +                            // Header
             sizeof(size_t) + sizeof(GfxTechniqueBlob_T) +   // Main blob
             sizeof(size_t) + cs_size;                       // Compute shader
         blob.m_Data = Alloc(blob.m_Size);
 
         WriteStream stream(blob.m_Data, blob.m_Size);
-        stream.WriteUint64(GfxHash(static_cast<const char*>(json_data), json_size));
+        WriteBlobHeader(stream, json_data, json_size, json_stamp);
         stream.Write(&compute_blob, sizeof(GfxTechniqueBlob_T));
         stream.Write(cs_code, cs_size);
         ASSERT(stream.IsEndOfStream());
@@ -900,14 +1176,33 @@ static Blob CreateTechniqueBlob(const void* json_data, size_t json_size)
 #undef VERIFY
 }
 
-GfxTechnique GfxCreateTechnique(GfxDevice device, const void* data, size_t size, GfxTechnique old_tech)
+// Arrays sized by a specialization constant are clamped to the device limit, the constant is clamped with them so
+// that the shader never declares more elements than the layout holds
+static uint32_t GetSpecializedArrayCount(GfxDevice device, const GfxTechniqueBlob_T* blob, uint64_t constant_hash, VkDescriptorType type, uint32_t* specialization_data)
 {
-    ASSERT(data && size);
+    for (uint32_t i = 0; i < blob->m_SpecializationConstantCount; ++i)
+    {
+        if (blob->m_SpecializationConstants[i].m_Hash != constant_hash)
+            continue;
 
-    ReadStream stream(const_cast<void*>(data), size);
-    stream.ReadUint64(); // Checksum
+        const VkPhysicalDeviceLimits& limits = device->m_PhysicalDeviceProperties.limits;
+        const uint32_t max_count = type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? limits.maxPerStageDescriptorStorageImages : limits.maxPerStageDescriptorSampledImages;
+        if (specialization_data[i] > max_count)
+        {
+            Print("Warning: Texture array of %u clamped to the device limit of %u", specialization_data[i], max_count);
+            specialization_data[i] = max_count;
+        }
+        specialization_data[i] = Max(specialization_data[i], 1U);
+        return specialization_data[i];
+    }
+    Print("Error: Texture array is sized by a specialization constant that does not exist");
+    Abort();
+    return 0;
+}
 
-    const GfxTechniqueBlob_T* blob_ptr = static_cast<const GfxTechniqueBlob_T*>(stream.Read());
+static GfxTechnique CreateTechnique(GfxDevice device, const void* data, size_t size, GfxTechnique old_tech, const GfxSpecializationConstant* constants, uint32_t constant_count)
+{
+    ASSERT(data && size);
 
     GfxTechnique_T* tech = old_tech;
     if (tech)
@@ -924,24 +1219,98 @@ GfxTechnique GfxCreateTechnique(GfxDevice device, const void* data, size_t size,
     {
         tech = New<GfxTechnique_T>();
     }
+    if (constants)
+    {
+        tech->m_SpecializationConstants.Resize(constant_count);
+        memcpy(tech->m_SpecializationConstants.Data(), constants, constant_count * sizeof(GfxSpecializationConstant));
+    }
+
+    // Keep the blob around so variants can be created without recompiling
+    Blob old_blob = tech->m_Blob;
+    tech->m_Blob.m_Data = Alloc(size);
+    tech->m_Blob.m_Size = size;
+    memcpy(tech->m_Blob.m_Data, data, size);
+    if (old_tech)
+        DestroyBlob(old_blob);
+
+    ReadStream stream(tech->m_Blob.m_Data, tech->m_Blob.m_Size);
+    stream.IncrPtr(sizeof(BlobHeader)); // Header
+
+    const GfxTechniqueBlob_T* blob_ptr = static_cast<const GfxTechniqueBlob_T*>(stream.Read());
+
     tech->m_BindPoint = blob_ptr->m_BindPoint;
 
+    if (blob_ptr->m_SubgroupFeatures)
+    {
+        const GfxDeviceCaps& caps = device->m_Caps;
+        const bool stages_supported = blob_ptr->m_BindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ?
+            caps.m_SubgroupComputeShader :
+            caps.m_SubgroupVertexShader && caps.m_SubgroupFragmentShader;
+        if (!stages_supported || (blob_ptr->m_SubgroupFeatures & caps.m_SubgroupFeatures) != blob_ptr->m_SubgroupFeatures)
+        {
+            Print("Error: Subgroup operations used by technique are not supported");
+            Abort();
+        }
+    }
+
+    // Specialization
+    uint32_t specialization_data[ARRAY_COUNT(GfxTechniqueBlob_T::m_SpecializationConstants)];
+    VkSpecializationMapEntry specialization_entries[ARRAY_COUNT(GfxTechniqueBlob_T::m_SpecializationConstants)];
+    for (uint32_t i = 0; i < blob_ptr->m_SpecializationConstantCount; ++i)
+    {
+        specialization_data[i] = blob_ptr->m_SpecializationConstants[i].m_Value;
+        for (uint32_t j = 0; j < tech->m_SpecializationConstants.Count(); ++j)
+        {
+            if (tech->m_SpecializationConstants[j].m_Hash == blob_ptr->m_SpecializationConstants[i].m_Hash)
+                specialization_data[i] = tech->m_SpecializationConstants[j].m_Uint;
+        }
+        specialization_entries[i].constantID = i;
+        specialization_entries[i].offset = i * sizeof(uint32_t);
+        specialization_entries[i].size = sizeof(uint32_t);
+    }
+
+    tech->m_WorkGroupSize[0] = 1;
+    tech->m_WorkGroupSize[1] = 1;
+    tech->m_WorkGroupSize[2] = 1;
+    for (uint32_t i = 0; i < blob_ptr->m_SpecializationConstantCount; ++i)
+    {
+        if (blob_ptr->m_SpecializationConstants[i].m_Hash == GFX_HASH("local_size_x"))
+            tech->m_WorkGroupSize[0] = specialization_data[i];
+        else if (blob_ptr->m_SpecializationConstants[i].m_Hash == GFX_HASH("local_size_y"))
+            tech->m_WorkGroupSize[1] = specialization_data[i];
+        else if (blob_ptr->m_SpecializationConstants[i].m_Hash == GFX_HASH("local_size_z"))
+            tech->m_WorkGroupSize[2] = specialization_data[i];
+    }
+
+    VkSpecializationInfo specialization_info = {};
+    specialization_info.mapEntryCount = blob_ptr->m_SpecializationConstantCount;
+    specialization_info.pMapEntries = specialization_entries;
+    specialization_info.dataSize = blob_ptr->m_SpecializationConstantCount * sizeof(uint32_t);
+    specialization_info.pData = specialization_data;
+
     // Pipeline layout
     {
         tech->m_ShaderBindingCount = blob_ptr->m_ShaderBindingCount;
+        tech->m_DescriptorImageInfoCount = 0;
 
         Array<VkDescriptorSetLayoutBinding> bindings(blob_ptr->m_ShaderBindingCount);
         for (uint32_t i = 0; i < blob_ptr->m_ShaderBindingCount; ++i)
         {
             bindings[i].binding = i;
             bindings[i].descriptorType = blob_ptr->m_ShaderBindings[i].m_Type;
-            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorCount = blob_ptr->m_ShaderBindings[i].m_Count;
+            if (blob_ptr->m_ShaderBindings[i].m_CountHash != 0)
+                bindings[i].descriptorCount = GetSpecializedArrayCount(device, blob_ptr, blob_ptr->m_ShaderBindings[i].m_CountHash, blob_ptr->m_ShaderBindings[i].m_Type, specialization_data);
             bindings[i].stageFlags = tech->m_BindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
             bindings[i].pImmutableSamplers = NULL;
 
             GfxTechnique_T::ShaderBinding binding;
             binding.m_Binding = i;
             binding.m_Type = blob_ptr->m_ShaderBindings[i].m_Type;
+            binding.m_Count = bindings[i].descriptorCount;
+            binding.m_Truncated = false;
+            binding.m_ImageInfoOffset = tech->m_DescriptorImageInfoCount;
+            tech->m_DescriptorImageInfoCount += binding.m_Count;
             tech->m_ShaderBindings.Put(blob_ptr->m_ShaderBindings[i].m_Hash, binding);
         }
 
@@ -1051,12 +1420,14 @@ GfxTechnique GfxCreateTechnique(GfxDevice device, const void* data, size_t size,
             shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
             shader_stages[0].module = vs_module;
             shader_stages[0].pName = "main";
+            shader_stages[0].pSpecializationInfo = &specialization_info;
             if (fs_module)
             {
                 shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
                 shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
                 shader_stages[1].module = fs_module;
                 shader_stages[1].pName = "main";
+                shader_stages[1].pSpecializationInfo = &specialization_info;
             }
 
             Array<VkVertexInputBindingDescription> vertex_bindings(graphics_blob_ptr->m_VertexAttributeCount);
@@ -1205,6 +1576,7 @@ GfxTechnique GfxCreateTechnique(GfxDevice device, const void* data, size_t size,
             shader_stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
             shader_stage.module = cs_module;
             shader_stage.pName = "main";
+            shader_stage.pSpecializationInfo = &specialization_info;
 
             VkComputePipelineCreateInfo pipeline_info = {};
             pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
@@ -1238,25 +1610,314 @@ GfxTechnique GfxCreateTechnique(GfxDevice device, const void* data, size_t size,
     {
         tech->m_RenderSetupHead = NULL;
         tech->m_RenderSetupTail = NULL;
+
+        tech->m_Base = NULL;
     }
 #endif
 
     return tech;
 }
 
+GfxTechnique GfxCreateTechnique(GfxDevice device, const void* data, size_t size, GfxTechnique old_tech)
+{
+    return CreateTechnique(device, data, size, old_tech, NULL, 0);
+}
+
+GfxTechnique GfxCreateTechniqueVariant(GfxDevice device, GfxTechnique tech, const GfxSpecializationConstant* constants, uint32_t constant_count)
+{
+    ASSERT(tech && (constants || constant_count == 0));
+
+#ifdef _DEBUG
+    ReadStream stream(tech->m_Blob.m_Data, tech->m_Blob.m_Size);
+    stream.IncrPtr(sizeof(BlobHeader)); // Header
+    const GfxTechniqueBlob_T* blob_ptr = static_cast<const GfxTechniqueBlob_T*>(stream.Read());
+    for (uint32_t i = 0; i < constant_count; ++i)
+    {
+        bool found = false;
+        for (uint32_t j = 0; j < blob_ptr->m_SpecializationConstantCount; ++j)
+            found |= blob_ptr->m_SpecializationConstants[j].m_Hash == constants[i].m_Hash;
+        ASSERT(found);
+    }
+#endif
+
+    // A variant of a variant keeps the overrides of its parent unless it overrides the same constant again
+    Array<GfxSpecializationConstant> merged_constants(tech->m_SpecializationConstants.Count());
+    for (uint32_t i = 0; i < merged_constants.Count(); ++i)
+        merged_constants[i] = tech->m_SpecializationConstants[i];
+    for (uint32_t i = 0; i < constant_count; ++i)
+    {
+        uint32_t j = 0;
+        while (j < merged_constants.Count() && merged_constants[j].m_Hash != constants[i].m_Hash)
+            ++j;
+        if (j < merged_constants.Count())
+            merged_constants[j] = constants[i];
+        else
+            merged_constants.Push(constants[i]);
+    }
+
+    GfxTechnique variant = CreateTechnique(device, tech->m_Blob.m_Data, tech->m_Blob.m_Size, NULL, merged_constants.Data(), merged_constants.Count());
+
+#ifdef _DEBUG
+    GfxTechnique base = tech->m_Base ? tech->m_Base : tech;
+    variant->m_Base = base;
+    base->m_Variants.Push(variant);
+#endif
+
+    return variant;
+}
+
+const uint32_t* GfxGetTechniqueWorkGroupSize(GfxTechnique tech)
+{
+    return tech->m_WorkGroupSize;
+}
+
+static uint32_t GetWorkGroupSizeCandidates(GfxDevice device, const uint32_t default_size[3], uint32_t candidates[][3], uint32_t max_candidate_count)
+{
+    const VkPhysicalDeviceLimits& limits = device->m_PhysicalDeviceProperties.limits;
+
+    uint32_t candidate_count = 0;
+    candidates[candidate_count][0] = default_size[0];
+    candidates[candidate_count][1] = default_size[1];
+    candidates[candidate_count][2] = default_size[2];
+    ++candidate_count;
+
+    // Keep the dimensionality of the default size
+    const uint32_t sizes_1d[] = { 16, 32, 64, 128, 256, 512, 1024 };
+    const uint32_t sizes_2d[] = { 4, 8, 16, 32 };
+    const uint32_t sizes_3d_z[] = { 1, 2, 4, 8 };
+    const bool is_1d = default_size[1] == 1 && default_size[2] == 1;
+    const bool is_2d = !is_1d && default_size[2] == 1;
+    for (uint32_t z = 0; z < (is_1d || is_2d ? 1 : ARRAY_COUNT(sizes_3d_z)); ++z)
+    {
+        for (uint32_t y = 0; y < (is_1d ? 1 : ARRAY_COUNT(sizes_2d)); ++y)
+        {
+            for (uint32_t x = 0; x < (is_1d ? ARRAY_COUNT(sizes_1d) : ARRAY_COUNT(sizes_2d)); ++x)
+            {
+                const uint32_t size[3] =
+                {
+                    is_1d ? sizes_1d[x] : sizes_2d[x],
+                    is_1d ? 1 : sizes_2d[y],
+                    is_1d || is_2d ? 1 : sizes_3d_z[z],
+                };
+                const uint32_t invocation_count = size[0] * size[1] * size[2];
+                if (invocation_count < 16 || invocation_count > limits.maxComputeWorkGroupInvocations ||
+                    size[0] > limits.maxComputeWorkGroupSize[0] ||
+                    size[1] > limits.maxComputeWorkGroupSize[1] ||
+                    size[2] > limits.maxComputeWorkGroupSize[2])
+                {
+                    continue;
+                }
+                if (size[0] == default_size[0] && size[1] == default_size[1] && size[2] == default_size[2])
+                    continue;
+                if (candidate_count == max_candidate_count)
+                    return candidate_count;
+
+                candidates[candidate_count][0] = size[0];
+                candidates[candidate_count][1] = size[1];
+                candidates[candidate_count][2] = size[2];
+                ++candidate_count;
+            }
+        }
+    }
+    return candidate_count;
+}
+
+static void ApplyWorkGroupSize(GfxDevice device, GfxTechnique tech, const uint32_t size[3])
+{
+    if (size[0] == tech->m_WorkGroupSize[0] && size[1] == tech->m_WorkGroupSize[1] && size[2] == tech->m_WorkGroupSize[2])
+        return;
+
+    const uint64_t hashes[3] = { GFX_HASH("local_size_x"), GFX_HASH("local_size_y"), GFX_HASH("local_size_z") };
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        GfxSpecializationConstant constant;
+        constant.m_Hash = hashes[i];
+        constant.m_Uint = size[i];
+
+        uint32_t j = 0;
+        while (j < tech->m_SpecializationConstants.Count() && tech->m_SpecializationConstants[j].m_Hash != hashes[i])
+            ++j;
+        if (j < tech->m_SpecializationConstants.Count())
+            tech->m_SpecializationConstants[j] = constant;
+        else
+            tech->m_SpecializationConstants.Push(constant);
+    }
+
+    GfxCreateTechnique(device, tech->m_Blob.m_Data, tech->m_Blob.m_Size, tech);
+}
+
+void GfxAutotuneTechnique(GfxDevice device, GfxTechnique tech, GfxAutotuneDispatchFunction dispatch, void* user_data)
+{
+    ASSERT(tech && dispatch);
+
+    if (tech->m_BindPoint != VK_PIPELINE_BIND_POINT_COMPUTE)
+        return;
+
+    String cache_filepath("Data/Autotune/");
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+        cache_filepath.AppendFormat("%02x", device->m_PhysicalDeviceProperties.pipelineCacheUUID[i]);
+    cache_filepath.AppendFormat("/%016llx.blob", static_cast<unsigned long long>(*static_cast<const uint64_t*>(tech->m_Blob.m_Data)));
+
+    void* cache_data = NULL;
+    size_t cache_size = 0;
+    if (ReadFile(cache_filepath.Data(), "rb", &cache_data, &cache_size))
+    {
+        const bool is_valid = cache_size == sizeof(uint32_t) * 3;
+        if (is_valid)
+            ApplyWorkGroupSize(device, tech, static_cast<const uint32_t*>(cache_data));
+        Free(cache_data);
+        if (is_valid)
+            return;
+    }
+
+    if (!device->m_PhysicalDeviceProperties.limits.timestampComputeAndGraphics)
+    {
+        Print("Error: Timestamp queries are not supported, skipping autotuning");
+        return;
+    }
+
+    const uint32_t repeat_count = 4;
+
+    uint32_t candidates[64][3];
+    const uint32_t candidate_count = GetWorkGroupSizeCandidates(device, tech->m_WorkGroupSize, candidates, ARRAY_COUNT(candidates));
+
+    VkQueryPoolCreateInfo query_pool_info = {};
+    query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = candidate_count * 2;
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    VK(vkCreateQueryPool(device->m_Device, &query_pool_info, NULL, &query_pool));
+
+    Array<GfxTechnique> variants(candidate_count);
+
+    GfxCommandBuffer cmd = BeginImmediateCommandBuffer(device);
+    vkCmdResetQueryPool(cmd->m_CommandBuffer, query_pool, 0, candidate_count * 2);
+    for (uint32_t i = 0; i < candidate_count; ++i)
+    {
+        GfxSpecializationConstant constants[3];
+        constants[0].m_Hash = GFX_HASH("local_size_x");
+        constants[0].m_Uint = candidates[i][0];
+        constants[1].m_Hash = GFX_HASH("local_size_y");
+        constants[1].m_Uint = candidates[i][1];
+        constants[2].m_Hash = GFX_HASH("local_size_z");
+        constants[2].m_Uint = candidates[i][2];
+        variants[i] = GfxCreateTechniqueVariant(device, tech, constants, ARRAY_COUNT(constants));
+
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        // Warm up before timing
+        for (uint32_t j = 0; j <= repeat_count; ++j)
+        {
+            if (j == 1)
+            {
+                vkCmdPipelineBarrier(cmd->m_CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+                vkCmdWriteTimestamp(cmd->m_CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, i * 2 + 0);
+            }
+            GfxCmdBeginTechnique(cmd, variants[i]);
+            dispatch(cmd, variants[i], user_data);
+            GfxCmdEndTechnique(cmd);
+        }
+        vkCmdWriteTimestamp(cmd->m_CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, i * 2 + 1);
+        vkCmdPipelineBarrier(cmd->m_CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+    EndImmediateCommandBuffer(device, cmd);
+
+    Array<uint64_t> timestamps(candidate_count * 2);
+    VK(vkGetQueryPoolResults(device->m_Device, query_pool, 0, candidate_count * 2, timestamps.Count() * sizeof(uint64_t), timestamps.Data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    vkDestroyQueryPool(device->m_Device, query_pool, NULL);
+
+    uint32_t best_index = 0;
+    double best_time = 0.0;
+    for (uint32_t i = 0; i < candidate_count; ++i)
+    {
+        const double time = static_cast<double>(timestamps[i * 2 + 1] - timestamps[i * 2 + 0]) * device->m_PhysicalDeviceProperties.limits.timestampPeriod / repeat_count;
+        if (i == 0 || time < best_time)
+        {
+            best_index = i;
+            best_time = time;
+        }
+        GfxDestroyTechnique(device, variants[i]);
+    }
+
+    Print("Autotuned work group size %ux%ux%u (%.3f ms, default %ux%ux%u)",
+        candidates[best_index][0], candidates[best_index][1], candidates[best_index][2], best_time * 1e-6,
+        candidates[0][0], candidates[0][1], candidates[0][2]);
+
+    ApplyWorkGroupSize(device, tech, candidates[best_index]);
+
+    if (!WriteFile(cache_filepath.Data(), "wb", candidates[best_index], sizeof(uint32_t) * 3))
+    {
+        Print("Error: Failed to write to file %s", cache_filepath.Data());
+    }
+}
+
 void GfxDestroyTechnique(GfxDevice device, GfxTechnique tech)
 {
     if (tech != NULL)
     {
+#ifdef _DEBUG
+        if (tech->m_Base)
+        {
+            for (uint32_t i = 0; i < tech->m_Base->m_Variants.Count(); ++i)
+            {
+                if (tech->m_Base->m_Variants[i] == tech)
+                {
+                    tech->m_Base->m_Variants.EraseSwap(i);
+                    break;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < tech->m_Variants.Count(); ++i)
+        {
+            tech->m_Variants[i]->m_Base = NULL;
+        }
+#endif
+
         vkDestroyPipeline(device->m_Device, tech->m_Pipeline, NULL);
         vkDestroyPipelineLayout(device->m_Device, tech->m_PipelineLayout, NULL);
         vkDestroyDescriptorSetLayout(device->m_Device, tech->m_DescriptorSetLayout, NULL);
         if (tech->m_BindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS)
             vkDestroyRenderPass(device->m_Device, tech->m_RenderPass, NULL);
+        DestroyBlob(tech->m_Blob);
         Delete<GfxTechnique_T>(tech);
     }
 }
 
+GfxTechnique CreateBuiltinTechnique(GfxDevice device, const char* name, const char* json)
+{
+    String blob_filepath("Data/Builtin/%s.blob", name);
+
+    const size_t json_size = strlen(json);
+
+    Blob blob;
+    if (ReadFile(blob_filepath.Data(), "rb", &blob.m_Data, &blob.m_Size) &&
+        !IsBlobChecksumCurrent(blob.m_Data, blob.m_Size, json, json_size))
+    {
+        DestroyBlob(blob);
+        blob = Blob();
+    }
+    if (!blob.m_Data)
+    {
+        blob = CreateTechniqueBlob(json, json_size, FileStamp());
+        if (!blob.m_Data || !blob.m_Size)
+        {
+            Print("Error: Failed to create builtin technique %s", name);
+            return NULL;
+        }
+        if (!WriteFile(blob_filepath.Data(), "wb", blob.m_Data, blob.m_Size))
+        {
+            Print("Error: Failed to write to file %s", blob_filepath.Data());
+        }
+    }
+
+    GfxTechnique tech = GfxCreateTechnique(device, blob.m_Data, blob.m_Size);
+    DestroyBlob(blob);
+    return tech;
+}
+
 GfxTechnique GfxLoadTechnique(GfxDevice device, const char* filepath)
 {
     const size_t filepath_len = strlen(filepath);
@@ -1267,22 +1928,38 @@ GfxTechnique GfxLoadTechnique(GfxDevice device, const char* filepath)
         return tech_entry->m_Technique;
     }
 
-    size_t blob_filepath_offset = 0;
-    while (blob_filepath_offset < filepath_len &&
-        (filepath[blob_filepath_offset] == '.' ||
-         filepath[blob_filepath_offset] == '/' ||
-         filepath[blob_filepath_offset] == '\\'))
+    String blob_filepath = GetBlobFilepath(filepath);
+
+    FileRead reads[2];
+    reads[0].m_Path = filepath;
+    reads[0].m_Mode = "r";
+    reads[1].m_Path = blob_filepath.Data();
+
+    // Packed blobs are used as they are without looking at the source file
+    const bool blob_packed = ResolvePackedFile(device, &reads[1]);
+
+    FileStamp json_stamp;
+    const bool json_exists = !blob_packed && GetFileStamp(filepath, &json_stamp);
+
+    // The JSON is only read when the blob is missing or was cooked from another version of it
+    FileBatch batch;
+    if (!blob_packed)
     {
-        ++blob_filepath_offset;
+        SubmitFileBatch(device->m_FileQueue, &batch, &reads[1], 1);
+        while (WaitFileBatch(device->m_FileQueue, &batch));
     }
-    String blob_filepath("Data/%s.blob", filepath + blob_filepath_offset);
-
-    void* json_data = NULL;
-    void* blob_data = NULL;
-    size_t json_size = 0;
-    size_t blob_size = 0;
-    bool json_loaded = ReadFile(filepath, "r", &json_data, &json_size);
-    bool blob_loaded = ReadFile(blob_filepath.Data(), "rb", &blob_data, &blob_size);
+    if (json_exists && !(reads[1].m_Loaded && IsBlobStampCurrent(reads[1].m_MappedFile.m_Data, reads[1].m_MappedFile.m_Size, json_stamp)))
+    {
+        SubmitFileBatch(device->m_FileQueue, &batch, &reads[0], 1);
+        while (WaitFileBatch(device->m_FileQueue, &batch));
+    }
+
+    void* json_data = reads[0].m_Data;
+    const void* blob_data = reads[1].m_MappedFile.m_Data;
+    size_t json_size = reads[0].m_Size;
+    size_t blob_size = reads[1].m_MappedFile.m_Size;
+    bool json_loaded = reads[0].m_Loaded;
+    bool blob_loaded = reads[1].m_Loaded;
     if (!json_loaded && !blob_loaded)
     {
         Print("Error: Failed to read from file %s", filepath);
@@ -1292,9 +1969,9 @@ GfxTechnique GfxLoadTechnique(GfxDevice device, const char* filepath)
     bool create_new_blob = false;
     if (json_loaded && blob_loaded)
     {
-        uint64_t json_checksum = GfxHash(static_cast<const char*>(json_data), json_size);
-        uint64_t blob_checksum = *static_cast<const uint64_t*>(blob_data);
-        create_new_blob = json_checksum != blob_checksum;
+        create_new_blob = !IsBlobChecksumCurrent(blob_data, blob_size, json_data, json_size);
+        if (!create_new_blob)
+            UpdateBlobSourceStamp(blob_filepath.Data(), json_stamp);
     }
     else if (json_loaded)
     {
@@ -1304,7 +1981,10 @@ GfxTechnique GfxLoadTechnique(GfxDevice device, const char* filepath)
     Blob blob;
     if (create_new_blob)
     {
-        blob = CreateTechniqueBlob(json_data, json_size);
+        // The stale blob is unmapped before its file is overwritten
+        ReleaseFileRead(&reads[1]);
+
+        blob = CreateTechniqueBlob(json_data, json_size, json_stamp);
         while (!blob.m_Data || !blob.m_Size)
         {
             Print("Failed to parse file %s. Press a key to reload...", filepath);
@@ -1312,40 +1992,36 @@ GfxTechnique GfxLoadTechnique(GfxDevice device, const char* filepath)
 
             Free(json_data);
 
+            GetFileStamp(filepath, &json_stamp);
             json_loaded = ReadFile(filepath, "r", &json_data, &json_size);
             if (!json_loaded)
             {
                 Print("Error: Failed to read from file %s", filepath);
-                if (blob_loaded)
-                    Free(blob_data);
                 return NULL;
             }
 
-            blob = CreateTechniqueBlob(json_data, json_size);
+            blob = CreateTechniqueBlob(json_data, json_size, json_stamp);
         }
         if (!WriteFile(blob_filepath.Data(), "wb", blob.m_Data, blob.m_Size))
         {
             Print("Error: Failed to write to file %s", blob_filepath.Data());
         }
     }
-    else
-    {
-        blob.m_Data = blob_data;
-        blob.m_Size = blob_size;
-    }
+    const void* tech_blob_data = create_new_blob ? blob.m_Data : blob_data;
+    const size_t tech_blob_size = create_new_blob ? blob.m_Size : blob_size;
 
     GfxDevice_T::TechniqueEntry tech_entry;
-    tech_entry.m_Technique = GfxCreateTechnique(device, blob.m_Data, blob.m_Size);
+    tech_entry.m_Technique = GfxCreateTechnique(device, tech_blob_data, tech_blob_size);
     tech_entry.m_Filepath = filepath;
-    tech_entry.m_Checksum = *static_cast<const uint64_t*>(blob.m_Data);
+    tech_entry.m_Checksum = static_cast<const BlobHeader*>(tech_blob_data)->m_Checksum;
+    tech_entry.m_SourceStamp = json_stamp;
     device->m_TechniqueEntries.Put(hash, tech_entry);
 
     if (create_new_blob)
         DestroyBlob(blob);
     if (json_loaded)
         Free(json_data);
-    if (blob_loaded)
-        Free(blob_data);
+    ReleaseFileRead(&reads[1]);
 
     Print("Loaded %s", create_new_blob ? filepath : blob_filepath.Data());
 
@@ -1367,34 +2043,35 @@ void GfxReloadAllTechniques(GfxDevice device)
         void* json_data = NULL;
         size_t json_size = 0;
         String json_filepath("%s", tech_entry->m_Filepath.Data());
+
+        // Untouched files are skipped without being read
+        FileStamp json_stamp;
+        if (!GetFileStamp(json_filepath.Data(), &json_stamp) ||
+            (json_stamp.m_Size == tech_entry->m_SourceStamp.m_Size && json_stamp.m_WriteTime == tech_entry->m_SourceStamp.m_WriteTime))
+        {
+            continue;
+        }
         if (!ReadFile(json_filepath.Data(), "r", &json_data, &json_size))
         {
             continue;
         }
 
-        uint64_t checksum = GfxHash(static_cast<const char*>(json_data), json_size);
+        uint64_t checksum = HashData(json_data, json_size);
         if (checksum == tech_entry->m_Checksum)
         {
+            tech_entry->m_SourceStamp = json_stamp;
             free(json_data);
             continue;
         }
 
-        Blob blob = CreateTechniqueBlob(json_data, json_size);
+        Blob blob = CreateTechniqueBlob(json_data, json_size, json_stamp);
         if (!blob.m_Data || !blob.m_Size)
         {
             free(json_data);
             continue;
         }
 
-        size_t blob_filepath_offset = 0;
-        while (blob_filepath_offset < tech_entry->m_Filepath.Length() &&
-            (tech_entry->m_Filepath.Data()[blob_filepath_offset] == '.' ||
-             tech_entry->m_Filepath.Data()[blob_filepath_offset] == '/' ||
-             tech_entry->m_Filepath.Data()[blob_filepath_offset] == '\\'))
-        {
-            ++blob_filepath_offset;
-        }
-        String blob_filepath("Data/%s.blob", tech_entry->m_Filepath.Data() + blob_filepath_offset);
+        String blob_filepath = GetBlobFilepath(tech_entry->m_Filepath.Data());
         if (!WriteFile(blob_filepath.Data(), "wb", blob.m_Data, blob.m_Size))
         {
             Print("Error: Failed to write to file %s", blob_filepath.Data());
@@ -1402,6 +2079,12 @@ void GfxReloadAllTechniques(GfxDevice device)
 
         tech_entry->m_Technique = GfxCreateTechnique(device, blob.m_Data, blob.m_Size, tech_entry->m_Technique);
         tech_entry->m_Checksum = checksum;
+        tech_entry->m_SourceStamp = json_stamp;
+
+        for (uint32_t j = 0; j < tech_entry->m_Technique->m_Variants.Count(); ++j)
+        {
+            CreateTechnique(device, blob.m_Data, blob.m_Size, tech_entry->m_Technique->m_Variants[j], NULL, 0);
+        }
 
         DestroyBlob(blob);
         free(json_data);
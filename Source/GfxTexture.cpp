@@ -0,0 +1,523 @@
+#include "GfxInternal.h"
+
+#include <thread>
+#include <float.h>
+#include <ctype.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TEXTURE_COOK_MAX_THREAD_COUNT   16
+#define TEXTURE_COOK_MIN_BLOCK_ROWS     16  // Mips with fewer block rows than this per thread are encoded on one thread
+
+// Endpoints are quantized to 5:6:5 and expanded back the way the hardware does it
+static uint16_t PackColor565(const float* rgb)
+{
+    const uint32_t r = static_cast<uint32_t>(fminf(fmaxf(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    const uint32_t g = static_cast<uint32_t>(fminf(fmaxf(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    const uint32_t b = static_cast<uint32_t>(fminf(fmaxf(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+static void UnpackColor565(uint16_t c, int32_t* rgb)
+{
+    const int32_t r = (c >> 11) & 31;
+    const int32_t g = (c >> 5) & 63;
+    const int32_t b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the nearest of the four palette colors for every texel, returns the summed squared error
+static uint32_t SelectBC1Indices(const uint8_t* texels, uint16_t c0, uint16_t c1, uint32_t* out_indices)
+{
+    int32_t palette[4][3];
+    UnpackColor565(c0, palette[0]);
+    UnpackColor565(c1, palette[1]);
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    uint32_t error = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t best_index = 0;
+        uint32_t best_distance = ~0u;
+        for (uint32_t j = 0; j < 4; ++j)
+        {
+            const int32_t dr = texels[i * 4 + 0] - palette[j][0];
+            const int32_t dg = texels[i * 4 + 1] - palette[j][1];
+            const int32_t db = texels[i * 4 + 2] - palette[j][2];
+            const uint32_t distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best_index = j;
+            }
+        }
+        indices |= best_index << (i * 2);
+        error += best_distance;
+    }
+    *out_indices = indices;
+    return error;
+}
+
+// Endpoints come from the extent of the block along its principal axis, then get one least squares refit against
+// the indices they produce. Opaque blocks only, so the four color mode is always used.
+static void EncodeBC1Block(const uint8_t* texels, uint8_t* out_block)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+            mean[c] += texels[i * 4 + c] / 16.0f;
+    }
+
+    float covariance[6] = {}; // xx, xy, xz, yy, yz, zz
+    float min_color[3] = { 255.0f, 255.0f, 255.0f };
+    float max_color[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        const float r = texels[i * 4 + 0] - mean[0];
+        const float g = texels[i * 4 + 1] - mean[1];
+        const float b = texels[i * 4 + 2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            min_color[c] = fminf(min_color[c], texels[i * 4 + c]);
+            max_color[c] = fmaxf(max_color[c], texels[i * 4 + c]);
+        }
+    }
+
+    // Power iteration, started from the bounding box diagonal
+    float axis[3] = { max_color[0] - min_color[0], max_color[1] - min_color[1], max_color[2] - min_color[2] };
+    for (uint32_t iteration = 0; iteration < 4; ++iteration)
+    {
+        const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        const float m = fmaxf(fmaxf(fabsf(x), fabsf(y)), fabsf(z));
+        if (m == 0.0f)
+            break;
+        axis[0] = x / m;
+        axis[1] = y / m;
+        axis[2] = z / m;
+    }
+    const float axis_length_sq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    float t_min = 0.0f;
+    float t_max = 0.0f;
+    if (axis_length_sq > 0.0f)
+    {
+        t_min = FLT_MAX;
+        t_max = -FLT_MAX;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            const float t = ((texels[i * 4 + 0] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2]) / axis_length_sq;
+            t_min = fminf(t_min, t);
+            t_max = fmaxf(t_max, t);
+        }
+    }
+    float endpoints[2][3];
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        endpoints[0][c] = mean[c] + axis[c] * t_max;
+        endpoints[1][c] = mean[c] + axis[c] * t_min;
+    }
+
+    uint16_t c0 = PackColor565(endpoints[0]);
+    uint16_t c1 = PackColor565(endpoints[1]);
+    uint32_t indices;
+    uint32_t error = SelectBC1Indices(texels, c0, c1, &indices);
+
+    if (c0 != c1)
+    {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = {}, bx[3] = {};
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            const float a = weights[(indices >> (i * 2)) & 3];
+            const float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                ax[c] += a * texels[i * 4 + c];
+                bx[c] += b * texels[i * 4 + c];
+            }
+        }
+        const float determinant = aa * bb - ab * ab;
+        if (fabsf(determinant) > 1e-6f)
+        {
+            float refit[2][3];
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                refit[0][c] = (bb * ax[c] - ab * bx[c]) / determinant;
+                refit[1][c] = (aa * bx[c] - ab * ax[c]) / determinant;
+            }
+            const uint16_t refit_c0 = PackColor565(refit[0]);
+            const uint16_t refit_c1 = PackColor565(refit[1]);
+            uint32_t refit_indices;
+            const uint32_t refit_error = SelectBC1Indices(texels, refit_c0, refit_c1, &refit_indices);
+            if (refit_error < error)
+            {
+                c0 = refit_c0;
+                c1 = refit_c1;
+                indices = refit_indices;
+                error = refit_error;
+            }
+        }
+    }
+
+    // c0 > c1 selects the four color mode, swapping the endpoints mirrors the indices
+    if (c0 < c1)
+    {
+        const uint16_t c = c0;
+        c0 = c1;
+        c1 = c;
+        indices ^= 0x55555555;
+    }
+    else if (c0 == c1)
+    {
+        indices = 0;
+    }
+
+    out_block[0] = static_cast<uint8_t>(c0);
+    out_block[1] = static_cast<uint8_t>(c0 >> 8);
+    out_block[2] = static_cast<uint8_t>(c1);
+    out_block[3] = static_cast<uint8_t>(c1 >> 8);
+    memcpy(out_block + 4, &indices, sizeof(indices));
+}
+
+// Single channel block in the eight value mode, taking its endpoints from the channel extent in the block
+static void EncodeBC4Block(const uint8_t* texels, uint32_t channel, uint8_t* out_block)
+{
+    uint32_t min_value = 255;
+    uint32_t max_value = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        min_value = Min(min_value, texels[i * 4 + channel]);
+        max_value = Max(max_value, texels[i * 4 + channel]);
+    }
+
+    uint64_t indices = 0;
+    if (max_value > min_value)
+    {
+        // Step 0 is max_value and step 7 is min_value, the steps in between are indices 2 to 7
+        const uint32_t range = max_value - min_value;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            const uint32_t step = ((max_value - texels[i * 4 + channel]) * 7 + range / 2) / range;
+            const uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+            indices |= index << (i * 3);
+        }
+    }
+
+    out_block[0] = static_cast<uint8_t>(max_value);
+    out_block[1] = static_cast<uint8_t>(min_value);
+    for (uint32_t i = 0; i < 6; ++i)
+        out_block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+}
+
+static void EncodeBlock(GfxFormat format, const uint8_t* texels, uint8_t* out_block)
+{
+    switch (format)
+    {
+    case GFX_FORMAT_BC1_RGB_UNORM:
+        EncodeBC1Block(texels, out_block);
+        break;
+    case GFX_FORMAT_BC3_UNORM:
+        EncodeBC4Block(texels, 3, out_block);
+        EncodeBC1Block(texels, out_block + 8);
+        break;
+    case GFX_FORMAT_BC4_UNORM:
+        EncodeBC4Block(texels, 0, out_block);
+        break;
+    case GFX_FORMAT_BC5_UNORM:
+        EncodeBC4Block(texels, 0, out_block);
+        EncodeBC4Block(texels, 1, out_block + 8);
+        break;
+    default:
+        ASSERT(false);
+    }
+}
+
+// Encodes the rows of blocks in [first_block_row, last_block_row), texels past the edge repeat the last row and column
+static void EncodeBlockRows(GfxFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t first_block_row, uint32_t last_block_row, uint8_t* out_blocks)
+{
+    const uint32_t block_stride = ToBlockStride(ToVkFormat(format));
+    const uint32_t block_count_x = (width + 3) / 4;
+    for (uint32_t block_y = first_block_row; block_y < last_block_row; ++block_y)
+    {
+        for (uint32_t block_x = 0; block_x < block_count_x; ++block_x)
+        {
+            uint8_t texels[16 * 4];
+            for (uint32_t y = 0; y < 4; ++y)
+            {
+                const uint32_t pixel_y = Min(block_y * 4 + y, height - 1);
+                for (uint32_t x = 0; x < 4; ++x)
+                {
+                    const uint32_t pixel_x = Min(block_x * 4 + x, width - 1);
+                    memcpy(&texels[(y * 4 + x) * 4], &pixels[(pixel_y * width + pixel_x) * 4], 4);
+                }
+            }
+            EncodeBlock(format, texels, out_blocks + (block_y * block_count_x + block_x) * block_stride);
+        }
+    }
+}
+
+// Mips are filtered in linear space as floats, color in linear light and normals as vectors that are renormalized
+struct MipFilterTables
+{
+    float   m_SrgbToLinear[256];
+    float   m_LinearMidpoints[255];   // Linear values halfway between two neighbouring sRGB codes
+};
+static MipFilterTables CreateMipFilterTables()
+{
+    MipFilterTables tables;
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        const float c = i / 255.0f;
+        tables.m_SrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (uint32_t i = 0; i < 255; ++i)
+        tables.m_LinearMidpoints[i] = 0.5f * (tables.m_SrgbToLinear[i] + tables.m_SrgbToLinear[i + 1]);
+    return tables;
+}
+static const MipFilterTables& GetMipFilterTables()
+{
+    static const MipFilterTables tables = CreateMipFilterTables();
+    return tables;
+}
+static uint8_t LinearToSrgb(const MipFilterTables& tables, float linear)
+{
+    // Nearest sRGB code by binary search, exact against the decode table
+    uint32_t code = 0;
+    for (uint32_t step = 128; step > 0; step >>= 1)
+    {
+        if (code + step <= 255 && tables.m_LinearMidpoints[code + step - 1] < linear)
+            code += step;
+    }
+    return static_cast<uint8_t>(code);
+}
+static uint8_t FloatToUnorm8(float n)
+{
+    return static_cast<uint8_t>(fminf(fmaxf(n, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void DecodeMip(const MipFilterTables& tables, const uint8_t* pixels, uint32_t texel_count, bool normal_map, float* out_texels)
+{
+    for (uint32_t i = 0; i < texel_count; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+            out_texels[i * 4 + c] = normal_map ? pixels[i * 4 + c] / 127.5f - 1.0f : tables.m_SrgbToLinear[pixels[i * 4 + c]];
+        out_texels[i * 4 + 3] = pixels[i * 4 + 3] / 255.0f;
+    }
+}
+static void EncodeMip(const MipFilterTables& tables, const float* texels, uint32_t texel_count, bool normal_map, float alpha_scale, uint8_t* out_pixels)
+{
+    for (uint32_t i = 0; i < texel_count; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+            out_pixels[i * 4 + c] = normal_map ? FloatToUnorm8(texels[i * 4 + c] * 0.5f + 0.5f) : LinearToSrgb(tables, texels[i * 4 + c]);
+        out_pixels[i * 4 + 3] = FloatToUnorm8(texels[i * 4 + 3] * alpha_scale);
+    }
+}
+
+// 2x2 box filter over RGBA float texels, one SSE register per texel. Odd edges reuse the last row or column.
+static void DownsampleMip(const float* src, uint32_t src_width, uint32_t src_height, bool normal_map, float* dst)
+{
+    const uint32_t dst_width = Max(src_width >> 1, 1);
+    const uint32_t dst_height = Max(src_height >> 1, 1);
+    for (uint32_t y = 0; y < dst_height; ++y)
+    {
+        const float* row0 = src + Min(y * 2 + 0, src_height - 1) * src_width * 4;
+        const float* row1 = src + Min(y * 2 + 1, src_height - 1) * src_width * 4;
+        for (uint32_t x = 0; x < dst_width; ++x)
+        {
+            const uint32_t x0 = Min(x * 2 + 0, src_width - 1) * 4;
+            const uint32_t x1 = Min(x * 2 + 1, src_width - 1) * 4;
+            float* texel = dst + (y * dst_width + x) * 4;
+#if defined(_M_X64) || defined(__SSE2__)
+            const __m128 sum = _mm_add_ps(
+                _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(texel, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (uint32_t c = 0; c < 4; ++c)
+                texel[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+            if (normal_map)
+            {
+                const float length = sqrtf(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+                if (length > 0.0f)
+                {
+                    texel[0] /= length;
+                    texel[1] /= length;
+                    texel[2] /= length;
+                }
+                else
+                {
+                    texel[0] = texel[1] = 0.0f;
+                    texel[2] = 1.0f;
+                }
+            }
+        }
+    }
+}
+
+// Fraction of texels that pass an alpha test at MIP_ALPHA_CUTOFF once their alpha is scaled. Shaders alpha testing
+// cooked textures have to discard below the same cutoff for the coverage to hold.
+#define MIP_ALPHA_CUTOFF 0.5f
+
+static float GetAlphaCoverage(const float* texels, uint32_t texel_count, float alpha_scale)
+{
+    uint32_t covered_count = 0;
+    for (uint32_t i = 0; i < texel_count; ++i)
+        covered_count += texels[i * 4 + 3] * alpha_scale >= MIP_ALPHA_CUTOFF ? 1 : 0;
+    return static_cast<float>(covered_count) / texel_count;
+}
+// Averaging alpha thins out alpha tested foliage and fences in the smaller mips, so each mip gets its alpha scaled
+// until it covers as much as the first mip does
+static float FindAlphaScale(const float* texels, uint32_t texel_count, float coverage)
+{
+    float low = 0.0f;
+    float high = 4.0f;
+    for (uint32_t iteration = 0; iteration < 12; ++iteration)
+    {
+        const float middle = 0.5f * (low + high);
+        if (GetAlphaCoverage(texels, texel_count, middle) < coverage)
+            low = middle;
+        else
+            high = middle;
+    }
+    return high;
+}
+
+// Alpha tested textures are authored with texels close to either transparent or opaque, apart from antialiased
+// edges. Blended textures have alpha all over the range and keep it as filtered, scaling it would change how they blend.
+static bool IsAlphaTested(const uint8_t* pixels, uint32_t texel_count)
+{
+    uint32_t transparent_count = 0;
+    uint32_t partial_count = 0;
+    for (uint32_t i = 0; i < texel_count; ++i)
+    {
+        const uint8_t alpha = pixels[i * 4 + 3];
+        transparent_count += alpha < 32 ? 1 : 0;
+        partial_count += alpha >= 32 && alpha < 224 ? 1 : 0;
+    }
+    return transparent_count > 0 && partial_count <= texel_count / 8;
+}
+
+static bool IsNormalMapFilepath(const char* filepath)
+{
+    const char* filename = filepath;
+    for (const char* c = filepath; *c; ++c)
+    {
+        if (*c == '/' || *c == '\\')
+            filename = c + 1;
+    }
+
+    char name[256];
+    uint32_t length = 0;
+    for (; filename[length] && filename[length] != '.' && length + 1 < sizeof(name); ++length)
+        name[length] = static_cast<char>(tolower(static_cast<unsigned char>(filename[length])));
+    name[length] = '\0';
+
+    return strstr(name, "_ddn") || strstr(name, "_nrm") || strstr(name, "_normal");
+}
+
+GfxFormat ChooseTextureFormat(const char* filepath, const uint8_t* pixels, uint32_t width, uint32_t height, bool block_compression, bool* out_normal_map, bool* out_alpha_tested)
+{
+    *out_normal_map = IsNormalMapFilepath(filepath);
+    *out_alpha_tested = !*out_normal_map && IsAlphaTested(pixels, width * height);
+    if (!block_compression)
+        return GFX_FORMAT_R8G8B8A8_UNORM;
+
+    if (*out_normal_map)
+        return GFX_FORMAT_BC5_UNORM;
+
+    for (uint32_t i = 0; i < width * height; ++i)
+    {
+        if (pixels[i * 4 + 3] != 255)
+            return GFX_FORMAT_BC3_UNORM;
+    }
+    return GFX_FORMAT_BC1_RGB_UNORM;
+}
+
+size_t GetTextureDataSize(GfxFormat format, uint32_t width, uint32_t height, uint32_t mip_count)
+{
+    size_t size = 0;
+    for (uint32_t mip = 0; mip < mip_count; ++mip)
+        size += static_cast<size_t>(ToImageSize(ToVkFormat(format), Max(width >> mip, 1), Max(height >> mip, 1)));
+    return size;
+}
+
+void CookTexture(GfxFormat format, bool normal_map, bool alpha_tested, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t mip_count, void* out_data, uint32_t thread_count)
+{
+    const bool block_compressed = ToBlockStride(ToVkFormat(format)) != 0;
+    ASSERT(block_compressed || format == GFX_FORMAT_R8G8B8A8_UNORM);
+
+    thread_count = Clamp(thread_count ? thread_count : std::thread::hardware_concurrency(), 1, TEXTURE_COOK_MAX_THREAD_COUNT);
+    const MipFilterTables& tables = GetMipFilterTables();
+
+    // The filter chain stays in float, every mip is encoded back to 8 bits on its own
+    float* mip_texels[2] = { static_cast<float*>(Alloc(sizeof(float) * 4 * width * height)), NULL };
+    DecodeMip(tables, pixels, width * height, normal_map, mip_texels[0]);
+    const float coverage = alpha_tested ? GetAlphaCoverage(mip_texels[0], width * height, 1.0f) : 0.0f;
+
+    uint8_t* mip_pixels = mip_count > 1 ? static_cast<uint8_t*>(Alloc(static_cast<size_t>(Max(width >> 1, 1)) * Max(height >> 1, 1) * 4)) : NULL;
+    uint8_t* out = static_cast<uint8_t*>(out_data);
+    const uint8_t* src = pixels;
+    for (uint32_t mip = 0; mip < mip_count; ++mip)
+    {
+        const uint32_t mip_width = Max(width >> mip, 1);
+        const uint32_t mip_height = Max(height >> mip, 1);
+        if (mip > 0)
+        {
+            float*& dst_texels = mip_texels[mip & 1];
+            if (dst_texels == NULL)
+                dst_texels = static_cast<float*>(Alloc(sizeof(float) * 4 * mip_width * mip_height));
+            DownsampleMip(mip_texels[(mip - 1) & 1], Max(width >> (mip - 1), 1), Max(height >> (mip - 1), 1), normal_map, dst_texels);
+
+            const float alpha_scale = alpha_tested ? FindAlphaScale(dst_texels, mip_width * mip_height, coverage) : 1.0f;
+            EncodeMip(tables, dst_texels, mip_width * mip_height, normal_map, alpha_scale, mip_pixels);
+            src = mip_pixels;
+        }
+
+        if (block_compressed)
+        {
+            // Block rows are independent, so large mips are split over threads
+            const uint32_t block_row_count = (mip_height + 3) / 4;
+            const uint32_t mip_thread_count = Clamp(block_row_count / TEXTURE_COOK_MIN_BLOCK_ROWS, 1, thread_count);
+            std::thread threads[TEXTURE_COOK_MAX_THREAD_COUNT];
+            for (uint32_t i = 1; i < mip_thread_count; ++i)
+                threads[i] = std::thread(EncodeBlockRows, format, src, mip_width, mip_height, block_row_count * i / mip_thread_count, block_row_count * (i + 1) / mip_thread_count, out);
+            EncodeBlockRows(format, src, mip_width, mip_height, 0, block_row_count / mip_thread_count, out);
+            for (uint32_t i = 1; i < mip_thread_count; ++i)
+                threads[i].join();
+        }
+        else
+        {
+            memcpy(out, src, static_cast<size_t>(mip_width) * mip_height * 4);
+        }
+        out += static_cast<size_t>(ToImageSize(ToVkFormat(format), mip_width, mip_height));
+    }
+
+    Free(mip_texels[0]);
+    if (mip_texels[1])
+        Free(mip_texels[1]);
+    if (mip_pixels)
+        Free(mip_pixels);
+}
@@ -4,6 +4,14 @@
 #include <new>
 #include <math.h>
 #include <stdio.h>
+#include <stddef.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 static void Print(const char* message, ...)
 {
@@ -273,6 +281,219 @@ public:
     }
 };
 
+// LZ4 style block codec for cooked data. Sequences are a token with 4 bit literal and match lengths, extended by
+// 255 valued bytes, the literals and a 16 bit backwards offset. The final sequence only holds literals.
+#define LZ_HASH_BITS        16
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       0xFFFF
+#define LZ_END_LITERALS     5   // Matches end at least this far from the end of the data, as in LZ4
+
+static bool WriteLZLength(uint8_t** out_ptr, const uint8_t* out_end, size_t length)
+{
+    uint8_t* ptr = *out_ptr;
+    for (; length >= 255; length -= 255)
+    {
+        if (ptr == out_end)
+            return false;
+        *ptr++ = 255;
+    }
+    if (ptr == out_end)
+        return false;
+    *ptr++ = static_cast<uint8_t>(length);
+    *out_ptr = ptr;
+    return true;
+}
+static bool WriteLZSequence(uint8_t** out_ptr, const uint8_t* out_end, const uint8_t* literals, size_t literal_count, size_t offset, size_t match_length)
+{
+    uint8_t* ptr = *out_ptr;
+    if (ptr == out_end)
+        return false;
+
+    const size_t match_code = match_length > 0 ? match_length - LZ_MIN_MATCH : 0;
+    uint8_t* token = ptr++;
+    *token = static_cast<uint8_t>((literal_count < 15 ? literal_count : 15) << 4 | (match_code < 15 ? match_code : 15));
+    if (literal_count >= 15 && !WriteLZLength(&ptr, out_end, literal_count - 15))
+        return false;
+    if (static_cast<size_t>(out_end - ptr) < literal_count)
+        return false;
+    memcpy(ptr, literals, literal_count);
+    ptr += literal_count;
+
+    if (match_length > 0)
+    {
+        if (out_end - ptr < 2)
+            return false;
+        *ptr++ = static_cast<uint8_t>(offset);
+        *ptr++ = static_cast<uint8_t>(offset >> 8);
+        if (match_code >= 15 && !WriteLZLength(&ptr, out_end, match_code - 15))
+            return false;
+    }
+    *out_ptr = ptr;
+    return true;
+}
+// Greedy single probe matcher, returns the compressed size or 0 when it does not fit in dst_capacity
+static size_t CompressLZ(const void* src, size_t src_size, void* dst, size_t dst_capacity)
+{
+    const uint8_t* in = static_cast<const uint8_t*>(src);
+    const uint8_t* in_end = in + src_size;
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    const uint8_t* out_end = out + dst_capacity;
+
+    const uint8_t* anchor = in;
+    if (src_size > LZ_MIN_MATCH + LZ_END_LITERALS)
+    {
+        uint32_t* table = static_cast<uint32_t*>(Alloc(sizeof(uint32_t) << LZ_HASH_BITS));
+        memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+
+        const uint8_t* match_limit = in_end - LZ_MIN_MATCH - LZ_END_LITERALS;
+        const uint8_t* ptr = in + 1;
+        uint32_t miss_count = 0;
+        while (ptr < match_limit)
+        {
+            uint32_t sequence;
+            memcpy(&sequence, ptr, sizeof(sequence));
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+            const uint8_t* ref = in + table[hash];
+            table[hash] = static_cast<uint32_t>(ptr - in);
+
+            uint32_t ref_sequence;
+            memcpy(&ref_sequence, ref, sizeof(ref_sequence));
+            if (ref >= ptr || ptr - ref > LZ_MAX_OFFSET || ref_sequence != sequence)
+            {
+                // Incompressible runs are skipped through with growing steps
+                ptr += 1 + (miss_count++ >> 6);
+                continue;
+            }
+            miss_count = 0;
+
+            const uint8_t* match_end = ptr + LZ_MIN_MATCH;
+            const uint8_t* ref_end = ref + LZ_MIN_MATCH;
+            while (match_end < in_end - LZ_END_LITERALS && *match_end == *ref_end)
+            {
+                ++match_end;
+                ++ref_end;
+            }
+            while (ptr > anchor && ref > in && ptr[-1] == ref[-1])
+            {
+                --ptr;
+                --ref;
+            }
+
+            if (!WriteLZSequence(&out, out_end, anchor, ptr - anchor, ptr - ref, match_end - ptr))
+            {
+                Free(table);
+                return 0;
+            }
+            ptr = match_end;
+            anchor = ptr;
+        }
+        Free(table);
+    }
+
+    if (!WriteLZSequence(&out, out_end, anchor, in_end - anchor, 0, 0))
+        return 0;
+    return out - static_cast<uint8_t*>(dst);
+}
+// Returns false unless src decodes to exactly dst_size bytes without reading or writing out of bounds
+static bool DecompressLZ(const void* src, size_t src_size, void* dst, size_t dst_size)
+{
+    const uint8_t* in = static_cast<const uint8_t*>(src);
+    const uint8_t* in_end = in + src_size;
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    uint8_t* out_end = out + dst_size;
+
+    while (in < in_end)
+    {
+        const uint8_t token = *in++;
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15)
+        {
+            uint8_t n;
+            do
+            {
+                if (in == in_end)
+                    return false;
+                n = *in++;
+                literal_count += n;
+            } while (n == 255);
+        }
+        if (literal_count > static_cast<size_t>(in_end - in) || literal_count > static_cast<size_t>(out_end - out))
+            return false;
+        if (literal_count <= 16 && in_end - in >= 16 && out_end - out >= 16)
+            memcpy(out, in, 16); // Fixed size copies of short runs are much cheaper than exact ones
+        else
+            memcpy(out, in, literal_count);
+        in += literal_count;
+        out += literal_count;
+
+        if (in == in_end)
+            break;
+
+        if (in_end - in < 2)
+            return false;
+        const size_t offset = in[0] | static_cast<size_t>(in[1]) << 8;
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - static_cast<uint8_t*>(dst)))
+            return false;
+
+        size_t match_length = token & 15;
+        if (match_length == 15)
+        {
+            uint8_t n;
+            do
+            {
+                if (in == in_end)
+                    return false;
+                n = *in++;
+                match_length += n;
+            } while (n == 255);
+        }
+        match_length += LZ_MIN_MATCH;
+        if (match_length > static_cast<size_t>(out_end - out))
+            return false;
+
+        const uint8_t* ref = out - offset;
+        if (offset >= 8 && static_cast<size_t>(out_end - out) >= match_length + 8)
+        {
+            // 8 byte steps may run past the match but never past the output, and never read bytes not yet written
+            uint8_t* match_end = out + match_length;
+            do
+            {
+                memcpy(out, ref, 8);
+                out += 8;
+                ref += 8;
+            } while (out < match_end);
+            out = match_end;
+        }
+        else
+        {
+            // Overlapping matches repeat the last offset bytes
+            for (size_t i = 0; i < match_length; ++i)
+                *out++ = *ref++;
+        }
+    }
+    return out == out_end;
+}
+
+// Blob section, prefixed by its size and the size it is stored with. Sections stored smaller than their size are
+// LZ compressed and are decoded independently of each other, straight into the memory they end up in.
+struct StreamSection
+{
+    const void* m_Data          = NULL;
+    size_t      m_StoredSize    = 0;
+    size_t      m_Size          = 0;
+};
+static bool DecodeSection(const StreamSection& section, void* dst)
+{
+    if (section.m_StoredSize == section.m_Size)
+    {
+        memcpy(dst, section.m_Data, section.m_Size);
+        return true;
+    }
+    return DecompressLZ(section.m_Data, section.m_StoredSize, dst, section.m_Size);
+}
+
 class ReadStream
 {
 private:
@@ -359,6 +580,15 @@ public:
         m_Ptr = static_cast<const void*>(static_cast<const float*>(m_Ptr) + 3);
         return ptr;
     }
+    StreamSection ReadSection()
+    {
+        StreamSection section;
+        section.m_Size = static_cast<size_t>(ReadUint64());
+        section.m_StoredSize = static_cast<size_t>(ReadUint64());
+        section.m_Data = m_Ptr;
+        m_Ptr = static_cast<const void*>(static_cast<const uint8_t*>(m_Ptr) + section.m_StoredSize);
+        return section;
+    }
 };
 class WriteStream
 {
@@ -377,6 +607,10 @@ public:
     {
         m_Ptr = static_cast<void*>(static_cast<uint8_t*>(m_Ptr) + size);
     }
+    void* GetPtr()
+    {
+        return m_Ptr;
+    }
     const void* GetPtr() const
     {
         return m_Ptr;
@@ -396,6 +630,14 @@ public:
         }
         m_Ptr = static_cast<void*>(static_cast<uint8_t*>(m_Ptr) + size);
     }
+    void WriteBytes(const void* data, size_t size)
+    {
+        if (size)
+        {
+            memcpy(m_Ptr, data, size);
+        }
+        m_Ptr = static_cast<void*>(static_cast<uint8_t*>(m_Ptr) + size);
+    }
     void WriteUint8(uint8_t n)
     {
         uint8_t* ptr = static_cast<uint8_t*>(m_Ptr);
@@ -437,6 +679,37 @@ public:
         memcpy(m_Ptr, a, sizeof(float) * 3);
         m_Ptr = static_cast<void*>(static_cast<float*>(m_Ptr) + 3);
     }
+    // Everything written between BeginSection and EndSection becomes one section. A compressed section is moved
+    // back in place, so the stream ends short of its size whenever compression paid off.
+    void* BeginSection()
+    {
+        void* section = m_Ptr;
+        WriteUint64(0);
+        WriteUint64(0);
+        return section;
+    }
+    void EndSection(void* section, bool compress)
+    {
+        uint8_t* data = static_cast<uint8_t*>(section) + sizeof(uint64_t) * 2;
+        const size_t size = static_cast<uint8_t*>(m_Ptr) - data;
+
+        size_t stored_size = size;
+        if (compress && size > 0)
+        {
+            void* compressed = Alloc(size);
+            const size_t compressed_size = CompressLZ(data, size, compressed, size - 1);
+            if (compressed_size > 0)
+            {
+                memcpy(data, compressed, compressed_size);
+                stored_size = compressed_size;
+            }
+            Free(compressed);
+        }
+
+        uint64_t sizes[2] = { size, stored_size };
+        memcpy(section, sizes, sizeof(sizes));
+        m_Ptr = static_cast<void*>(data + stored_size);
+    }
 };
 
 inline uint32_t Min(uint32_t a, uint32_t b)
@@ -464,6 +737,21 @@ static bool FileExists(const char* filepath)
     fclose(file);
     return true;
 }
+// Cooked data of a source file is cached at Data/<filepath>.blob, without any leading ./ or ../
+static String GetBlobFilepath(const char* filepath)
+{
+    const size_t filepath_len = strlen(filepath);
+
+    size_t blob_filepath_offset = 0;
+    while (blob_filepath_offset < filepath_len &&
+        (filepath[blob_filepath_offset] == '.' ||
+         filepath[blob_filepath_offset] == '/' ||
+         filepath[blob_filepath_offset] == '\\'))
+    {
+        ++blob_filepath_offset;
+    }
+    return String("Data/%s.blob", filepath + blob_filepath_offset);
+}
 static bool ReadFile(const char* path, const char* mode, void** data, size_t* size)
 {
     *data = NULL;
@@ -477,25 +765,229 @@ static bool ReadFile(const char* path, const char* mode, void** data, size_t* si
     size_t alloc_size = static_cast<size_t>(ftell(file));
     fseek(file, 0L, SEEK_SET);
 
-    *data = Alloc(alloc_size);
+    // Text mode may read fewer bytes than the file size but never more
+    *data = Alloc(alloc_size > 0 ? alloc_size : 1);
+    *size = fread(*data, 1, alloc_size, file);
+
+    fclose(file);
+    return true;
+}
+
+// Read only view of a whole file, the pages come from the OS file cache without being copied into a heap block first
+struct MappedFile
+{
+    const void* m_Data      = NULL;
+    size_t      m_Size      = 0;
+#ifdef _WIN32
+    HANDLE      m_File      = INVALID_HANDLE_VALUE;
+    HANDLE      m_Mapping   = NULL;
+#else
+    int         m_File      = -1;
+#endif
+};
+static void UnmapFile(MappedFile* file)
+{
+#ifdef _WIN32
+    if (file->m_Data)
+        UnmapViewOfFile(file->m_Data);
+    if (file->m_Mapping)
+        CloseHandle(file->m_Mapping);
+    if (file->m_File != INVALID_HANDLE_VALUE)
+        CloseHandle(file->m_File);
+#else
+    if (file->m_Data)
+        munmap(const_cast<void*>(file->m_Data), file->m_Size);
+    if (file->m_File != -1)
+        close(file->m_File);
+#endif
+    *file = MappedFile();
+}
+static bool MapFile(const char* path, MappedFile* file)
+{
+    *file = MappedFile();
+#ifdef _WIN32
+    file->m_File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file->m_File == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->m_File, &size) || size.QuadPart == 0)
+    {
+        UnmapFile(file);
+        return false;
+    }
+    file->m_Size = static_cast<size_t>(size.QuadPart);
+
+    file->m_Mapping = CreateFileMappingA(file->m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file->m_Mapping)
+        file->m_Data = MapViewOfFile(file->m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    file->m_File = open(path, O_RDONLY);
+    if (file->m_File == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(file->m_File, &st) != 0 || st.st_size == 0)
+    {
+        UnmapFile(file);
+        return false;
+    }
+    file->m_Size = static_cast<size_t>(st.st_size);
+
+    void* data = mmap(NULL, file->m_Size, PROT_READ, MAP_PRIVATE, file->m_File, 0);
+    if (data != MAP_FAILED)
+    {
+        madvise(data, file->m_Size, MADV_SEQUENTIAL);
+        file->m_Data = data;
+    }
+#endif
+    if (!file->m_Data)
+    {
+        UnmapFile(file);
+        return false;
+    }
+    return true;
+}
+// XXH64 (Collet), four independent lanes over 32 byte stripes instead of GfxHash's serial byte loop
+static uint64_t HashData(const void* data, size_t size)
+{
+    const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t prime3 = 0x165667B19E3779F9ull;
+    const uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+    #define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+    #define HASH_ROUND(acc, lane) (HASH_ROTL((acc) + (lane) * prime2, 31) * prime1)
+
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+    const uint8_t* end = ptr + size;
 
-    uint8_t chunk[256 * 1024];
-    size_t chunk_size;
-    while ((chunk_size = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    uint64_t hash;
+    if (size >= 32)
     {
-        size_t new_size = *size + chunk_size;
-        if (new_size > alloc_size)
+        uint64_t acc[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+        for (; ptr + 32 <= end; ptr += 32)
         {
-            *data = Realloc(*data, new_size);
-            alloc_size = new_size;
+            uint64_t lanes[4];
+            memcpy(lanes, ptr, sizeof(lanes));
+            acc[0] = HASH_ROUND(acc[0], lanes[0]);
+            acc[1] = HASH_ROUND(acc[1], lanes[1]);
+            acc[2] = HASH_ROUND(acc[2], lanes[2]);
+            acc[3] = HASH_ROUND(acc[3], lanes[3]);
         }
-        memcpy(static_cast<uint8_t*>(*data) + *size, chunk, chunk_size);
-        *size = new_size;
+        hash = HASH_ROTL(acc[0], 1) + HASH_ROTL(acc[1], 7) + HASH_ROTL(acc[2], 12) + HASH_ROTL(acc[3], 18);
+        for (uint32_t i = 0; i < 4; ++i)
+            hash = (hash ^ HASH_ROUND(0, acc[i])) * prime1 + prime4;
+    }
+    else
+    {
+        hash = prime5;
     }
+    hash += static_cast<uint64_t>(size);
 
-    fclose(file);
+    for (; ptr + 8 <= end; ptr += 8)
+    {
+        uint64_t lane;
+        memcpy(&lane, ptr, sizeof(lane));
+        hash ^= HASH_ROUND(0, lane);
+        hash = HASH_ROTL(hash, 27) * prime1 + prime4;
+    }
+    if (ptr + 4 <= end)
+    {
+        uint32_t lane;
+        memcpy(&lane, ptr, sizeof(lane));
+        hash ^= static_cast<uint64_t>(lane) * prime1;
+        hash = HASH_ROTL(hash, 23) * prime2 + prime3;
+        ptr += 4;
+    }
+    for (; ptr < end; ++ptr)
+    {
+        hash ^= *ptr * prime5;
+        hash = HASH_ROTL(hash, 11) * prime1;
+    }
+
+    #undef HASH_ROUND
+    #undef HASH_ROTL
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Size and last write time of a file, comparing them is much cheaper than reading and hashing the file
+struct FileStamp
+{
+    uint64_t    m_Size          = 0;
+    uint64_t    m_WriteTime     = 0;
+};
+static bool GetFileStamp(const char* path, FileStamp* out_stamp)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+        return false;
+    out_stamp->m_Size = static_cast<uint64_t>(attributes.nFileSizeHigh) << 32 | attributes.nFileSizeLow;
+    out_stamp->m_WriteTime = static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32 | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    out_stamp->m_Size = static_cast<uint64_t>(st.st_size);
+    // Whole seconds would miss a source saved again within the second it was cooked in
+#ifdef __APPLE__
+    const struct timespec& write_time = st.st_mtimespec;
+#else
+    const struct timespec& write_time = st.st_mtim;
+#endif
+    out_stamp->m_WriteTime = static_cast<uint64_t>(write_time.tv_sec) * 1000000000 + static_cast<uint64_t>(write_time.tv_nsec);
+#endif
     return true;
 }
+
+// Every blob starts with the checksum and stamp of the source file it was cooked from. A blob whose stamp matches
+// the source file is used without reading the source, otherwise the source is read and hashed against the checksum.
+// BLOB_VERSION is bumped whenever the layout of a blob changes, blobs written by another version are cooked again.
+// Blobs cooked with other flags than the loader asks for count as stale as well.
+#define BLOB_VERSION            14
+#define BLOB_FLAG_COMPRESSED    0x1 // Large sections may be LZ compressed
+#define BLOB_FLAG_BCN           0x2 // Textures may be cooked to BCn formats
+#define BLOB_FLAG_MIP_SECTIONS  0x4 // Texture mips are separate sections, so they can be loaded one at a time
+
+struct BlobHeader
+{
+    uint64_t    m_Checksum;
+    FileStamp   m_SourceStamp;
+    uint32_t    m_Version;
+    uint32_t    m_Flags;
+};
+static void WriteBlobHeader(WriteStream& stream, const void* source_data, size_t source_size, const FileStamp& source_stamp, uint32_t flags = 0)
+{
+    stream.WriteUint64(HashData(source_data, source_size));
+    stream.WriteUint64(source_stamp.m_Size);
+    stream.WriteUint64(source_stamp.m_WriteTime);
+    stream.WriteUint32(BLOB_VERSION);
+    stream.WriteUint32(flags);
+}
+static bool IsBlobStampCurrent(const void* blob_data, size_t blob_size, const FileStamp& source_stamp, uint32_t flags = 0)
+{
+    if (blob_size < sizeof(BlobHeader))
+        return false;
+    const BlobHeader* header = static_cast<const BlobHeader*>(blob_data);
+    return header->m_Version == BLOB_VERSION && header->m_Flags == flags &&
+        header->m_SourceStamp.m_Size == source_stamp.m_Size && header->m_SourceStamp.m_WriteTime == source_stamp.m_WriteTime;
+}
+static bool IsBlobChecksumCurrent(const void* blob_data, size_t blob_size, const void* source_data, size_t source_size, uint32_t flags = 0)
+{
+    if (blob_size < sizeof(BlobHeader))
+        return false;
+    const BlobHeader* header = static_cast<const BlobHeader*>(blob_data);
+    return header->m_Version == BLOB_VERSION && header->m_Flags == flags && header->m_Checksum == HashData(source_data, source_size);
+}
+
 static bool WriteFile(const char* path, const char* mode, const void* data, size_t size)
 {
     char path_buf[2048];
@@ -516,7 +1008,7 @@ static bool WriteFile(const char* path, const char* mode, const void* data, size
         if (!CreateDirectory(path_buf, 0x0) && GetLastError() != ERROR_ALREADY_EXISTS)
             return false;
 #else
-        if (mkdir(path, 0777) != 0 && errno != EEXIST)
+        if (mkdir(path_buf, 0777) != 0 && errno != EEXIST)
             return false;
 #endif
         *path_curr = '/';
@@ -530,5 +1022,25 @@ static bool WriteFile(const char* path, const char* mode, const void* data, size
     fclose(file);
     return true;
 }
+// Refreshes the stamp of a blob whose source file was touched without changing its contents
+static bool UpdateBlobSourceStamp(const char* blob_filepath, const FileStamp& source_stamp)
+{
+    FILE* file = fopen(blob_filepath, "r+b");
+    if (file == NULL)
+        return false;
+    fseek(file, offsetof(BlobHeader, m_SourceStamp), SEEK_SET);
+    const bool written = fwrite(&source_stamp, sizeof(FileStamp), 1, file) == 1;
+    fclose(file);
+    return written;
+}
+static bool ReadBlobHeader(const char* blob_filepath, BlobHeader* out_header)
+{
+    FILE* file = fopen(blob_filepath, "rb");
+    if (file == NULL)
+        return false;
+    const bool read = fread(out_header, sizeof(BlobHeader), 1, file) == 1;
+    fclose(file);
+    return read;
+}
 
 #endif